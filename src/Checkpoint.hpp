@@ -0,0 +1,264 @@
+#ifndef CHECKPOINT_H_
+#define CHECKPOINT_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <limits>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <type_traits>
+#include <unistd.h>
+#include <utility>
+
+/**
+ * @brief on-disk layout of a tree checkpoint
+ *
+ * A checkpoint is a header followed by one section per level, leafs first and the root level last, and finally the
+ * buffered late entries. Every node is a fixed size record so the position of any node follows from the header alone,
+ * children are referenced by their index on the level below instead of by pointer. This keeps the file position
+ * independent, it can be copied into a tree in parallel or queried in place.
+ */
+namespace checkpoint {
+  // "TTREECKP" in little endian
+  inline constexpr uint64_t MAGIC = 0x504B434545525454;
+  inline constexpr uint32_t VERSION = 4;
+  // Enough for an arity of two over the full 64-bit range
+  inline constexpr std::size_t MAX_LEVELS = 64;
+  // Collapsed inner nodes have had their children removed
+  inline constexpr uint64_t NO_CHILD = std::numeric_limits<uint64_t>::max();
+
+  struct Header_t {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t leafArity;
+    uint32_t innerArity;
+    uint32_t height;
+    uint64_t lateEntries;
+    uint64_t collapsed;
+    uint64_t collapsedEnd;
+    // Last write-ahead log record reflected in the checkpoint
+    uint64_t logSequence;
+    // Number of nodes on every level, leafs first
+    std::array<uint64_t, MAX_LEVELS> levelSizes;
+  };
+
+  // Common to leaf and inner records
+  struct NodeRecord_t {
+    uint64_t start;
+    uint64_t end;
+    uint64_t aggregatePtr;
+    // Value reported by a collapsed node in place of its entries
+    double aggregateValue;
+    uint32_t count;
+    uint32_t aggregateLevel;
+    // Summary over the values of every entry below the node
+    uint64_t entries;
+    double sum;
+    double min;
+    double max;
+  };
+
+  template<std::size_t leafArity> struct LeafRecord_t {
+    NodeRecord_t node;
+    std::array<uint64_t, leafArity> starts;
+    std::array<uint64_t, leafArity> ends;
+    std::array<uint64_t, leafArity> ptrs;
+    std::array<double, leafArity> values;
+  };
+
+  template<std::size_t innerArity> struct InnerRecord_t {
+    NodeRecord_t node;
+    // Index of the first child on the level below, the others follow it
+    uint64_t firstChild;
+    std::array<uint64_t, innerArity> ends;
+  };
+
+  // Every record stays 8 byte aligned within a page aligned mapping, so they can be read in place
+  static_assert(sizeof(Header_t) % alignof(uint64_t) == 0);
+  static_assert(sizeof(LeafRecord_t<1>) % alignof(uint64_t) == 0);
+  static_assert(sizeof(InnerRecord_t<2>) % alignof(uint64_t) == 0);
+  static_assert(std::is_trivially_copyable_v<Header_t>);
+  static_assert(std::is_trivially_copyable_v<LeafRecord_t<1>>);
+  static_assert(std::is_trivially_copyable_v<InnerRecord_t<2>>);
+
+  // Byte offset of the first record on a level
+  template<std::size_t leafArity, std::size_t innerArity>
+  [[nodiscard]] std::size_t LevelOffset(const Header_t& header, std::size_t level) {
+    std::size_t offset = sizeof(Header_t);
+    for (std::size_t i = 0; i < level; ++i) {
+      const std::size_t recordSize = (i == 0) ? sizeof(LeafRecord_t<leafArity>) : sizeof(InnerRecord_t<innerArity>);
+      offset += header.levelSizes[i] * recordSize;
+    }
+    return offset;
+  }
+
+  // Size of the complete checkpoint, the late entries come after the root level as start, end, ptr, value
+  template<std::size_t leafArity, std::size_t innerArity>
+  [[nodiscard]] std::size_t FileSize(const Header_t& header) {
+    return LevelOffset<leafArity, innerArity>(header, header.height) + header.lateEntries * 4 * sizeof(uint64_t);
+  }
+
+  /**
+   * @brief read only mapping of a whole file
+   *
+   * Pages are faulted in on first access, so opening is constant time regardless of the file size.
+   */
+  class MappedFile {
+  public:
+    explicit MappedFile(const std::string& path) {
+      const int fd = ::open(path.c_str(), O_RDONLY);
+      if (fd < 0) {
+        return;
+      }
+      struct stat info {};
+      if (::fstat(fd, &info) == 0 && info.st_size > 0) {
+        void* data = ::mmap(nullptr, static_cast<std::size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+          m_data = static_cast<const std::byte*>(data);
+          m_size = static_cast<std::size_t>(info.st_size);
+        }
+      }
+      ::close(fd);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile&& other) noexcept
+    : m_data(std::exchange(other.m_data, nullptr))
+    , m_size(std::exchange(other.m_size, 0)) {}
+
+    MappedFile& operator=(MappedFile&& other) noexcept {
+      std::swap(m_data, other.m_data);
+      std::swap(m_size, other.m_size);
+      return *this;
+    }
+
+    ~MappedFile() {
+      if (m_data != nullptr) {
+        ::munmap(const_cast<std::byte*>(m_data), m_size);
+      }
+    }
+
+    [[nodiscard]] bool IsOpen() const {
+      return m_data != nullptr;
+    }
+
+    [[nodiscard]] const std::byte* Data() const {
+      return m_data;
+    }
+
+    [[nodiscard]] std::size_t Size() const {
+      return m_size;
+    }
+
+    // Hints the kernel to read ahead, the whole file is about to be touched
+    void WillNeed() const {
+      if (m_data != nullptr) {
+        ::madvise(const_cast<std::byte*>(m_data), m_size, MADV_WILLNEED);
+      }
+    }
+
+  private:
+    const std::byte* m_data{nullptr};
+    std::size_t m_size{0};
+  };
+
+  // Reads the header of a mapped checkpoint, false unless it is complete and matches the arities
+  template<std::size_t leafArity, std::size_t innerArity>
+  [[nodiscard]] bool ReadHeader(const MappedFile& file, Header_t& header) {
+    if (!file.IsOpen() || file.Size() < sizeof(header)) {
+      return false;
+    }
+    std::memcpy(&header, file.Data(), sizeof(header));
+    if (header.magic != MAGIC || header.version != VERSION || header.leafArity != leafArity
+        || header.innerArity != innerArity || header.height == 0 || header.height > MAX_LEVELS
+        || header.levelSizes[0] == 0 || header.levelSizes[header.height - 1] != 1) {
+      return false;
+    }
+    // No single section may be larger than the file, so computing the file size can't overflow
+    for (std::size_t level = 0; level < header.height; ++level) {
+      const std::size_t recordSize = (level == 0) ? sizeof(LeafRecord_t<leafArity>) : sizeof(InnerRecord_t<innerArity>);
+      if (header.levelSizes[level] > file.Size() / recordSize) {
+        return false;
+      }
+    }
+    return header.lateEntries <= file.Size() / (4 * sizeof(uint64_t))
+        && file.Size() == FileSize<leafArity, innerArity>(header);
+  }
+
+  /**
+   * @brief checks every record of a checkpoint whose header was accepted by ReadHeader
+   *
+   * No count may exceed the arity. The nodes of an inner level that are not collapsed have to cover the level below
+   * with their children in order, the way TimeTree::Save writes them, so every child index stays in bounds.
+   */
+  template<std::size_t leafArity, std::size_t innerArity>
+  [[nodiscard]] bool ValidateRecords(const MappedFile& file, const Header_t& header) {
+    const std::byte* leafs = file.Data() + LevelOffset<leafArity, innerArity>(header, 0);
+    for (std::size_t i = 0; i < header.levelSizes[0]; ++i) {
+      const auto* record =
+          reinterpret_cast<const LeafRecord_t<leafArity>*>(leafs + i * sizeof(LeafRecord_t<leafArity>));
+      if (record->node.count > leafArity) {
+        return false;
+      }
+    }
+    for (std::size_t level = 1; level < header.height; ++level) {
+      const std::byte* section = file.Data() + LevelOffset<leafArity, innerArity>(header, level);
+      const uint64_t below = header.levelSizes[level - 1];
+      uint64_t nextChild = 0;
+      for (std::size_t i = 0; i < header.levelSizes[level]; ++i) {
+        const auto* record =
+            reinterpret_cast<const InnerRecord_t<innerArity>*>(section + i * sizeof(InnerRecord_t<innerArity>));
+        if (record->node.count > innerArity || (record->node.aggregateLevel != 0) != (record->firstChild == NO_CHILD)) {
+          return false;
+        }
+        if (record->firstChild == NO_CHILD) {
+          continue;
+        }
+        if (record->node.count == 0 || record->firstChild != nextChild || record->node.count > below - nextChild) {
+          return false;
+        }
+        nextChild += record->node.count;
+      }
+      if (nextChild != below) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /**
+   * @brief moves a checkpoint written to temporary over path, durably
+   *
+   * The file is synced before the rename and its directory after it, so a crash leaves either the previous or the new
+   * checkpoint behind and never a partial one. Once this returns true a write-ahead log can be truncated.
+   */
+  [[nodiscard]] inline bool Replace(const std::string& temporary, const std::string& path) {
+    const int fd = ::open(temporary.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      return false;
+    }
+    const bool synced = ::fsync(fd) == 0;
+    ::close(fd);
+    if (!synced || std::rename(temporary.c_str(), path.c_str()) != 0) {
+      return false;
+    }
+    const std::filesystem::path directory = std::filesystem::path(path).parent_path();
+    const int directoryFd = ::open(directory.empty() ? "." : directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (directoryFd < 0) {
+      return false;
+    }
+    const bool renamed = ::fsync(directoryFd) == 0;
+    ::close(directoryFd);
+    return renamed;
+  }
+} // namespace checkpoint
+
+#endif // CHECKPOINT_H_
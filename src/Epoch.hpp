@@ -0,0 +1,115 @@
+#ifndef EPOCH_H_
+#define EPOCH_H_
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <thread>
+#include <utility>
+
+/**
+ * @brief epoch based reclamation for a single writer and any number of readers
+ *
+ * Readers pin the current epoch into a slot for as long as they hold pointers into the shared structure. The writer
+ * stamps everything it unlinks with the epoch at that moment and frees it once no reader is pinned at or before that
+ * epoch anymore. Pinning is a single compare and swap on a slot of its own cache line, readers never wait on the
+ * writer and the writer never waits on readers when reclaiming.
+ */
+class EpochManager {
+public:
+  static constexpr std::size_t MAX_READERS = 128;
+
+  class Guard {
+  public:
+    Guard() = default;
+    explicit Guard(std::atomic<uint64_t>* slot)
+    : m_slot(slot) {}
+
+    Guard(const Guard&) = delete;
+    Guard& operator=(const Guard&) = delete;
+
+    Guard(Guard&& other) noexcept
+    : m_slot(std::exchange(other.m_slot, nullptr)) {}
+
+    Guard& operator=(Guard&& other) noexcept {
+      std::swap(m_slot, other.m_slot);
+      return *this;
+    }
+
+    ~Guard() {
+      Unpin();
+    }
+
+    void Unpin() {
+      if (m_slot != nullptr) {
+        m_slot->store(0, std::memory_order_release);
+        m_slot = nullptr;
+      }
+    }
+
+  private:
+    std::atomic<uint64_t>* m_slot{nullptr};
+  };
+
+  // Readers beyond MAX_READERS spin until a slot frees up
+  [[nodiscard]] Guard Pin() {
+    thread_local const std::size_t hint = std::hash<std::thread::id>{}(std::this_thread::get_id());
+    while (true) {
+      for (std::size_t i = 0; i < MAX_READERS; ++i) {
+        std::atomic<uint64_t>& slot = m_slots[(hint + i) % MAX_READERS].epoch;
+        uint64_t expected = 0;
+        if (slot.load(std::memory_order_relaxed) == 0
+            && slot.compare_exchange_strong(expected, m_epoch.load(std::memory_order_seq_cst))) {
+          return Guard(&slot);
+        }
+      }
+      std::this_thread::yield();
+    }
+  }
+
+  [[nodiscard]] uint64_t GetEpoch() const {
+    return m_epoch.load(std::memory_order_seq_cst);
+  }
+
+  /**
+   * @brief moves on to a new epoch and returns the oldest epoch still pinned by a reader
+   *
+   * Anything stamped before the returned epoch can no longer be reached by any reader.
+   */
+  [[nodiscard]] uint64_t Advance() {
+    uint64_t oldest = m_epoch.fetch_add(1, std::memory_order_seq_cst) + 1;
+    for (const Slot_t& slot : m_slots) {
+      const uint64_t pinned = slot.epoch.load(std::memory_order_seq_cst);
+      if (pinned != 0) {
+        oldest = std::min(oldest, pinned);
+      }
+    }
+    return oldest;
+  }
+
+  // Blocks until every reader pinned before epoch has left
+  void WaitForReaders(uint64_t epoch) const {
+    for (const Slot_t& slot : m_slots) {
+      while (true) {
+        const uint64_t pinned = slot.epoch.load(std::memory_order_seq_cst);
+        if (pinned == 0 || pinned >= epoch) {
+          break;
+        }
+        std::this_thread::yield();
+      }
+    }
+  }
+
+private:
+  struct alignas(64) Slot_t {
+    std::atomic<uint64_t> epoch{0};
+  };
+
+  std::atomic<uint64_t> m_epoch{1};
+  std::array<Slot_t, MAX_READERS> m_slots;
+};
+
+#endif // EPOCH_H_
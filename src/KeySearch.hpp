@@ -0,0 +1,131 @@
+#ifndef KEYSEARCH_H_
+#define KEYSEARCH_H_
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+#if defined(__x86_64__) || defined(__i386__)
+  #include <immintrin.h>
+  #define TIME_TREE_X86 1
+#endif
+
+/**
+ * @brief search kernels over the structure-of-arrays key layout of the tree nodes
+ *
+ * Every kernel answers the same question: the index of the first key that is greater or equal to a value, or the
+ * number of keys when there is none. The vector kernels are compiled with target attributes so a single binary
+ * contains all of them, the active one is picked at runtime from what the CPU supports and can be overridden with
+ * SetKernel() to compare against the scalar fallback.
+ */
+namespace simd {
+  enum Kernel_e { SCALAR, SSE42, AVX2 };
+
+  inline std::size_t FirstGreaterEqualScalar(const uint64_t* keys, std::size_t count, uint64_t value) {
+    for (std::size_t i = 0; i < count; ++i) {
+      if (keys[i] >= value) {
+        return i;
+      }
+    }
+    return count;
+  }
+
+#ifdef TIME_TREE_X86
+  // x86 only has signed 64-bit compares, flipping the sign bit maps unsigned order onto signed order
+  __attribute__((target("sse4.2"))) inline std::size_t
+      FirstGreaterEqualSse42(const uint64_t* keys, std::size_t count, uint64_t value) {
+    const __m128i bias = _mm_set1_epi64x(std::numeric_limits<int64_t>::min());
+    const __m128i needle = _mm_xor_si128(_mm_set1_epi64x(static_cast<int64_t>(value)), bias);
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+      unsigned below = 0;
+      for (std::size_t j = 0; j < 4; ++j) {
+        const __m128i block = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i + 2 * j)), bias);
+        below |= static_cast<unsigned>(_mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(needle, block)))) << (2 * j);
+      }
+      if (below != 0xFF) {
+        return i + static_cast<std::size_t>(std::countr_one(below));
+      }
+    }
+    return i + FirstGreaterEqualScalar(keys + i, count - i, value);
+  }
+
+  __attribute__((target("avx2"))) inline std::size_t
+      FirstGreaterEqualAvx2(const uint64_t* keys, std::size_t count, uint64_t value) {
+    const __m256i bias = _mm256_set1_epi64x(std::numeric_limits<int64_t>::min());
+    const __m256i needle = _mm256_xor_si256(_mm256_set1_epi64x(static_cast<int64_t>(value)), bias);
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+      const __m256i lo = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i)), bias);
+      const __m256i hi = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i + 4)), bias);
+      const auto below = static_cast<unsigned>(
+          _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(needle, lo)))
+          | (_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(needle, hi))) << 4));
+      if (below != 0xFF) {
+        return i + static_cast<std::size_t>(std::countr_one(below));
+      }
+    }
+    if (i + 4 <= count) {
+      const __m256i block = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i)), bias);
+      const auto below =
+          static_cast<unsigned>(_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(needle, block))));
+      if (below != 0xF) {
+        return i + static_cast<std::size_t>(std::countr_one(below));
+      }
+      i += 4;
+    }
+    return i + FirstGreaterEqualScalar(keys + i, count - i, value);
+  }
+#endif
+
+  inline Kernel_e BestKernel() {
+#ifdef TIME_TREE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+      return AVX2;
+    }
+    if (__builtin_cpu_supports("sse4.2")) {
+      return SSE42;
+    }
+#endif
+    return SCALAR;
+  }
+
+  inline Kernel_e& ActiveKernel() {
+    static Kernel_e kernel = BestKernel();
+    return kernel;
+  }
+
+  [[nodiscard]] inline Kernel_e GetKernel() {
+    return ActiveKernel();
+  }
+
+  // Kernels the CPU does not support fall back to the best one that it does
+  inline void SetKernel(Kernel_e kernel) {
+    ActiveKernel() = (kernel > BestKernel()) ? BestKernel() : kernel;
+  }
+
+  inline std::size_t FirstGreaterEqual(const uint64_t* keys, std::size_t count, uint64_t value) {
+    switch (ActiveKernel()) {
+#ifdef TIME_TREE_X86
+      case AVX2: return FirstGreaterEqualAvx2(keys, count, value);
+      case SSE42: return FirstGreaterEqualSse42(keys, count, value);
+#else
+      case AVX2:
+      case SSE42:
+#endif
+      case SCALAR: return FirstGreaterEqualScalar(keys, count, value);
+    }
+    return FirstGreaterEqualScalar(keys, count, value);
+  }
+
+  inline std::size_t FirstGreater(const uint64_t* keys, std::size_t count, uint64_t value) {
+    if (value == std::numeric_limits<uint64_t>::max()) {
+      return count;
+    }
+    return FirstGreaterEqual(keys, count, value + 1);
+  }
+} // namespace simd
+
+#endif // KEYSEARCH_H_
@@ -0,0 +1,135 @@
+#ifndef LEAFCODEC_H_
+#define LEAFCODEC_H_
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief byte encoding for the entries of a sealed leaf
+ *
+ * Entries are written one after the other as four fields, each relative to the entry before it:
+ * - start: delta-of-delta, zigzag varint. Regularly spaced series take a single zero byte per entry.
+ * - width (end - start): difference to the previous width, zigzag varint.
+ * - ptr: delta-of-delta, zigzag varint. Increasing offsets into equally sized segments take a single byte.
+ * - value: bits xor'ed with the previous value, the meaningful bytes behind a header byte giving the number of leading
+ *   and trailing zero bytes. Repeated values take the header byte only.
+ * The first entry is encoded against zeros, so the encoding is self contained and is decoded front to back.
+ */
+namespace codec {
+  inline uint64_t ZigZag(uint64_t delta) {
+    return (delta << 1) ^ static_cast<uint64_t>(static_cast<int64_t>(delta) >> 63);
+  }
+
+  inline uint64_t UnZigZag(uint64_t encoded) {
+    return (encoded >> 1) ^ (~(encoded & 1) + 1);
+  }
+
+  inline void PutVarint(std::vector<uint8_t>& out, uint64_t value) {
+    while (value >= 0x80) {
+      out.push_back(static_cast<uint8_t>(value | 0x80));
+      value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+  }
+
+  inline uint64_t GetVarint(const uint8_t*& in) {
+    uint64_t value = 0;
+    for (unsigned shift = 0;; shift += 7) {
+      const uint8_t byte = *in++;
+      value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+      if (byte < 0x80) {
+        return value;
+      }
+    }
+  }
+
+  // Header 0 marks an unchanged value, otherwise 1 + leading * 8 + trailing zero bytes of the xor
+  inline void PutXor(std::vector<uint8_t>& out, uint64_t bits) {
+    if (bits == 0) {
+      out.push_back(0);
+      return;
+    }
+    const auto leading = static_cast<unsigned>(std::countl_zero(bits)) / 8;
+    const auto trailing = static_cast<unsigned>(std::countr_zero(bits)) / 8;
+    out.push_back(static_cast<uint8_t>(1 + leading * 8 + trailing));
+    for (unsigned i = trailing; i < 8 - leading; ++i) {
+      out.push_back(static_cast<uint8_t>(bits >> (8 * i)));
+    }
+  }
+
+  inline uint64_t GetXor(const uint8_t*& in) {
+    const unsigned header = *in++;
+    if (header == 0) {
+      return 0;
+    }
+    const unsigned leading = (header - 1) / 8;
+    const unsigned trailing = (header - 1) % 8;
+    uint64_t bits = 0;
+    for (unsigned i = trailing; i < 8 - leading; ++i) {
+      bits |= static_cast<uint64_t>(*in++) << (8 * i);
+    }
+    return bits;
+  }
+
+  // Appends the encoding of count entries to out
+  inline void EncodeEntries(
+      const uint64_t* starts,
+      const uint64_t* ends,
+      const uint64_t* ptrs,
+      const double* values,
+      std::size_t count,
+      std::vector<uint8_t>& out) {
+    uint64_t start = 0;
+    uint64_t startDelta = 0;
+    uint64_t width = 0;
+    uint64_t ptr = 0;
+    uint64_t ptrDelta = 0;
+    uint64_t value = 0;
+    for (std::size_t i = 0; i < count; ++i) {
+      const uint64_t nextStartDelta = starts[i] - start;
+      PutVarint(out, ZigZag(nextStartDelta - startDelta));
+      start = starts[i];
+      startDelta = nextStartDelta;
+
+      const uint64_t nextWidth = ends[i] - starts[i];
+      PutVarint(out, ZigZag(nextWidth - width));
+      width = nextWidth;
+
+      const uint64_t nextPtrDelta = ptrs[i] - ptr;
+      PutVarint(out, ZigZag(nextPtrDelta - ptrDelta));
+      ptr = ptrs[i];
+      ptrDelta = nextPtrDelta;
+
+      const auto bits = std::bit_cast<uint64_t>(values[i]);
+      PutXor(out, bits ^ value);
+      value = bits;
+    }
+  }
+
+  // Decodes count entries written by EncodeEntries() back into separate arrays
+  inline void DecodeEntries(
+      const uint8_t* in, std::size_t count, uint64_t* starts, uint64_t* ends, uint64_t* ptrs, double* values) {
+    uint64_t start = 0;
+    uint64_t startDelta = 0;
+    uint64_t width = 0;
+    uint64_t ptr = 0;
+    uint64_t ptrDelta = 0;
+    uint64_t value = 0;
+    for (std::size_t i = 0; i < count; ++i) {
+      startDelta += UnZigZag(GetVarint(in));
+      start += startDelta;
+      width += UnZigZag(GetVarint(in));
+      ptrDelta += UnZigZag(GetVarint(in));
+      ptr += ptrDelta;
+      value ^= GetXor(in);
+      starts[i] = start;
+      ends[i] = start + width;
+      ptrs[i] = ptr;
+      values[i] = std::bit_cast<double>(value);
+    }
+  }
+} // namespace codec
+
+#endif // LEAFCODEC_H_
@@ -0,0 +1,810 @@
+#ifndef MAPPEDTIMETREE_H_
+#define MAPPEDTIMETREE_H_
+
+#include "Checkpoint.hpp"
+#include "KeySearch.hpp"
+#include "ThreadPool.hpp"
+#include "TimeTree.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <optional>
+#include <span>
+#include <string>
+#include <tl/expected.hpp>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief read only tree queried in place from a memory mapped checkpoint
+ *
+ * Nodes are addressed by their level and index instead of by pointer, the children of an inner record follow its
+ * first child index and the next node on a level is simply the next record. Nothing is deserialized, opening only maps
+ * the file and checks its records, pages are faulted in by the queries touching them and shared through the page cache
+ * with every other process mapping the same checkpoint. The query API matches the one of TimeTree.
+ */
+template<std::size_t leafArity, std::size_t innerArity = leafArity> class MappedTimeTree {
+public:
+  using LeafRecord = checkpoint::LeafRecord_t<leafArity>;
+  using InnerRecord = checkpoint::InnerRecord_t<innerArity>;
+
+  // Position of a node, leafs are on level 0
+  struct NodeRef_t {
+    std::size_t level;
+    std::size_t index;
+
+    [[nodiscard]] bool Valid() const {
+      return index != checkpoint::NO_CHILD;
+    }
+
+    friend bool operator==(const NodeRef_t& a, const NodeRef_t& b) = default;
+  };
+
+  static constexpr NodeRef_t NO_NODE{0, checkpoint::NO_CHILD};
+
+  struct NodeSlice_t {
+    std::size_t first;
+    std::size_t last;
+    bool final;
+  };
+
+  /**
+   * @brief range over the entries of a query, walks the records as it is iterated
+   *
+   * Late entries stored with the checkpoint are merged in by start.
+   */
+  class EntryRange {
+  public:
+    struct Iterator {
+      using iterator_category = std::forward_iterator_tag;
+      using difference_type = std::ptrdiff_t;
+      using value_type = TimeRange_t;
+      using pointer = const TimeRange_t*;
+      using reference = TimeRange_t;
+
+      Iterator() = default;
+      Iterator(const MappedTimeTree* tree, NodeRef_t node, uint64_t start, uint64_t end)
+      : m_tree(tree)
+      , m_node(node)
+      , m_late(tree->m_late)
+      , m_lateEnd(tree->m_late + tree->m_header.lateEntries)
+      , m_start(start)
+      , m_end(end) {
+        Load();
+        SkipLate();
+      }
+
+      TimeRange_t operator*() const {
+        return FromLate() ? *m_late : m_tree->EntryAt(m_node, m_slice.first);
+      }
+
+      Iterator& operator++() {
+        if (FromLate()) {
+          ++m_late;
+          SkipLate();
+          return *this;
+        }
+        ++m_slice.first;
+        if (m_slice.first == m_slice.last) {
+          m_node = m_slice.final ? NO_NODE : m_tree->NextNode(m_node);
+          Load();
+        }
+        return *this;
+      }
+      Iterator operator++(int) {
+        Iterator tmp = *this;
+        ++(*this);
+        return tmp;
+      }
+
+      friend bool operator==(const Iterator& a, const Iterator& b) {
+        return a.m_node == b.m_node && (!a.m_node.Valid() || a.m_slice.first == b.m_slice.first)
+            && a.m_late == b.m_late;
+      }
+      friend bool operator!=(const Iterator& a, const Iterator& b) {
+        return !(a == b);
+      }
+
+    private:
+      [[nodiscard]] bool FromLate() const {
+        return m_late != m_lateEnd && (!m_node.Valid() || m_late->start < m_tree->EntryAt(m_node, m_slice.first).start);
+      }
+
+      // Moves on to the first late entry overlapping the range, the end iterator has none left
+      void SkipLate() {
+        while (m_late != m_lateEnd && m_late->end < m_start) {
+          ++m_late;
+        }
+        if (m_late == m_lateEnd || m_late->start > m_end) {
+          m_late = m_lateEnd = nullptr;
+        }
+      }
+
+      // Moves on to the first node with entries in range, or the end
+      void Load() {
+        while (m_node.Valid()) {
+          m_slice = m_tree->SliceNode(m_node, m_start, m_end);
+          if (m_slice.first != m_slice.last) {
+            return;
+          }
+          m_node = m_slice.final ? NO_NODE : m_tree->NextNode(m_node);
+        }
+      }
+
+      const MappedTimeTree* m_tree{nullptr};
+      NodeRef_t m_node{NO_NODE};
+      const TimeRange_t* m_late{nullptr};
+      const TimeRange_t* m_lateEnd{nullptr};
+      uint64_t m_start{0};
+      uint64_t m_end{0};
+      NodeSlice_t m_slice{0, 0, true};
+    };
+
+    EntryRange(const MappedTimeTree* tree, NodeRef_t first, uint64_t start, uint64_t end)
+    : m_tree(tree)
+    , m_first(first)
+    , m_start(start)
+    , m_end(end) {}
+
+    [[nodiscard]] Iterator begin() const {
+      return Iterator(m_tree, m_first, m_start, m_end);
+    }
+    [[nodiscard]] Iterator end() const {
+      return Iterator();
+    }
+
+  private:
+    const MappedTimeTree* m_tree;
+    NodeRef_t m_first;
+    uint64_t m_start;
+    uint64_t m_end;
+  };
+
+  /**
+   * @brief maps a checkpoint written by TimeTree::Save
+   *
+   * Checkpoints written with a different arity are rejected. Every record is checked once here, so the queries can
+   * follow counts and child indexes without bounds checks.
+   */
+  static tl::expected<MappedTimeTree, Errors_e> Open(const std::string& path) {
+    checkpoint::MappedFile file(path);
+    if (!file.IsOpen()) {
+      return tl::unexpected(Errors_e::IO_ERROR);
+    }
+    checkpoint::Header_t header{};
+    if (!checkpoint::ReadHeader<leafArity, innerArity>(file, header)
+        || !checkpoint::ValidateRecords<leafArity, innerArity>(file, header)) {
+      return tl::unexpected(Errors_e::INVALID_CHECKPOINT);
+    }
+    return MappedTimeTree(std::move(file), header);
+  }
+
+  [[nodiscard]] std::size_t GetHeight() const {
+    return m_header.height;
+  }
+
+  [[nodiscard]] std::size_t GetNumberLeafs() const {
+    return m_header.levelSizes[0];
+  }
+
+  [[nodiscard]] std::size_t GetLateEntryCount() const {
+    return m_header.lateEntries;
+  }
+
+  [[nodiscard]] const checkpoint::NodeRecord_t& GetRoot() const {
+    return GetNode(GetRootRef());
+  }
+
+  tl::expected<std::vector<TimeRange_t>, Errors_e> Query(uint64_t start, uint64_t end) const {
+    std::vector<TimeRange_t> res;
+    auto visited = QueryVisit(start, end, [&res](const TimeRange_t& range) { res.push_back(range); });
+    if (!visited) {
+      return tl::unexpected(visited.error());
+    }
+    return res;
+  }
+
+  /**
+   * @brief streams every entry overlapping [start, end] into visitor, oldest first
+   *
+   * Collapsed nodes are passed as a single entry carrying their aggregate ptr.
+   */
+  template<typename F> tl::expected<void, Errors_e> QueryVisit(uint64_t start, uint64_t end, F&& visitor) const {
+    auto first = FindQueryStart(start, end);
+    if (!first && first.error() == Errors_e::INVALID_TIME_RANGE) {
+      return tl::unexpected(first.error());
+    }
+    if (!CollectMerged(first ? *first : NO_NODE, start, end, visitor)) {
+      return tl::unexpected(first.error());
+    }
+    return {};
+  }
+
+  /**
+   * @brief Query() spread over the threads of pool, for ranges covering a large part of the checkpoint
+   *
+   * Follows TimeTree::ParallelQuery, the range is split into subtrees of records scanned on their own and the late
+   * entries are merged into the buffers of the subtrees they fall in.
+   */
+  tl::expected<std::vector<TimeRange_t>, Errors_e> ParallelQuery(uint64_t start, uint64_t end, ThreadPool& pool) const {
+    auto first = FindQueryStart(start, end);
+    if (!first && first.error() == Errors_e::INVALID_TIME_RANGE) {
+      return tl::unexpected(first.error());
+    }
+    std::vector<TimeRange_t> late;
+    for (const TimeRange_t* range = m_late; range != m_late + m_header.lateEntries && range->start <= end; ++range) {
+      if (range->end >= start) {
+        late.push_back(*range);
+      }
+    }
+    if (!first && late.empty()) {
+      return tl::unexpected(first.error());
+    }
+
+    std::vector<NodeRef_t> parts;
+    if (first) {
+      parts = SplitRange(start, end, pool.GetThreadCount() * PARTS_PER_THREAD);
+    }
+    std::vector<std::vector<TimeRange_t>> scanned(parts.size());
+    std::vector<char> finals(parts.size(), 0);
+    pool.ParallelFor(parts.size(), [this, &parts, &scanned, &finals, start, end](std::size_t i) {
+      auto collect = [&scanned, i](const TimeRange_t& range) { scanned[i].push_back(range); };
+      finals[i] = CollectSubtree(parts[i], start, end, collect) ? 1 : 0;
+    });
+    // Like a serial query everything after the first final record is left out
+    const auto final = std::find(finals.begin(), finals.end(), 1);
+    if (final != finals.end()) {
+      parts.resize(static_cast<std::size_t>(final - finals.begin()) + 1);
+    }
+
+    // A late entry goes before the first entry from the leafs that starts after it, in whichever part that is
+    std::vector<std::size_t> offsets(parts.size() + 1, 0);
+    std::vector<std::size_t> lateEnds(parts.size() + 1, 0);
+    for (std::size_t i = 0; i < parts.size(); ++i) {
+      lateEnds[i + 1] = lateEnds[i];
+      if (!scanned[i].empty()) {
+        lateEnds[i + 1] = static_cast<std::size_t>(
+            std::lower_bound(
+                late.begin() + static_cast<std::ptrdiff_t>(lateEnds[i]),
+                late.end(),
+                scanned[i].back().start,
+                [](const TimeRange_t& range, uint64_t value) { return range.start < value; })
+            - late.begin());
+      }
+      offsets[i + 1] = offsets[i] + scanned[i].size() + lateEnds[i + 1] - lateEnds[i];
+    }
+    std::vector<TimeRange_t> res(offsets.back() + late.size() - lateEnds.back());
+    pool.ParallelFor(parts.size(), [&](std::size_t i) {
+      std::merge(
+          scanned[i].begin(),
+          scanned[i].end(),
+          late.begin() + static_cast<std::ptrdiff_t>(lateEnds[i]),
+          late.begin() + static_cast<std::ptrdiff_t>(lateEnds[i + 1]),
+          res.begin() + static_cast<std::ptrdiff_t>(offsets[i]),
+          [](const TimeRange_t& a, const TimeRange_t& b) { return a.start < b.start; });
+      scanned[i] = {};
+    });
+    std::copy(
+        late.begin() + static_cast<std::ptrdiff_t>(lateEnds.back()),
+        late.end(),
+        res.begin() + static_cast<std::ptrdiff_t>(offsets.back()));
+    return res;
+  }
+
+  /**
+   * @brief copies the entries of several windows out of the checkpoint in a single sweep
+   *
+   * Follows TimeTree::QueryMany, every window continues the descent of the one before it from the lowest record that
+   * still reaches its start.
+   */
+  tl::expected<void, Errors_e> QueryMany(
+      std::span<const std::pair<uint64_t, uint64_t>> windows,
+      std::vector<TimeRange_t>& out,
+      std::vector<std::size_t>& offsets) const {
+    for (std::size_t i = 0; i < windows.size(); ++i) {
+      if (windows[i].first > windows[i].second || (i != 0 && windows[i].first < windows[i - 1].first)) {
+        return tl::unexpected(Errors_e::INVALID_TIME_RANGE);
+      }
+    }
+    out.clear();
+    offsets.clear();
+    offsets.reserve(windows.size() + 1);
+    offsets.push_back(0);
+
+    std::vector<NodeRef_t> path{GetRootRef()};
+    auto collect = [&out](const TimeRange_t& range) { out.push_back(range); };
+    for (const auto& [start, end] : windows) {
+      CollectMerged(FindStartFromPath(path, start), start, end, collect);
+      offsets.push_back(out.size());
+    }
+    return {};
+  }
+
+  /**
+   * @brief count, sum, min and max over the values of every entry overlapping [start, end]
+   *
+   * Follows TimeTree::AggregateQuery, only the records on the edges of the range are read.
+   */
+  tl::expected<Summary_t, Errors_e> AggregateQuery(uint64_t start, uint64_t end) const {
+    auto first = FindQueryStart(start, end);
+    Summary_t summary;
+    bool found = false;
+    for (const TimeRange_t* late = m_late; late != m_late + m_header.lateEntries && late->start <= end; ++late) {
+      if (late->end >= start) {
+        summary.Add(late->value);
+        found = true;
+      }
+    }
+    if (!first) {
+      if (first.error() == Errors_e::INVALID_TIME_RANGE || !found) {
+        return tl::unexpected(first.error());
+      }
+      return summary;
+    }
+    SummarizeNode(GetRootRef(), start, end, summary);
+    return summary;
+  }
+
+  /**
+   * @brief number of entries overlapping [start, end], without copying any of them
+   *
+   * Follows TimeTree::Count, records lying entirely inside the range add the entry count of their summary.
+   */
+  tl::expected<uint64_t, Errors_e> Count(uint64_t start, uint64_t end) const {
+    if (start > end) {
+      return tl::unexpected(Errors_e::INVALID_TIME_RANGE);
+    }
+    uint64_t count = 0;
+    for (const TimeRange_t* late = m_late; late != m_late + m_header.lateEntries && late->start <= end; ++late) {
+      count += late->end >= start ? 1 : 0;
+    }
+    return count + CountNode(GetRootRef(), start, end);
+  }
+
+  // Whether any entry overlaps [start, end], stops at the first one found
+  [[nodiscard]] bool Any(uint64_t start, uint64_t end) const {
+    for (const TimeRange_t* late = m_late; late != m_late + m_header.lateEntries && late->start <= end; ++late) {
+      if (late->end >= start) {
+        return true;
+      }
+    }
+    auto first = FindQueryStart(start, end);
+    if (!first) {
+      return false;
+    }
+    for (NodeRef_t current = *first; current.Valid(); current = NextNode(current)) {
+      const NodeSlice_t slice = SliceNode(current, start, end);
+      if (slice.first != slice.last) {
+        return true;
+      }
+      if (slice.final) {
+        return false;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * @brief lazy range over every entry overlapping [start, end], oldest first
+   *
+   * The range refers to the mapping, it must not outlive the tree.
+   */
+  tl::expected<EntryRange, Errors_e> QueryRange(uint64_t start, uint64_t end) const {
+    auto first = FindQueryStart(start, end);
+    if (!first) {
+      if (first.error() == Errors_e::INVALID_TIME_RANGE || m_header.lateEntries == 0) {
+        return tl::unexpected(first.error());
+      }
+      return EntryRange(this, NO_NODE, start, end);
+    }
+    return EntryRange(this, *first, start, end);
+  }
+
+  /**
+   * @brief copies the n newest entries starting no later than before, newest first
+   *
+   * Follows TimeTree::QueryLatest, walking the records back from the one holding before.
+   */
+  tl::expected<std::vector<TimeRange_t>, Errors_e>
+      QueryLatest(std::size_t n, uint64_t before = std::numeric_limits<uint64_t>::max()) const {
+    std::vector<TimeRange_t> res;
+    res.reserve(std::min<std::size_t>(n, 1 << 16));
+    const TimeRange_t* late = std::upper_bound(
+        m_late, m_late + m_header.lateEntries, before, [](uint64_t value, const TimeRange_t& range) {
+          return value < range.start;
+        });
+    auto visitLate = [&](uint64_t from) {
+      for (; late != m_late && late[-1].start >= from && res.size() < n; --late) {
+        res.push_back(late[-1]);
+      }
+    };
+    for (NodeRef_t current = FindLatestUnit(before); current.Valid() && res.size() < n; current = PrevNode(current)) {
+      const NodeSlice_t slice = SliceNode(current, 0, before);
+      for (std::size_t i = slice.last; i-- > slice.first && res.size() < n;) {
+        const TimeRange_t range = EntryAt(current, i);
+        visitLate(range.start);
+        if (res.size() < n) {
+          res.push_back(range);
+        }
+      }
+    }
+    visitLate(0);
+    if (res.empty() && n != 0) {
+      return tl::unexpected(Errors_e::RANGE_NOT_IN_DB);
+    }
+    return res;
+  }
+
+  /**
+   * @brief the entry holding t, or the newest one before it, std::nullopt when every entry starts after t
+   *
+   * Follows TimeTree::AsOf, a single descent over the records and a binary search over the late entries.
+   */
+  [[nodiscard]] std::optional<TimeRange_t> AsOf(uint64_t t) const {
+    std::optional<TimeRange_t> res = FindAsOf(t);
+    const TimeRange_t* late = std::upper_bound(
+        m_late, m_late + m_header.lateEntries, t, [](uint64_t value, const TimeRange_t& range) {
+          return value < range.start;
+        });
+    // Late entries go after entries from the leafs with the same start, as in Query()
+    if (late != m_late && (!res || late[-1].start >= res->start)) {
+      res = late[-1];
+    }
+    return res;
+  }
+
+  // Descends to the leaf or collapsed node holding start, without touching any other node
+  [[nodiscard]] NodeRef_t FindStartOfRange(uint64_t start) const {
+    NodeRef_t node = GetRootRef();
+    while (node.level != 0 && GetNode(node).aggregateLevel == 0) {
+      const InnerRecord& inner = GetInner(node);
+      const std::size_t index = simd::FirstGreaterEqual(inner.ends.data(), inner.node.count, start);
+      if (index == inner.node.count) {
+        return NO_NODE;
+      }
+      node = {node.level - 1, inner.firstChild + index};
+    }
+    return node;
+  }
+
+private:
+  MappedTimeTree(checkpoint::MappedFile file, const checkpoint::Header_t& header)
+  : m_file(std::move(file))
+  , m_header(header) {
+    for (std::size_t level = 0; level < m_header.height; ++level) {
+      m_levels[level] = m_file.Data() + checkpoint::LevelOffset<leafArity, innerArity>(m_header, level);
+    }
+    m_late = reinterpret_cast<const TimeRange_t*>(
+        m_file.Data() + checkpoint::LevelOffset<leafArity, innerArity>(m_header, m_header.height));
+  }
+
+  [[nodiscard]] NodeRef_t GetRootRef() const {
+    return {m_header.height - 1, 0};
+  }
+
+  [[nodiscard]] const LeafRecord& GetLeaf(NodeRef_t node) const {
+    return *reinterpret_cast<const LeafRecord*>(m_levels[0] + node.index * sizeof(LeafRecord));
+  }
+
+  [[nodiscard]] const InnerRecord& GetInner(NodeRef_t node) const {
+    return *reinterpret_cast<const InnerRecord*>(m_levels[node.level] + node.index * sizeof(InnerRecord));
+  }
+
+  [[nodiscard]] const checkpoint::NodeRecord_t& GetNode(NodeRef_t node) const {
+    return (node.level == 0) ? GetLeaf(node).node : GetInner(node).node;
+  }
+
+  tl::expected<NodeRef_t, Errors_e> FindQueryStart(uint64_t start, uint64_t end) const {
+    if (start > end) {
+      return tl::unexpected(Errors_e::INVALID_TIME_RANGE);
+    }
+    const checkpoint::NodeRecord_t& root = GetRoot();
+    if (start > root.end || end < root.start) {
+      return tl::unexpected(Errors_e::RANGE_NOT_IN_DB);
+    }
+    const NodeRef_t node = FindStartOfRange(start);
+    if (!node.Valid()) {
+      return tl::unexpected(Errors_e::RANGE_NOT_IN_DB);
+    }
+    return node;
+  }
+
+  [[nodiscard]] NodeRef_t NextNode(NodeRef_t current) const {
+    if (current.index + 1 == m_header.levelSizes[current.level]) {
+      return NO_NODE;
+    }
+    NodeRef_t next{current.level, current.index + 1};
+    while (next.level != 0 && GetNode(next).aggregateLevel == 0) {
+      next = {next.level - 1, GetInner(next).firstChild};
+    }
+    return next;
+  }
+
+  // Same as TimeTree::PrevUnit, the oldest record of a level follows the collapsed records left of its parent
+  [[nodiscard]] NodeRef_t PrevNode(NodeRef_t current) const {
+    while (current.index == 0) {
+      if (current.level + 1 == m_header.height) {
+        return NO_NODE;
+      }
+      // Parent of the oldest record of a level is the oldest record above that is not collapsed
+      NodeRef_t parent{current.level + 1, 0};
+      while (GetNode(parent).aggregateLevel != 0) {
+        ++parent.index;
+      }
+      current = parent;
+    }
+    return LastUnit({current.level, current.index - 1});
+  }
+
+  // Newest leaf or collapsed record below node
+  [[nodiscard]] NodeRef_t LastUnit(NodeRef_t node) const {
+    while (node.level != 0 && GetNode(node).aggregateLevel == 0) {
+      const InnerRecord& inner = GetInner(node);
+      node = {node.level - 1, inner.firstChild + inner.node.count - 1};
+    }
+    return node;
+  }
+
+  // Same as TimeTree::FindLatestUnit, the newest leaf is the last record of the leaf level
+  [[nodiscard]] NodeRef_t FindLatestUnit(uint64_t before) const {
+    const NodeRef_t newest = LastUnit(GetRootRef());
+    if (before >= GetNode(newest).start) {
+      return newest;
+    }
+    auto found = FindQueryStart(before, before);
+    if (!found) {
+      return before > GetRoot().end ? newest : NO_NODE;
+    }
+    NodeRef_t current = *found;
+    for (NodeRef_t next = NextNode(current); next.Valid() && GetNode(next).start <= before; next = NextNode(next)) {
+      current = next;
+    }
+    while (current.Valid() && GetNode(current).start > before) {
+      current = PrevNode(current);
+    }
+    return current;
+  }
+
+  // Same descent as TimeTree::FindAsOf, taking the last child starting at or before t on every level
+  [[nodiscard]] std::optional<TimeRange_t> FindAsOf(uint64_t t) const {
+    NodeRef_t current = GetRootRef();
+    while (current.level != 0 && GetNode(current).aggregateLevel == 0) {
+      const InnerRecord& inner = GetInner(current);
+      std::size_t index = simd::FirstGreaterEqual(inner.ends.data(), inner.node.count, t);
+      if (index == inner.node.count || GetNode({current.level - 1, inner.firstChild + index}).start > t) {
+        if (index == 0) {
+          return std::nullopt;
+        }
+        --index;
+      }
+      current = {current.level - 1, inner.firstChild + index};
+    }
+    bool last = false;
+    std::optional<TimeRange_t> res = FindLatestInNode(current, t, last);
+    // Entries overlapping t may continue into the records after it
+    while (last) {
+      current = NextNode(current);
+      if (!current.Valid() || GetNode(current).start > t) {
+        break;
+      }
+      res = FindLatestInNode(current, t, last);
+    }
+    return res;
+  }
+
+  // Entry of a leaf or collapsed record with the latest start at or before t, last is set when it is the final one
+  [[nodiscard]] std::optional<TimeRange_t> FindLatestInNode(NodeRef_t current, uint64_t t, bool& last) const {
+    const checkpoint::NodeRecord_t& node = GetNode(current);
+    if (node.aggregateLevel != 0) {
+      last = true;
+      if (node.start > t) {
+        return std::nullopt;
+      }
+      return EntryAt(current, 0);
+    }
+    const std::size_t index = simd::FirstGreater(GetLeaf(current).starts.data(), node.count, t);
+    last = index == node.count;
+    if (index == 0) {
+      return std::nullopt;
+    }
+    return EntryAt(current, index - 1);
+  }
+
+  // Same as TimeTree::FindStartFromPath, path runs from the root down to the record found for an earlier start
+  [[nodiscard]] NodeRef_t FindStartFromPath(std::vector<NodeRef_t>& path, uint64_t start) const {
+    while (path.size() > 1 && GetNode(path.back()).end < start) {
+      path.pop_back();
+    }
+    NodeRef_t node = path.back();
+    if (GetNode(node).end < start) {
+      return NO_NODE;
+    }
+    while (node.level != 0 && GetNode(node).aggregateLevel == 0) {
+      const InnerRecord& inner = GetInner(node);
+      const std::size_t index = simd::FirstGreaterEqual(inner.ends.data(), inner.node.count, start);
+      if (index == inner.node.count) {
+        return NO_NODE;
+      }
+      node = {node.level - 1, inner.firstChild + index};
+      path.push_back(node);
+    }
+    return node;
+  }
+
+  /**
+   * Entries of [start, end] from first on interleaved with the late entries, first is NO_NODE when no record reaches
+   * the range. Returns whether there was a record to start from or any late entry in range.
+   */
+  template<typename F> bool CollectMerged(NodeRef_t first, uint64_t start, uint64_t end, F& visitor) const {
+    const TimeRange_t* late = m_late;
+    const TimeRange_t* lateEnd = m_late + m_header.lateEntries;
+    bool found = false;
+    auto visitLate = [&](uint64_t before) {
+      for (; late != lateEnd && late->start < before; ++late) {
+        if (late->end >= start && late->start <= end) {
+          visitor(*late);
+          found = true;
+        }
+      }
+    };
+    for (NodeRef_t current = first; current.Valid();) {
+      const NodeSlice_t slice = SliceNode(current, start, end);
+      for (std::size_t i = slice.first; i < slice.last; ++i) {
+        const TimeRange_t range = EntryAt(current, i);
+        visitLate(range.start);
+        visitor(range);
+      }
+      current = slice.final ? NO_NODE : NextNode(current);
+      found = true;
+    }
+    visitLate(end == std::numeric_limits<uint64_t>::max() ? end : end + 1);
+    return found;
+  }
+
+  [[nodiscard]] TimeRange_t EntryAt(NodeRef_t current, std::size_t index) const {
+    const checkpoint::NodeRecord_t& node = GetNode(current);
+    if (node.aggregateLevel == 0) {
+      const LeafRecord& leaf = GetLeaf(current);
+      return {leaf.starts[index], leaf.ends[index], leaf.ptrs[index], leaf.values[index]};
+    }
+    return {node.start, node.end, node.aggregatePtr, node.aggregateValue};
+  }
+
+  [[nodiscard]] static Summary_t GetSummary(const checkpoint::NodeRecord_t& node) {
+    return {node.entries, node.sum, node.min, node.max};
+  }
+
+  // Same descent as TimeTree::SummarizeNode, on records
+  void SummarizeNode(NodeRef_t current, uint64_t start, uint64_t end, Summary_t& summary) const {
+    const checkpoint::NodeRecord_t& node = GetNode(current);
+    if (node.aggregateLevel != 0) {
+      if (node.end >= start && node.start <= end) {
+        summary.Merge(GetSummary(node));
+      }
+      return;
+    }
+    if (current.level == 0) {
+      const NodeSlice_t slice = SliceNode(current, start, end);
+      const LeafRecord& leaf = GetLeaf(current);
+      for (std::size_t i = slice.first; i < slice.last; ++i) {
+        summary.Add(leaf.values[i]);
+      }
+      return;
+    }
+    const InnerRecord& inner = GetInner(current);
+    for (std::size_t i = simd::FirstGreaterEqual(inner.ends.data(), node.count, start); i < node.count; ++i) {
+      const NodeRef_t child{current.level - 1, inner.firstChild + i};
+      const checkpoint::NodeRecord_t& childNode = GetNode(child);
+      if (childNode.start > end) {
+        break;
+      }
+      if (childNode.start >= start && childNode.end <= end) {
+        summary.Merge(GetSummary(childNode));
+      } else {
+        SummarizeNode(child, start, end, summary);
+      }
+    }
+  }
+
+  // Same as TimeTree::SplitRange, on records
+  [[nodiscard]] std::vector<NodeRef_t> SplitRange(uint64_t start, uint64_t end, std::size_t parts) const {
+    std::vector<NodeRef_t> frontier{GetRootRef()};
+    std::vector<NodeRef_t> next;
+    bool split = true;
+    while (split && frontier.size() < parts) {
+      split = false;
+      next.clear();
+      for (const NodeRef_t node : frontier) {
+        if (node.level == 0 || GetNode(node).aggregateLevel != 0) {
+          next.push_back(node);
+          continue;
+        }
+        split = true;
+        const InnerRecord& inner = GetInner(node);
+        for (std::size_t i = simd::FirstGreaterEqual(inner.ends.data(), inner.node.count, start); i < inner.node.count;
+             ++i) {
+          const NodeRef_t child{node.level - 1, inner.firstChild + i};
+          if (GetNode(child).start > end) {
+            break;
+          }
+          next.push_back(child);
+        }
+      }
+      frontier.swap(next);
+    }
+    return frontier;
+  }
+
+  // Streams the entries of [start, end] below current into visitor through the children, true once a record is final
+  template<typename F> bool CollectSubtree(NodeRef_t current, uint64_t start, uint64_t end, F& visitor) const {
+    if (current.level == 0 || GetNode(current).aggregateLevel != 0) {
+      const NodeSlice_t slice = SliceNode(current, start, end);
+      for (std::size_t i = slice.first; i < slice.last; ++i) {
+        visitor(EntryAt(current, i));
+      }
+      return slice.final;
+    }
+    const InnerRecord& inner = GetInner(current);
+    for (std::size_t i = simd::FirstGreaterEqual(inner.ends.data(), inner.node.count, start); i < inner.node.count;
+         ++i) {
+      const NodeRef_t child{current.level - 1, inner.firstChild + i};
+      if (GetNode(child).start > end || CollectSubtree(child, start, end, visitor)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  [[nodiscard]] uint64_t CountNode(NodeRef_t current, uint64_t start, uint64_t end) const {
+    const checkpoint::NodeRecord_t& node = GetNode(current);
+    if (node.aggregateLevel != 0) {
+      return node.end >= start && node.start <= end ? node.entries : 0;
+    }
+    if (current.level == 0) {
+      const NodeSlice_t slice = SliceNode(current, start, end);
+      return slice.last - slice.first;
+    }
+    const InnerRecord& inner = GetInner(current);
+    uint64_t entries = 0;
+    for (std::size_t i = simd::FirstGreaterEqual(inner.ends.data(), node.count, start); i < node.count; ++i) {
+      const NodeRef_t child{current.level - 1, inner.firstChild + i};
+      const checkpoint::NodeRecord_t& childNode = GetNode(child);
+      if (childNode.start > end) {
+        break;
+      }
+      if (childNode.start >= start && childNode.end <= end) {
+        entries += childNode.entries;
+      } else {
+        entries += CountNode(child, start, end);
+      }
+    }
+    return entries;
+  }
+
+  // Same slicing as TimeTree::SliceNode, on records
+  [[nodiscard]] NodeSlice_t SliceNode(NodeRef_t current, uint64_t start, uint64_t end) const {
+    const checkpoint::NodeRecord_t& node = GetNode(current);
+    if (node.aggregateLevel != 0) {
+      const bool overlaps = node.end >= start && node.start <= end;
+      return {0, overlaps ? 1U : 0U, node.end >= end || node.start > end};
+    }
+    const LeafRecord& leaf = GetLeaf(current);
+    const std::size_t count = node.count;
+    const std::size_t first = simd::FirstGreaterEqual(leaf.ends.data(), count, start);
+    const std::size_t last = first + simd::FirstGreater(leaf.starts.data() + first, count - first, end);
+    return {first, last, last != count || (count != 0 && leaf.ends[count - 1] >= end)};
+  }
+
+  // Subtrees a parallel query is split into per thread at least, as in TimeTree
+  static constexpr std::size_t PARTS_PER_THREAD = 8;
+
+  checkpoint::MappedFile m_file;
+  checkpoint::Header_t m_header;
+  std::array<const std::byte*, checkpoint::MAX_LEVELS> m_levels{};
+  const TimeRange_t* m_late{nullptr};
+};
+
+#endif // MAPPEDTIMETREE_H_
@@ -0,0 +1,136 @@
+#ifndef SEALEDINDEX_H_
+#define SEALEDINDEX_H_
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <new>
+#include <span>
+#include <vector>
+
+/**
+ * @brief immutable search tree over sorted keys laid out in Eytzinger order
+ *
+ * The keys are stored as an implicit binary tree in breadth first order, the children of slot k are slots 2k and
+ * 2k + 1, so a search descends without following a single pointer. The first levels share a few cache lines that stay
+ * hot, and the keys are aligned so the eight slots 8k to 8k + 7 holding the great-grandchildren of k sit in one cache
+ * line, which is prefetched while the three levels above it are compared. Every step of the descent picks the next
+ * slot from the comparison instead of branching on it.
+ *
+ * Stretches of keys that follow a fixed step can be registered as runs, a search landing in a run computes the rank
+ * of its key and only checks it against its neighbours, falling back to the descent when the guess is off.
+ */
+template<typename T> class SealedIndex {
+public:
+  // The key of rank first + k covers [base + k * step, base + (k + 1) * step), for k below count
+  struct Run_t {
+    uint64_t base;
+    uint64_t step;
+    std::size_t first;
+    std::size_t count;
+  };
+
+  // keys have to be sorted, values[i] belongs to keys[i], runs are ordered on base and don't overlap
+  SealedIndex(std::span<const uint64_t> keys, std::span<const T> values, std::vector<Run_t> runs = {})
+  : m_count(keys.size())
+  , m_keys(static_cast<uint64_t*>(::operator new[]((m_count + 1) * sizeof(uint64_t), std::align_val_t{CACHE_LINE})))
+  , m_ranks(std::make_unique<std::size_t[]>(m_count + 1))
+  , m_sorted(keys.begin(), keys.end())
+  , m_values(values.begin(), values.end())
+  , m_runs(std::move(runs)) {
+    m_keys[0] = 0;
+    std::size_t next = 0;
+    Fill(next, 1);
+  }
+
+  [[nodiscard]] std::size_t size() const {
+    return m_count;
+  }
+
+  [[nodiscard]] std::size_t GetRunCount() const {
+    return m_runs.size();
+  }
+
+  // The largest key, 0 when empty
+  [[nodiscard]] uint64_t GetLastKey() const {
+    return m_count == 0 ? 0 : m_sorted.back();
+  }
+
+  // Value of the first key greater or equal to key, nullptr when every key is smaller
+  [[nodiscard]] const T* FindFirstGreaterEqual(uint64_t key) const {
+    if (!m_runs.empty()) {
+      if (const std::size_t rank = FindInRun(key); rank != NONE) {
+        return &m_values[rank];
+      }
+    }
+    const uint64_t* keys = m_keys.get();
+    std::size_t slot = 1;
+    while (slot <= m_count) {
+      __builtin_prefetch(keys + std::min(slot * PREFETCH_STRIDE, m_count));
+      slot = 2 * slot + static_cast<std::size_t>(keys[slot] < key);
+    }
+    // Every right turn after the last left turn was taken past a smaller key, undo them and the left turn itself
+    slot >>= std::countr_one(slot) + 1;
+    return slot == 0 ? nullptr : &m_values[m_ranks[slot]];
+  }
+
+private:
+  static constexpr std::size_t CACHE_LINE = 64;
+  static constexpr std::size_t PREFETCH_STRIDE = CACHE_LINE / sizeof(uint64_t);
+  static constexpr std::size_t NONE = std::numeric_limits<std::size_t>::max();
+
+  struct AlignedDelete_t {
+    void operator()(uint64_t* keys) const {
+      ::operator delete[](keys, std::align_val_t{CACHE_LINE});
+    }
+  };
+
+  // An in-order walk over the implicit tree visits the slots in key order
+  void Fill(std::size_t& next, std::size_t slot) {
+    if (slot > m_count) {
+      return;
+    }
+    Fill(next, 2 * slot);
+    m_keys[slot] = m_sorted[next];
+    m_ranks[slot] = next;
+    ++next;
+    Fill(next, 2 * slot + 1);
+  }
+
+  // Rank of the first key greater or equal to key as computed from the run holding key, NONE when there is none
+  [[nodiscard]] std::size_t FindInRun(uint64_t key) const {
+    auto run = std::upper_bound(m_runs.begin(), m_runs.end(), key, [](uint64_t value, const Run_t& candidate) {
+      return value < candidate.base;
+    });
+    if (run == m_runs.begin()) {
+      return NONE;
+    }
+    --run;
+    const uint64_t offset = (key - run->base) / run->step;
+    if (offset >= run->count) {
+      return NONE;
+    }
+    std::size_t rank = run->first + offset;
+    // Key may fall in the gap after the end of its step, the next key is the first one past it then
+    if (m_sorted[rank] < key) {
+      ++rank;
+    }
+    if (rank == m_count || m_sorted[rank] < key || (rank != 0 && m_sorted[rank - 1] >= key)) {
+      return NONE;
+    }
+    return rank;
+  }
+
+  std::size_t m_count;
+  std::unique_ptr<uint64_t[], AlignedDelete_t> m_keys;
+  // Rank of the key in every slot, values and sorted keys are kept in rank order
+  std::unique_ptr<std::size_t[]> m_ranks;
+  std::vector<uint64_t> m_sorted;
+  std::vector<T> m_values;
+  std::vector<Run_t> m_runs;
+};
+
+#endif // SEALEDINDEX_H_
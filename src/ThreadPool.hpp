@@ -0,0 +1,163 @@
+#ifndef THREADPOOL_H_
+#define THREADPOOL_H_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @brief fixed set of worker threads sharing work through per-worker queues
+ *
+ * Work is pushed round robin onto the queues, every worker takes from the back of its own queue and steals from the
+ * front of the others once it runs dry, so uneven tasks even out without a single contended queue. The thread calling
+ * ParallelFor() works along instead of blocking, which also keeps nested calls from deadlocking the pool.
+ */
+class ThreadPool {
+public:
+  explicit ThreadPool(std::size_t threads = std::thread::hardware_concurrency()) {
+    threads = std::max<std::size_t>(threads, 1);
+    // Queue 0 belongs to the calling threads, the others to one worker each
+    for (std::size_t i = 0; i < threads; ++i) {
+      m_queues.push_back(std::make_unique<Queue_t>());
+    }
+    for (std::size_t i = 1; i < threads; ++i) {
+      m_workers.emplace_back([this, i]() { Work(i); });
+    }
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(m_sleepMutex);
+      m_stop = true;
+    }
+    m_wake.notify_all();
+    for (std::thread& worker : m_workers) {
+      worker.join();
+    }
+  }
+
+  // Number of threads running tasks, including the caller of ParallelFor()
+  [[nodiscard]] std::size_t GetThreadCount() const {
+    return m_queues.size();
+  }
+
+  /**
+   * @brief calls body(i) for every i in [0, count) and returns once all calls are done
+   *
+   * Indices are handed out in contiguous chunks, a few per thread so stealing has something to balance.
+   */
+  template<typename F> void ParallelFor(std::size_t count, F&& body) {
+    if (count == 0) {
+      return;
+    }
+    using Body = std::remove_reference_t<F>;
+    const std::size_t chunks = std::min(count, m_queues.size() * 4);
+    std::atomic<std::size_t> remaining{chunks};
+    for (std::size_t chunk = 0; chunk < chunks; ++chunk) {
+      Task_t task{
+          [](void* context, std::size_t first, std::size_t last) {
+            Body& fn = *static_cast<Body*>(context);
+            for (std::size_t i = first; i < last; ++i) {
+              fn(i);
+            }
+          },
+          const_cast<void*>(static_cast<const void*>(std::addressof(body))),
+          count * chunk / chunks,
+          count * (chunk + 1) / chunks,
+          &remaining};
+      Push(chunk % m_queues.size(), task);
+    }
+    while (remaining.load(std::memory_order_acquire) != 0) {
+      if (!RunOne(0)) {
+        std::this_thread::yield();
+      }
+    }
+  }
+
+private:
+  struct Task_t {
+    void (*run)(void* context, std::size_t first, std::size_t last);
+    void* context;
+    std::size_t first;
+    std::size_t last;
+    std::atomic<std::size_t>* remaining;
+  };
+
+  struct Queue_t {
+    std::mutex mutex;
+    std::deque<Task_t> tasks;
+  };
+
+  void Push(std::size_t queue, const Task_t& task) {
+    {
+      std::lock_guard<std::mutex> lock(m_queues[queue]->mutex);
+      m_queues[queue]->tasks.push_back(task);
+    }
+    m_pending.fetch_add(1, std::memory_order_release);
+    {
+      // Taken so a worker about to sleep can't miss the wake up
+      std::lock_guard<std::mutex> lock(m_sleepMutex);
+    }
+    m_wake.notify_one();
+  }
+
+  // Runs a task from queue self or stolen from another queue, false when there was none
+  bool RunOne(std::size_t self) {
+    Task_t task{};
+    bool found = false;
+    for (std::size_t i = 0; i < m_queues.size() && !found; ++i) {
+      Queue_t& queue = *m_queues[(self + i) % m_queues.size()];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      if (queue.tasks.empty()) {
+        continue;
+      }
+      if (i == 0) {
+        task = queue.tasks.back();
+        queue.tasks.pop_back();
+      } else {
+        task = queue.tasks.front();
+        queue.tasks.pop_front();
+      }
+      found = true;
+    }
+    if (!found) {
+      return false;
+    }
+    m_pending.fetch_sub(1, std::memory_order_relaxed);
+    task.run(task.context, task.first, task.last);
+    task.remaining->fetch_sub(1, std::memory_order_release);
+    return true;
+  }
+
+  void Work(std::size_t self) {
+    while (true) {
+      if (RunOne(self)) {
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(m_sleepMutex);
+      m_wake.wait(lock, [this]() { return m_stop || m_pending.load(std::memory_order_acquire) != 0; });
+      if (m_stop) {
+        return;
+      }
+    }
+  }
+
+  std::vector<std::unique_ptr<Queue_t>> m_queues;
+  std::vector<std::thread> m_workers;
+  std::atomic<std::size_t> m_pending{0};
+  std::mutex m_sleepMutex;
+  std::condition_variable m_wake;
+  bool m_stop{false};
+};
+
+#endif // THREADPOOL_H_
@@ -1,92 +1,307 @@
 #ifndef TIMETREE_H_
 #define TIMETREE_H_
 
+#include "Checkpoint.hpp"
+#include "Epoch.hpp"
+#include "KeySearch.hpp"
+#include "LeafCodec.hpp"
+#include "SealedIndex.hpp"
+#include "ThreadPool.hpp"
+
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <deque>
 #include <fmt/format.h>
+#include <fstream>
+#include <functional>
 #include <iterator>
 #include <limits>
 #include <memory>
+#include <optional>
 #include <span>
+#include <string>
+#include <thread>
 #include <tl/expected.hpp>
+#include <tuple>
 #include <type_traits>
-#include <variant>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
-enum Errors_e { INVALID_TIME_RANGE, NON_LEAF_PTR_INSERT, RANGE_NOT_IN_DB };
+enum Errors_e {
+  INVALID_TIME_RANGE,
+  NON_LEAF_PTR_INSERT,
+  RANGE_NOT_IN_DB,
+  RANGE_AGGREGATED,
+  IO_ERROR,
+  INVALID_CHECKPOINT
+};
 
 struct TimeRange_t {
   uint64_t start;
   uint64_t end;
   uint64_t ptr;
+  // Measurement carried by the entry, summarised by the nodes above it
+  double value{0.0};
 };
 
-template<std::size_t arity> class TimeTreeNode;
+/**
+ * @brief count, sum, min and max over the values of a set of entries
+ */
+struct Summary_t {
+  uint64_t count{0};
+  double sum{0.0};
+  double min{std::numeric_limits<double>::infinity()};
+  double max{-std::numeric_limits<double>::infinity()};
+
+  void Add(double value) {
+    ++count;
+    sum += value;
+    min = std::min(min, value);
+    max = std::max(max, value);
+  }
 
-template<std::size_t arity>
-class INodeAllocator {
-public: 
-  virtual ~INodeAllocator() = default;
-  virtual TimeTreeNode<arity>* GetNew(bool leaf, uint64_t start, uint64_t end, uint64_t ptr, TimeTreeNode<arity>* parent = nullptr) = 0;
+  void Merge(const Summary_t& other) {
+    count += other.count;
+    sum += other.sum;
+    min = std::min(min, other.min);
+    max = std::max(max, other.max);
+  }
+
+  [[nodiscard]] double Mean() const {
+    return (count == 0) ? 0.0 : sum / static_cast<double>(count);
+  }
 };
 
-template<std::size_t arity>
-class SimpleAllocator : public INodeAllocator<arity> {
+/**
+ * @brief reduces the entries collapsed into a node to the single value the node reports in their place
+ *
+ * Gets the summary over every entry below the node and the entries removed from it. For a leaf those are its own
+ * entries, for an inner node the entries its collapsed children reported, each carrying the value of that child.
+ */
+using AggregatePolicy = std::function<double(const Summary_t& summary, std::span<const TimeRange_t> entries)>;
+
+namespace aggregate {
+  inline double Mean(const Summary_t& summary, std::span<const TimeRange_t> /*entries*/) {
+    return summary.Mean();
+  }
+
+  inline double Min(const Summary_t& summary, std::span<const TimeRange_t> /*entries*/) {
+    return summary.min;
+  }
+
+  inline double Max(const Summary_t& summary, std::span<const TimeRange_t> /*entries*/) {
+    return summary.max;
+  }
+
+  inline double Sum(const Summary_t& summary, std::span<const TimeRange_t> /*entries*/) {
+    return summary.sum;
+  }
+
+  // The newest value, a collapsed child already reports its own newest one
+  inline double Last(const Summary_t& /*summary*/, std::span<const TimeRange_t> entries) {
+    return entries.empty() ? 0.0 : entries.back().value;
+  }
+} // namespace aggregate
+
+/**
+ * @brief read only view over the entries of a leaf
+ *
+ * Leafs store their entries as separate start/end/ptr arrays, the view stitches them back together into TimeRange_t's.
+ * Compressed leafs are decoded into a LeafBuffer_t first, the view then points into the buffer.
+ */
+class EntryView {
 public:
-  // ~SimpleAllocator() {
-  //   for (TimeTreeNode<arity>* ptr : ptrs) {
-  //     delete ptr;
-  //   }
-  // }
-  
-  TimeTreeNode<arity>* GetNew(bool leaf, uint64_t start, uint64_t end, uint64_t ptr, TimeTreeNode<arity>* parent = nullptr) {
-    // ptrs.push_back((new TimeTreeNode<arity>(leaf, start, end, ptr, parent)));
-    // return ptrs.back();
-    // TimeTreeNode<arity>* newptr = new TimeTreeNode<arity>(leaf, start, end, ptr, parent); 
-    // TimeTreeNode<arity>* newptr = std::make_unique<TimeTreeNode<arity>>(leaf, start, end, ptr, parent).release(); 
-    // ptrs.push_back(newptr);
-    // ptrs.emplace_back(std::make_unique<TimeTreeNode<arity>>(leaf, start, end, ptr, parent));
-    ptrs.emplace_back(new TimeTreeNode<arity>(leaf, start, end, ptr, parent));
-    // return newptr;
-    return ptrs.back().get();
-    // objs.emplace_back(leaf, start, end, ptr, parent);
-    // return &objs.back();
+  struct Iterator {
+    using iterator_category = std::forward_iterator_tag;
+    using difference_type = std::ptrdiff_t;
+    using value_type = TimeRange_t;
+    using pointer = const TimeRange_t*;
+    using reference = TimeRange_t;
+
+    TimeRange_t operator*() const {
+      return (*m_view)[m_index];
+    }
+
+    Iterator& operator++() {
+      ++m_index;
+      return *this;
+    }
+    Iterator operator++(int) {
+      Iterator tmp = *this;
+      ++(*this);
+      return tmp;
+    }
+
+    friend bool operator==(const Iterator& a, const Iterator& b) {
+      return a.m_index == b.m_index;
+    }
+    friend bool operator!=(const Iterator& a, const Iterator& b) {
+      return a.m_index != b.m_index;
+    }
+
+    const EntryView* m_view;
+    std::size_t m_index;
+  };
+
+  EntryView() = default;
+  EntryView(const uint64_t* starts, const uint64_t* ends, const uint64_t* ptrs, const double* values, std::size_t count)
+  : m_starts(starts)
+  , m_ends(ends)
+  , m_ptrs(ptrs)
+  , m_values(values)
+  , m_count(count) {}
+
+  [[nodiscard]] TimeRange_t operator[](std::size_t index) const {
+    return {m_starts[index], m_ends[index], m_ptrs[index], m_values[index]};
+  }
+
+  [[nodiscard]] std::size_t size() const {
+    return m_count;
+  }
+
+  [[nodiscard]] bool empty() const {
+    return m_count == 0;
+  }
+
+  [[nodiscard]] Iterator begin() const {
+    return {this, 0};
+  }
+  [[nodiscard]] Iterator end() const {
+    return {this, m_count};
+  }
+
+  [[nodiscard]] const uint64_t* GetStarts() const {
+    return m_starts;
+  }
+
+  [[nodiscard]] const uint64_t* GetEnds() const {
+    return m_ends;
+  }
+
+  [[nodiscard]] const uint64_t* GetPtrs() const {
+    return m_ptrs;
+  }
+
+  [[nodiscard]] const double* GetValues() const {
+    return m_values;
   }
 
 private:
-  // std::deque<TimeTreeNode<arity>*> ptrs;
-  std::vector<std::unique_ptr<TimeTreeNode<arity>>> ptrs;
-  // std::deque<TimeTreeNode<arity>> objs;
+  const uint64_t* m_starts{nullptr};
+  const uint64_t* m_ends{nullptr};
+  const uint64_t* m_ptrs{nullptr};
+  const double* m_values{nullptr};
+  std::size_t m_count{0};
+};
+
+// Scratch space the entries of a compressed leaf are decoded into while they are read
+template<std::size_t arity> struct LeafBuffer_t {
+  std::array<uint64_t, arity> starts;
+  std::array<uint64_t, arity> ends;
+  std::array<uint64_t, arity> ptrs;
+  std::array<double, arity> values;
+};
+
+template<std::size_t leafArity, std::size_t innerArity = leafArity> class TimeTreeNode;
+template<std::size_t leafArity, std::size_t innerArity = leafArity> class LeafNode;
+template<std::size_t leafArity, std::size_t innerArity = leafArity> class InnerNode;
+template<std::size_t leafArity, std::size_t innerArity = leafArity> class CompressedLeafNode;
+
+template<std::size_t leafArity, std::size_t innerArity = leafArity>
+class INodeAllocator {
+public: 
+  virtual ~INodeAllocator() = default;
+  virtual LeafNode<leafArity, innerArity>* GetNewLeaf(uint64_t start, uint64_t end, uint64_t ptr) = 0;
+  virtual InnerNode<leafArity, innerArity>* GetNewInner(uint64_t start, uint64_t end) = 0;
+  // Compressed copy of a sealed leaf, which stays allocated until released
+  virtual CompressedLeafNode<leafArity, innerArity>*
+      GetNewCompressedLeaf(const LeafNode<leafArity, innerArity>& leaf) = 0;
+  // Hands a node that is no longer referenced by the tree back to the allocator
+  virtual void Release(TimeTreeNode<leafArity, innerArity>* node) = 0;
+  [[nodiscard]] virtual std::size_t GetBytesHeld() const = 0;
 };
 
-template<std::size_t arity> class TimeTreeNode {
+/**
+ * @brief allocator giving every node a heap allocation of its own
+ *
+ * Released nodes are deleted right away, so memory follows the size of the tree as old data is aggregated away. The
+ * allocator only counts the nodes it handed out, the tree releases every node it still holds when it is destroyed.
+ */
+template<std::size_t leafArity, std::size_t innerArity = leafArity>
+class SimpleAllocator : public INodeAllocator<leafArity, innerArity> {
 public:
-  TimeTreeNode() = default;
+  LeafNode<leafArity, innerArity>* GetNewLeaf(uint64_t start, uint64_t end, uint64_t ptr) {
+    auto* res = new LeafNode<leafArity, innerArity>(start, end, ptr);
+    ++m_leafs;
+    return res;
+  }
 
-  // , m_time({start, end})
-  TimeTreeNode(bool leaf, uint64_t start, uint64_t end, uint64_t ptr, TimeTreeNode<arity>* parent = nullptr)
-  : m_leaf(leaf) {
-    if (parent != nullptr) {
-      m_parent = parent;
-    }
+  InnerNode<leafArity, innerArity>* GetNewInner(uint64_t start, uint64_t end) {
+    auto* res = new InnerNode<leafArity, innerArity>(start, end);
+    ++m_inners;
+    return res;
+  }
 
-    // fmt::print("Constructing {}\n", (leaf ? "leaf" : "node"));
+  CompressedLeafNode<leafArity, innerArity>* GetNewCompressedLeaf(const LeafNode<leafArity, innerArity>& leaf) {
+    auto* res = new CompressedLeafNode<leafArity, innerArity>(leaf);
+    ++m_compressed;
+    m_compressedBytes += res->GetEncodedSize();
+    return res;
+  }
 
-    if (leaf) {
-      m_children = std::array<TimeRange_t, arity>{{start, end, ptr}};
+  void Release(TimeTreeNode<leafArity, innerArity>* node) {
+    if (node->IsCompressed()) {
+      --m_compressed;
+      m_compressedBytes -= node->AsCompressed()->GetEncodedSize();
+      delete node->AsCompressed();
+    } else if (node->IsLeaf()) {
+      --m_leafs;
+      delete node->AsLeaf();
     } else {
-      m_children = std::array<TimeTreeNode<arity>*, arity>{};
+      --m_inners;
+      delete node->AsInner();
     }
+  }
+
+  [[nodiscard]] std::size_t GetBytesHeld() const {
+    return m_leafs * sizeof(LeafNode<leafArity, innerArity>) + m_inners * sizeof(InnerNode<leafArity, innerArity>)
+           + m_compressed * sizeof(CompressedLeafNode<leafArity, innerArity>) + m_compressedBytes;
+  }
 
-    m_stats.start = start;
-    m_stats.end = end;
+  [[nodiscard]] std::size_t GetLiveNodes() const {
+    return m_leafs + m_inners + m_compressed;
   }
 
-  [[nodiscard]] tl::expected<int, Errors_e> Insert(uint64_t start, uint64_t end, uint64_t ptr) {
+private:
+  std::size_t m_leafs{0};
+  std::size_t m_inners{0};
+  std::size_t m_compressed{0};
+  std::size_t m_compressedBytes{0};
+};
+
+/**
+ * @brief common header shared by leaf and inner nodes
+ *
+ * The node kind is fixed at construction, callers check IsLeaf() once and then use AsLeaf()/AsInner() which are plain
+ * static casts. Compressed leafs are leafs as far as the shape of the tree goes, their entries are only reachable
+ * through AsCompressed(). The GetData()/GetChildren()/GetFirst() helpers forward to the right kind for convenience.
+ *
+ * Fields read by concurrent queries are atomics that only the writer stores to. Entries and children are written before
+ * the child count is released, so a reader sees every one of them below the count it acquires.
+ */
+template<std::size_t leafArity, std::size_t innerArity> class TimeTreeNode {
+public:
+  static_assert(leafArity > 0 && leafArity <= std::numeric_limits<uint16_t>::max());
+  static_assert(innerArity > 1 && innerArity <= std::numeric_limits<uint16_t>::max());
+
+  [[nodiscard]] tl::expected<int, Errors_e> Insert(uint64_t start, uint64_t end, uint64_t ptr, double value = 0.0) {
     if (start > end) {
       return tl::make_unexpected(Errors_e::INVALID_TIME_RANGE);
     }
@@ -96,567 +311,2962 @@ public:
     if (!m_leaf) {
       return tl::make_unexpected(Errors_e::NON_LEAF_PTR_INSERT);
     }
-    auto& children = std::get<std::array<TimeRange_t, arity>>(m_children);
-    children.at(m_aryCounter) = {start, end, ptr};
-    m_stats.end = end;
-    m_aryCounter += 1;
-    return m_aryCounter;
+    return AsLeaf()->Append(start, end, ptr, value);
   }
 
   [[nodiscard]] tl::expected<uint64_t, Errors_e> UpdateTimeRange(uint64_t start, uint64_t end) {
     if (start > end) {
       return tl::make_unexpected(Errors_e::INVALID_TIME_RANGE);
     }
-    // TODO statistics
-    m_stats.start = start;
-    m_stats.end = end;
-    return m_stats.end;
-  }
-
-  void InsertChild(TimeTreeNode<arity>* child) {
-    // assert(m_aryCounter < arity);
-    auto& children = std::get<std::array<TimeTreeNode<arity>*, arity>>(m_children);
-    children.at(m_aryCounter) = child;
-    m_aryCounter += 1;
+    m_stats.start.store(start, std::memory_order_relaxed);
+    m_stats.end.store(end, std::memory_order_relaxed);
+    return end;
   }
 
   [[nodiscard]] uint64_t GetNodeStart() const {
-    return m_stats.start;
+    return m_stats.start.load(std::memory_order_relaxed);
   }
 
   [[nodiscard]] uint64_t GetNodeEnd() const {
-    return m_stats.end;
+    return m_stats.end.load(std::memory_order_relaxed);
   }
   void SetNodeEnd(uint64_t end) {
-    m_stats.end = end;
-  }
-
-  void ConvertToLeaf() {
-    m_leaf = true;
-    fmt::print("Converting {}-{} to leaf\n", m_stats.start, m_stats.end);
+    m_stats.end.store(end, std::memory_order_relaxed);
   }
 
   [[nodiscard]] std::size_t GetChildCount() const {
-    return m_aryCounter;
+    return m_aryCounter.load(std::memory_order_acquire);
   }
 
-  TimeTreeNode<arity>* GetLink() const {
-    return m_backLink;
+  TimeTreeNode* GetLink() const {
+    return m_backLink.load(std::memory_order_acquire);
   }
-  // [[nodiscard]] TimeTreeNode<arity>* GetNewestChild() {
-  //   return m_children.at(m_aryCounter - 1);
-  // }
-  void UpdateNodeEnd() {
-    auto& children = std::get<std::array<TimeTreeNode<arity>*, arity>>(m_children);
-    TimeTreeNode<arity>* child = children.at(m_aryCounter - 1);
-    m_stats.end = child->GetNodeEnd();
+
+  // The linked node has to be complete, readers may follow the link right away
+  void SetBackLink(TimeTreeNode* link) {
+    m_backLink.store(link, std::memory_order_release);
   }
 
-  void UpdateNodeStart() {
-    auto& children = std::get<std::array<TimeTreeNode<arity>*, arity>>(m_children);
-    TimeTreeNode<arity>* child = children.at(0);
-    m_stats.start = child->GetNodeStart();
+  // Previous node on the same level, null for the oldest one
+  TimeTreeNode* GetReverseLink() const {
+    return m_reverseLink.load(std::memory_order_acquire);
   }
 
-  void SetBackLink(TimeTreeNode<arity>* link) {
-    m_backLink = link;
+  void SetReverseLink(TimeTreeNode* link) {
+    m_reverseLink.store(link, std::memory_order_release);
   }
 
   [[nodiscard]] bool IsLeaf() const {
     return m_leaf;
   }
 
-  // FIXME switch to span
-  [[nodiscard]] std::span<TimeRange_t> GetData() {
-    assert(m_leaf);
-    auto& children = std::get<std::array<TimeRange_t, arity>>(m_children);
-    return std::span<TimeRange_t>(children.data(), m_aryCounter);
+  [[nodiscard]] bool IsCompressed() const {
+    return m_compressed;
   }
 
-  [[nodiscard]] std::span<TimeTreeNode<arity>*> GetChildren() {
-    assert(!m_leaf);
-    auto& children = std::get<std::array<TimeTreeNode<arity>*, arity>>(m_children);
-    return std::span<TimeTreeNode<arity>*>(children.data(), m_aryCounter);
+  [[nodiscard]] LeafNode<leafArity, innerArity>* AsLeaf() {
+    assert(m_leaf && !m_compressed);
+    return static_cast<LeafNode<leafArity, innerArity>*>(this);
+  }
+
+  [[nodiscard]] CompressedLeafNode<leafArity, innerArity>* AsCompressed() {
+    assert(m_compressed);
+    return static_cast<CompressedLeafNode<leafArity, innerArity>*>(this);
   }
-  // auto& children = std::get<std::array<TimeTreeNode<arity>*, arity>>(m_children);
-  // auto& children = std::get<std::array<TimeRange_t, arity>>(m_children);
-  // return std::make_pair(&children, m_aryCounter);
 
-  [[nodiscard]] TimeTreeNode<arity>* GetFirst() {
-    auto& children = std::get<std::array<TimeTreeNode<arity>*, arity>>(m_children);
-    return children.at(0);
+  [[nodiscard]] InnerNode<leafArity, innerArity>* AsInner() {
+    assert(!m_leaf);
+    return static_cast<InnerNode<leafArity, innerArity>*>(this);
   }
 
+  // Leafs that are not compressed only
+  [[nodiscard]] EntryView GetData();
+  [[nodiscard]] std::span<TimeTreeNode*> GetChildren();
+  [[nodiscard]] TimeTreeNode* GetFirst();
+
   [[nodiscard]] std::size_t GetAggregateLevel() const {
-    return m_aggregateLevel;
+    return m_aggregateLevel.load(std::memory_order_acquire);
   }
 
+  // Set the aggregate ptr and value first, readers take them once they see the node collapsed
   void IncAggregateLevel() {
-    ++m_aggregateLevel;
+    m_aggregateLevel.store(m_aggregateLevel.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+
+  void SetAggregateLevel(std::size_t level) {
+    assert(level <= std::numeric_limits<uint8_t>::max());
+    m_aggregateLevel.store(static_cast<uint8_t>(level), std::memory_order_release);
   }
 
   [[nodiscard]] uint64_t GetAggregatePtr() const {
-    return m_aggregatePtr;
+    return m_aggregatePtr.load(std::memory_order_relaxed);
   }
 
   void SetAggregatePtr(uint64_t ptr) {
-    m_aggregatePtr = ptr;
+    m_aggregatePtr.store(ptr, std::memory_order_relaxed);
   }
 
-  typename std::array<TimeRange_t, arity>::iterator begin() {
-    assert(m_leaf);
-    auto& children = std::get<std::array<TimeRange_t, arity>>(m_children);
-    return children.begin();
+  // Value a collapsed node reports for the entries it replaced, as computed by the aggregation policy
+  [[nodiscard]] double GetAggregateValue() const {
+    return m_aggregateValue.load(std::memory_order_relaxed);
   }
-  typename std::array<TimeRange_t, arity>::iterator end() {
-    assert(m_leaf);
-    auto& children = std::get<std::array<TimeRange_t, arity>>(m_children);
-    return children.end();
+
+  void SetAggregateValue(double value) {
+    m_aggregateValue.store(value, std::memory_order_relaxed);
   }
 
-  typename std::array<TimeRange_t, arity>::iterator cbegin() const {
-    assert(m_leaf);
-    auto& children = std::get<std::array<TimeRange_t, arity>>(m_children);
-    return children.cbegin();
+  // Summary over the values of every entry below the node, including ones since collapsed into it
+  [[nodiscard]] Summary_t GetSummary() const {
+    return {
+        m_stats.count.load(std::memory_order_relaxed),
+        m_stats.sum.load(std::memory_order_relaxed),
+        m_stats.min.load(std::memory_order_relaxed),
+        m_stats.max.load(std::memory_order_relaxed)};
   }
-  typename std::array<TimeRange_t, arity>::iterator cend() const {
-    assert(m_leaf);
-    auto& children = std::get<std::array<TimeRange_t, arity>>(m_children);
-    return children.cend();
+
+  // Number of entries below the node, the count of its summary
+  [[nodiscard]] uint64_t GetEntryCount() const {
+    return m_stats.count.load(std::memory_order_relaxed);
+  }
+
+  // Only the writer updates summaries, readers may see the fields of one update apart
+  void SetSummary(const Summary_t& summary) {
+    m_stats.count.store(summary.count, std::memory_order_relaxed);
+    m_stats.sum.store(summary.sum, std::memory_order_relaxed);
+    m_stats.min.store(summary.min, std::memory_order_relaxed);
+    m_stats.max.store(summary.max, std::memory_order_relaxed);
+  }
+
+  void AddSummary(const Summary_t& summary) {
+    Summary_t merged = GetSummary();
+    merged.Merge(summary);
+    SetSummary(merged);
+  }
+
+protected:
+  TimeTreeNode(bool leaf, uint64_t start, uint64_t end, bool compressed = false)
+  : m_stats{start, end, 0, 0.0, std::numeric_limits<double>::infinity(), -std::numeric_limits<double>::infinity()}
+  , m_leaf(leaf)
+  , m_compressed(compressed) {}
+
+  // Only the writer updates the count, so it can read it back without synchronising
+  [[nodiscard]] std::size_t GetOwnCount() const {
+    return m_aryCounter.load(std::memory_order_relaxed);
+  }
+
+  void PublishCount(std::size_t count) {
+    m_aryCounter.store(static_cast<uint16_t>(count), std::memory_order_release);
   }
 
-private:
   struct Statistics_t {
-    std::size_t min;
-    std::size_t max;
-    uint64_t start;
-    uint64_t end;
+    std::atomic<uint64_t> start;
+    std::atomic<uint64_t> end;
+    std::atomic<uint64_t> count;
+    std::atomic<double> sum;
+    std::atomic<double> min;
+    std::atomic<double> max;
   };
 
-  using Children = std::variant<std::array<TimeRange_t, arity>, std::array<TimeTreeNode<arity>*, arity>>;
-
-  bool m_leaf{};
   Statistics_t m_stats;
-  // TimeRange_t m_time;
+  std::atomic<uint64_t> m_aggregatePtr{0};
+  std::atomic<double> m_aggregateValue{0.0};
+  std::atomic<TimeTreeNode*> m_backLink{nullptr};
+  std::atomic<TimeTreeNode*> m_reverseLink{nullptr};
+
+  std::atomic<uint16_t> m_aryCounter{0};
+  std::atomic<uint8_t> m_aggregateLevel{0};
+  bool m_leaf;
+  bool m_compressed;
+};
+
+template<std::size_t leafArity, std::size_t innerArity>
+class LeafNode : public TimeTreeNode<leafArity, innerArity> {
+public:
+  LeafNode(uint64_t start, uint64_t end, uint64_t /*ptr*/)
+  : TimeTreeNode<leafArity, innerArity>(true, start, end) {}
+
+  int Append(uint64_t start, uint64_t end, uint64_t ptr, double value) {
+    const std::size_t index = this->GetOwnCount();
+    assert(index < leafArity);
+    if (index == 0) {
+      this->m_stats.start.store(start, std::memory_order_relaxed);
+    }
+    m_starts[index] = start;
+    m_ends[index] = end;
+    m_ptrs[index] = ptr;
+    m_values[index] = value;
+    this->m_stats.end.store(end, std::memory_order_relaxed);
+    Summary_t added;
+    added.Add(value);
+    this->AddSummary(added);
+    this->PublishCount(index + 1);
+    return static_cast<int>(index + 1);
+  }
+
+  // Returns the summary of the appended values, for the caller to pass on to the parents
+  Summary_t AppendBatch(std::span<const TimeRange_t> ranges) {
+    std::size_t index = this->GetOwnCount();
+    assert(index + ranges.size() <= leafArity);
+    Summary_t added;
+    if (ranges.empty()) {
+      return added;
+    }
+    if (index == 0) {
+      this->m_stats.start.store(ranges.front().start, std::memory_order_relaxed);
+    }
+    for (const TimeRange_t& range : ranges) {
+      m_starts[index] = range.start;
+      m_ends[index] = range.end;
+      m_ptrs[index] = range.ptr;
+      m_values[index] = range.value;
+      added.Add(range.value);
+      ++index;
+    }
+    this->m_stats.end.store(ranges.back().end, std::memory_order_relaxed);
+    this->AddSummary(added);
+    this->PublishCount(index);
+    return added;
+  }
 
-  std::size_t m_aggregateLevel{0};
-  uint64_t m_aggregatePtr{0};
+  // Replaces the entries wholesale, used when restoring a checkpoint together with the summary
+  void LoadEntries(
+      const uint64_t* starts, const uint64_t* ends, const uint64_t* ptrs, const double* values, std::size_t count) {
+    assert(count <= leafArity);
+    std::copy_n(starts, count, m_starts.begin());
+    std::copy_n(ends, count, m_ends.begin());
+    std::copy_n(ptrs, count, m_ptrs.begin());
+    std::copy_n(values, count, m_values.begin());
+    this->PublishCount(count);
+  }
 
-  Children m_children;
-  // std::unique_ptr<TimeTreeNode> m_parent;
-  TimeTreeNode* m_parent;
-  TimeTreeNode* m_backLink{nullptr};
+  [[nodiscard]] EntryView GetData() const {
+    return EntryView(m_starts.data(), m_ends.data(), m_ptrs.data(), m_values.data(), this->GetChildCount());
+  }
 
-  std::size_t m_aryCounter{0};
+  [[nodiscard]] const double* GetValues() const {
+    return m_values.data();
+  }
+
+  [[nodiscard]] const uint64_t* GetStarts() const {
+    return m_starts.data();
+  }
+
+  [[nodiscard]] const uint64_t* GetEnds() const {
+    return m_ends.data();
+  }
+
+private:
+  // Structure of arrays so the key searches can compare a vector of starts or ends at once
+  std::array<uint64_t, leafArity> m_starts;
+  std::array<uint64_t, leafArity> m_ends;
+  std::array<uint64_t, leafArity> m_ptrs;
+  std::array<double, leafArity> m_values;
 };
 
-// static_assert(std::is_trivially_copy_assignable_v<TimeRange_t>, "message");
+/**
+ * @brief sealed leaf keeping its entries in the byte encoding of codec::EncodeEntries()
+ *
+ * Takes the place of a leaf once the next one has been started, see TimeTree::SetLeafCompression(). The header and
+ * summary are carried over, the entries are decoded into a LeafBuffer_t whenever they are read. Compressed leafs never
+ * take inserts.
+ */
+template<std::size_t leafArity, std::size_t innerArity>
+class CompressedLeafNode : public TimeTreeNode<leafArity, innerArity> {
+public:
+  explicit CompressedLeafNode(const LeafNode<leafArity, innerArity>& leaf)
+  : TimeTreeNode<leafArity, innerArity>(true, leaf.GetNodeStart(), leaf.GetNodeEnd(), true) {
+    const EntryView data = leaf.GetData();
+    std::vector<uint8_t> encoded;
+    encoded.reserve(data.size() * 4 + 16);
+    codec::EncodeEntries(data.GetStarts(), data.GetEnds(), data.GetPtrs(), data.GetValues(), data.size(), encoded);
+    m_bytes = std::make_unique<uint8_t[]>(encoded.size());
+    std::copy(encoded.begin(), encoded.end(), m_bytes.get());
+    m_size = encoded.size();
+
+    this->SetSummary(leaf.GetSummary());
+    this->SetAggregatePtr(leaf.GetAggregatePtr());
+    this->SetAggregateValue(leaf.GetAggregateValue());
+    this->SetAggregateLevel(leaf.GetAggregateLevel());
+    this->PublishCount(data.size());
+  }
 
-// static_assert(
-//     std::is_trivially_constructible_v<TimeTreeNode<8>, bool, uint64_t, uint64_t>,
-//     "TimeTreeNode should be trivially constructable");
+  [[nodiscard]] EntryView Unpack(LeafBuffer_t<leafArity>& buffer) const {
+    const std::size_t count = this->GetChildCount();
+    codec::DecodeEntries(
+        m_bytes.get(), count, buffer.starts.data(), buffer.ends.data(), buffer.ptrs.data(), buffer.values.data());
+    return EntryView(buffer.starts.data(), buffer.ends.data(), buffer.ptrs.data(), buffer.values.data(), count);
+  }
 
-// static_assert(std::is_standard_layout_v<TimeTreeNode<4>> && std::is_trivial_v<TimeTreeNode<4>>, "Node needs to be
-// pod");
+  [[nodiscard]] std::size_t GetEncodedSize() const {
+    return m_size;
+  }
 
-// TODO iterator which only returns TimeRange_t's from the leafs
-template<std::size_t arity, typename alloc = SimpleAllocator<arity>> class TimeTree {
+private:
+  std::unique_ptr<uint8_t[]> m_bytes;
+  std::size_t m_size;
+};
+
+template<std::size_t leafArity, std::size_t innerArity>
+class InnerNode : public TimeTreeNode<leafArity, innerArity> {
 public:
-  TimeTree()
-  // : m_root(std::make_unique<TimeTreeNode<arity>>(true, 0, std::numeric_limits<uint64_t>::max(), 0).release()) {
-  // : m_root(std::make_unique<TimeTreeNode<arity>>(true, 0, 0, 0).release()) {
-  : m_root(m_allocator.GetNew(true, 0, 0, 0)) {
-    m_nodes.push_front({m_root});
+  using Node = TimeTreeNode<leafArity, innerArity>;
+
+  InnerNode(uint64_t start, uint64_t end)
+  : Node(false, start, end) {}
+
+  void InsertChild(Node* child) {
+    const std::size_t index = this->GetOwnCount();
+    assert(index < innerArity);
+    m_children[index] = child;
+    m_ends[index] = child->GetNodeEnd();
+    this->AddSummary(child->GetSummary());
+    this->PublishCount(index + 1);
   }
 
-  // TODO return error
-  void Insert(uint64_t start, uint64_t end, uint64_t ptr) {
-    // if (start < m_root->GetNodeEnd()) {
-    //   return;
-    // }
-    if (m_aryCounter == arity) {
-      // std::unique_ptr<TimeTreeNode<arity>> newLeaf = std::make_unique<TimeTreeNode<arity>>(true, start, end, 0);
-      TimeTreeNode<arity>* newLeaf = m_allocator.GetNew(true, start, end, 0);
-      const std::size_t height = m_nodes.size();
-      auto& leafs = m_nodes.front();
-      m_aryCounter = 0;
-      // newLeaf->SetBackLink(leafs.back());
-      // leafs.back()->SetBackLink(newLeaf.get());
-      leafs.back()->SetBackLink(newLeaf);
-      // m_nodes.at(0) = newLeaf.get();
-      // leafs.push_back(newLeaf.release());
-      leafs.push_back(newLeaf);
-      UpdateTreeLevels(m_nodes.front(), (height > 1) ? std::next(m_nodes.begin()) : m_nodes.end());
+  /**
+   * @brief pulls in the end of the newest child, which is the only one still receiving inserts
+   *
+   * Readers may be scanning the ends with vector loads meanwhile, the single aligned store can't tear on the platforms
+   * the key search targets.
+   */
+  void UpdateNodeEnd() {
+    const std::size_t newest = this->GetOwnCount() - 1U;
+    const uint64_t end = m_children[newest]->GetNodeEnd();
+    std::atomic_ref<uint64_t>(m_ends[newest]).store(end, std::memory_order_relaxed);
+    this->m_stats.end.store(end, std::memory_order_relaxed);
+  }
+
+  void UpdateNodeStart() {
+    this->m_stats.start.store(m_children[0]->GetNodeStart(), std::memory_order_relaxed);
+  }
+
+  // Swaps in a child covering the same entries, readers may take either until the old one is reclaimed
+  void ReplaceChild(std::size_t index, Node* child) {
+    assert(index < this->GetOwnCount());
+    std::atomic_ref<Node*>(m_children[index]).store(child, std::memory_order_release);
+  }
+
+  // Drops the children from index count onwards
+  void TruncateChildren(std::size_t count) {
+    assert(count != 0 && count <= this->GetOwnCount());
+    this->PublishCount(count);
+    UpdateNodeEnd();
+  }
+
+  // Drops the oldest count children, the remaining ones move to the front. Readers must be held off and the start is
+  // left to UpdateNodeStart() once the new first child is settled.
+  void DropChildren(std::size_t count) {
+    const std::size_t remaining = this->GetOwnCount() - count;
+    assert(remaining != 0);
+    std::copy_n(std::next(m_children.begin(), static_cast<std::ptrdiff_t>(count)), remaining, m_children.begin());
+    std::copy_n(std::next(m_ends.begin(), static_cast<std::ptrdiff_t>(count)), remaining, m_ends.begin());
+    this->PublishCount(remaining);
+  }
+
+  // Rebuilds the summary from the children, after the oldest or newest ones changed
+  void UpdateSummary() {
+    Summary_t summary;
+    for (std::size_t i = 0; i < this->GetOwnCount(); ++i) {
+      summary.Merge(m_children[i]->GetSummary());
     }
+    this->SetSummary(summary);
+  }
 
-    auto& leafs = m_nodes.front();
-    auto& newestLeaf = leafs.back();
-    m_aryCounter += 1;
-    auto insertRet = newestLeaf->Insert(start, end, ptr);
-    if (!insertRet) {
-      // fmt::print("Failed to insert values: {}\n", insertRet.error());
+  /**
+   * @brief replaces the children wholesale, used when restoring a checkpoint
+   *
+   * The child ends are taken as given rather than read from the children, which may not have been restored yet.
+   * Collapsed nodes keep their child count without having children.
+   */
+  void LoadChildren(std::span<Node* const> children, const uint64_t* ends, std::size_t count) {
+    assert(count <= innerArity && (children.empty() || children.size() == count));
+    std::copy_n(ends, count, m_ends.begin());
+    for (std::size_t i = 0; i < count; ++i) {
+      m_children[i] = children.empty() ? nullptr : children[i];
     }
+    this->PublishCount(count);
+  }
+
+  [[nodiscard]] std::span<Node*> GetChildren() {
+    return std::span<Node*>(m_children.data(), this->GetChildCount());
+  }
+
+  [[nodiscard]] Node* GetFirst() {
+    return m_children[0];
+  }
 
-    if (newestLeaf->GetNodeStart() == 0) {
-      assert(newestLeaf->UpdateTimeRange(start, start).has_value());
+  // Copies of the children's ends, kept next to each other so the descent doesn't touch every child
+  [[nodiscard]] const uint64_t* GetEnds() const {
+    return m_ends.data();
+  }
+
+private:
+  std::array<uint64_t, innerArity> m_ends;
+  std::array<Node*, innerArity> m_children;
+};
+
+template<std::size_t leafArity, std::size_t innerArity>
+EntryView TimeTreeNode<leafArity, innerArity>::GetData() {
+  return AsLeaf()->GetData();
+}
+
+template<std::size_t leafArity, std::size_t innerArity>
+std::span<TimeTreeNode<leafArity, innerArity>*> TimeTreeNode<leafArity, innerArity>::GetChildren() {
+  return AsInner()->GetChildren();
+}
+
+template<std::size_t leafArity, std::size_t innerArity>
+TimeTreeNode<leafArity, innerArity>* TimeTreeNode<leafArity, innerArity>::GetFirst() {
+  return AsInner()->GetFirst();
+}
+
+/**
+ * @brief fixed size object pool backed by large contiguous slabs
+ *
+ * Objects are placement constructed into slabs of roughly slabBytes, handing them out in insertion order so that
+ * neighbouring nodes end up next to each other in memory. Released objects are kept on an intrusive free list and are
+ * reused before a new slab is requested. Memory is only returned when the pool is destroyed.
+ */
+template<typename T, std::size_t slabBytes>
+class SlabPool {
+public:
+  template<typename... Args>
+  T* Get(Args&&... args) {
+    Slot_t* slot = nullptr;
+    if (m_freeList != nullptr) {
+      slot = m_freeList;
+      m_freeList = slot->next;
     } else {
-      // newestLeaf->UpdateTimeRange(newestLeaf->GetNodeStart(), end);
+      if (m_slabs.empty() || m_slabUsed == OBJECTS_PER_SLAB) {
+        m_slabs.emplace_back(std::make_unique<Slot_t[]>(OBJECTS_PER_SLAB));
+        m_slabUsed = 0;
+      }
+      slot = &m_slabs.back()[m_slabUsed];
+      ++m_slabUsed;
     }
+    ++m_live;
+    return std::construct_at(reinterpret_cast<T*>(slot->storage), std::forward<Args>(args)...);
+  }
 
-    UpdateTreeStats();
+  void Release(T* obj) {
+    assert(obj != nullptr);
+    std::destroy_at(obj);
+    auto* slot = reinterpret_cast<Slot_t*>(obj);
+    slot->next = m_freeList;
+    m_freeList = slot;
+    --m_live;
   }
 
-  [[nodiscard]] std::size_t GetHeight() const {
-    return m_nodes.size();
+  [[nodiscard]] std::size_t GetBytesHeld() const {
+    return m_slabs.size() * OBJECTS_PER_SLAB * sizeof(Slot_t);
   }
 
-  [[nodiscard]] TimeTreeNode<arity>* GetRoot() const {
-    return m_root;
+  [[nodiscard]] std::size_t GetLive() const {
+    return m_live;
   }
 
-  [[nodiscard]] auto GetLeafsIterator() const {
-    return m_nodes.front().begin();
+private:
+  static_assert(std::is_trivially_destructible_v<T>, "Slabs are dropped without running destructors");
+
+  union Slot_t {
+    Slot_t* next;
+    alignas(T) std::byte storage[sizeof(T)];
+  };
+
+  static constexpr std::size_t OBJECTS_PER_SLAB = std::max<std::size_t>(1, slabBytes / sizeof(Slot_t));
+
+  std::vector<std::unique_ptr<Slot_t[]>> m_slabs;
+  std::size_t m_slabUsed{0};
+  Slot_t* m_freeList{nullptr};
+  std::size_t m_live{0};
+};
+
+/**
+ * @brief allocator carving leaf and inner nodes out of their own slab pools
+ */
+template<std::size_t leafArity, std::size_t innerArity = leafArity, std::size_t slabBytes = 1 << 20>
+class SlabAllocator final : public INodeAllocator<leafArity, innerArity> {
+public:
+  SlabAllocator() = default;
+  SlabAllocator(const SlabAllocator&) = delete;
+  SlabAllocator& operator=(const SlabAllocator&) = delete;
+  SlabAllocator(SlabAllocator&&) noexcept = default;
+  SlabAllocator& operator=(SlabAllocator&&) noexcept = default;
+  ~SlabAllocator() override = default;
+
+  LeafNode<leafArity, innerArity>* GetNewLeaf(uint64_t start, uint64_t end, uint64_t ptr) override {
+    return m_leafs.Get(start, end, ptr);
   }
 
-  [[nodiscard]] std::size_t GetNumberLeafs() const {
-    return m_nodes.front().size();
+  InnerNode<leafArity, innerArity>* GetNewInner(uint64_t start, uint64_t end) override {
+    return m_inners.Get(start, end);
   }
 
-  void PrintTree() const {
-    for (const auto& level : m_nodes) {
-      for (const TimeTreeNode<arity>* node : level) {
-        fmt::print("[{} {} {}] ", node->GetNodeStart(), node->GetNodeEnd(), node->GetChildCount());
+  // Compressed leafs differ in size, they are allocated one by one and freed on release
+  CompressedLeafNode<leafArity, innerArity>*
+      GetNewCompressedLeaf(const LeafNode<leafArity, innerArity>& leaf) override {
+    auto node = std::make_unique<CompressedLeafNode<leafArity, innerArity>>(leaf);
+    auto* res = node.get();
+    m_compressedBytes += res->GetEncodedSize();
+    m_compressed.emplace(res, std::move(node));
+    return res;
+  }
+
+  void Release(TimeTreeNode<leafArity, innerArity>* node) override {
+    if (node->IsCompressed()) {
+      m_compressedBytes -= node->AsCompressed()->GetEncodedSize();
+      m_compressed.erase(node->AsCompressed());
+    } else if (node->IsLeaf()) {
+      m_leafs.Release(node->AsLeaf());
+    } else {
+      m_inners.Release(node->AsInner());
+    }
+  }
+
+  [[nodiscard]] std::size_t GetBytesHeld() const override {
+    return m_leafs.GetBytesHeld() + m_inners.GetBytesHeld()
+           + m_compressed.size() * sizeof(CompressedLeafNode<leafArity, innerArity>) + m_compressedBytes;
+  }
+
+  [[nodiscard]] std::size_t GetLiveNodes() const {
+    return m_leafs.GetLive() + m_inners.GetLive() + m_compressed.size();
+  }
+
+private:
+  SlabPool<LeafNode<leafArity, innerArity>, slabBytes> m_leafs;
+  SlabPool<InnerNode<leafArity, innerArity>, slabBytes> m_inners;
+  std::unordered_map<
+      CompressedLeafNode<leafArity, innerArity>*,
+      std::unique_ptr<CompressedLeafNode<leafArity, innerArity>>>
+      m_compressed;
+  std::size_t m_compressedBytes{0};
+};
+
+/**
+ * @brief allocator handing out nodes from a SlabAllocator owned elsewhere, so many small trees can share one pool
+ *
+ * The pool is not synchronised, trees sharing it must not be written to concurrently.
+ */
+template<std::size_t leafArity, std::size_t innerArity = leafArity>
+class SharedSlabAllocator final : public INodeAllocator<leafArity, innerArity> {
+public:
+  explicit SharedSlabAllocator(SlabAllocator<leafArity, innerArity>* pool)
+  : m_pool(pool) {}
+
+  LeafNode<leafArity, innerArity>* GetNewLeaf(uint64_t start, uint64_t end, uint64_t ptr) override {
+    return m_pool->GetNewLeaf(start, end, ptr);
+  }
+
+  InnerNode<leafArity, innerArity>* GetNewInner(uint64_t start, uint64_t end) override {
+    return m_pool->GetNewInner(start, end);
+  }
+
+  CompressedLeafNode<leafArity, innerArity>*
+      GetNewCompressedLeaf(const LeafNode<leafArity, innerArity>& leaf) override {
+    return m_pool->GetNewCompressedLeaf(leaf);
+  }
+
+  void Release(TimeTreeNode<leafArity, innerArity>* node) override {
+    m_pool->Release(node);
+  }
+
+  // The pool is accounted for by its owner
+  [[nodiscard]] std::size_t GetBytesHeld() const override {
+    return 0;
+  }
+
+private:
+  SlabAllocator<leafArity, innerArity>* m_pool;
+};
+
+// static_assert(std::is_trivially_copy_assignable_v<TimeRange_t>, "message");
+
+// static_assert(
+//     std::is_trivially_constructible_v<TimeTreeNode<8>, bool, uint64_t, uint64_t>,
+//     "TimeTreeNode should be trivially constructable");
+
+// static_assert(std::is_standard_layout_v<TimeTreeNode<4>> && std::is_trivial_v<TimeTreeNode<4>>, "Node needs to be
+// pod");
+
+// TODO iterator which only returns TimeRange_t's from the leafs
+template<
+    std::size_t leafArity,
+    std::size_t innerArity = leafArity,
+    typename alloc = SimpleAllocator<leafArity, innerArity>>
+class TimeTree {
+public:
+  using Node = TimeTreeNode<leafArity, innerArity>;
+  using Leaf = LeafNode<leafArity, innerArity>;
+  using Inner = InnerNode<leafArity, innerArity>;
+  using Compressed = CompressedLeafNode<leafArity, innerArity>;
+  using Buffer = LeafBuffer_t<leafArity>;
+  using Index = SealedIndex<Node*>;
+
+  struct NodeSlice_t {
+    std::size_t first;
+    std::size_t last;
+    bool final;
+    // Read once, a leaf may be collapsed by the writer while a reader is on it
+    bool collapsed;
+    // Entries of the leaf, pointing into the buffer given to SliceNode() for compressed leafs
+    EntryView entries;
+  };
+
+  /**
+   * @brief buffered late entries as handed to readers, sorted on start across a list of chunks
+   *
+   * Chunks are immutable and shared by the copies the writer publishes, a late insert only copies the chunk the entry
+   * lands in and the list of chunks, so filling a large buffer one insert at a time stays linear.
+   */
+  struct LateSnapshot_t {
+    std::vector<std::shared_ptr<const std::vector<TimeRange_t>>> chunks;
+  };
+
+  // Position in the entries of a LateSnapshot_t, a null snapshot has none
+  class LateCursor {
+  public:
+    LateCursor() = default;
+    explicit LateCursor(const LateSnapshot_t* late)
+    : m_late(late) {
+      Enter(0);
+    }
+
+    // At the first entry starting after start, or at the end
+    static LateCursor UpperBound(const LateSnapshot_t* late, uint64_t start) {
+      LateCursor cursor;
+      cursor.m_late = late;
+      if (late == nullptr) {
+        return cursor;
+      }
+      auto chunk = std::partition_point(late->chunks.begin(), late->chunks.end(), [start](const auto& entries) {
+        return entries->back().start <= start;
+      });
+      cursor.Enter(static_cast<std::size_t>(chunk - late->chunks.begin()));
+      if (cursor.m_entry != nullptr) {
+        cursor.m_entry = std::upper_bound(
+            cursor.m_entry, cursor.m_chunkEnd, start, [](uint64_t value, const TimeRange_t& range) {
+              return value < range.start;
+            });
+      }
+      return cursor;
+    }
+
+    [[nodiscard]] bool AtEnd() const {
+      return m_entry == nullptr;
+    }
+    [[nodiscard]] bool AtBegin() const {
+      return m_chunk == 0 && m_entry == m_chunkBegin;
+    }
+
+    const TimeRange_t& operator*() const {
+      return *m_entry;
+    }
+    const TimeRange_t* operator->() const {
+      return m_entry;
+    }
+    // The entry right before the cursor, not to be called at the beginning
+    [[nodiscard]] const TimeRange_t& Prev() const {
+      return m_entry != m_chunkBegin ? m_entry[-1] : m_late->chunks[m_chunk - 1]->back();
+    }
+
+    LateCursor& operator++() {
+      if (++m_entry == m_chunkEnd) {
+        Enter(m_chunk + 1);
+      }
+      return *this;
+    }
+    LateCursor& operator--() {
+      if (m_entry == m_chunkBegin) {
+        Enter(m_chunk - 1);
+        m_entry = m_chunkEnd;
+      }
+      --m_entry;
+      return *this;
+    }
+
+    friend bool operator==(const LateCursor& a, const LateCursor& b) {
+      return a.m_entry == b.m_entry;
+    }
+
+  private:
+    // Moves to the first entry of chunk, past the last chunk every pointer is null
+    void Enter(std::size_t chunk) {
+      m_chunk = chunk;
+      if (m_late == nullptr || chunk == m_late->chunks.size()) {
+        m_chunkBegin = m_entry = m_chunkEnd = nullptr;
+        return;
+      }
+      const std::vector<TimeRange_t>& entries = *m_late->chunks[chunk];
+      m_chunkBegin = m_entry = entries.data();
+      m_chunkEnd = m_chunkBegin + entries.size();
+    }
+
+    const LateSnapshot_t* m_late{nullptr};
+    std::size_t m_chunk{0};
+    const TimeRange_t* m_chunkBegin{nullptr};
+    const TimeRange_t* m_entry{nullptr};
+    const TimeRange_t* m_chunkEnd{nullptr};
+  };
+
+  // What a reader works from for the duration of a query, taken from the last state the writer published
+  struct Snapshot_t {
+    Node* root;
+    Node* newest;
+    std::size_t newestCount;
+    const LateSnapshot_t* late;
+    // Leafs and collapsed nodes left of the newest leaf, see Seal()
+    const Index* sealed;
+  };
+
+  /**
+   * @brief range over the entries of a query, walks the leafs as it is iterated
+   *
+   * Buffered late entries are interleaved with the entries from the leafs. The range keeps the reader pinned, the nodes
+   * it walks stay valid for as long as it lives.
+   */
+  class EntryRange {
+  public:
+    struct Iterator {
+      using iterator_category = std::forward_iterator_tag;
+      using difference_type = std::ptrdiff_t;
+      using value_type = TimeRange_t;
+      using pointer = const TimeRange_t*;
+      using reference = TimeRange_t;
+
+      Iterator() = default;
+      ~Iterator() = default;
+      Iterator(Iterator&&) noexcept = default;
+      Iterator& operator=(Iterator&&) noexcept = default;
+
+      // A compressed leaf is decoded into a buffer of the iterator's own, a copy gets its own buffer as well
+      Iterator(const Iterator& other)
+      : m_snapshot(other.m_snapshot)
+      , m_node(other.m_node)
+      , m_late(other.m_late)
+      , m_start(other.m_start)
+      , m_end(other.m_end)
+      , m_slice(other.m_slice) {
+        if (other.m_buffer) {
+          m_buffer = std::make_unique<Buffer>(*other.m_buffer);
+          if (m_slice.entries.GetStarts() == other.m_buffer->starts.data()) {
+            m_slice.entries = EntryView(
+                m_buffer->starts.data(),
+                m_buffer->ends.data(),
+                m_buffer->ptrs.data(),
+                m_buffer->values.data(),
+                m_slice.entries.size());
+          }
+        }
+      }
+
+      Iterator& operator=(const Iterator& other) {
+        if (this != &other) {
+          *this = Iterator(other);
+        }
+        return *this;
+      }
+
+      Iterator(const Snapshot_t& snapshot, Node* node, uint64_t start, uint64_t end)
+      : m_snapshot(snapshot)
+      , m_node(node)
+      , m_late(snapshot.late)
+      , m_start(start)
+      , m_end(end) {
+        Load();
+        SkipLate();
+      }
+
+      TimeRange_t operator*() const {
+        return FromLate() ? *m_late : EntryAt(m_node, m_slice, m_slice.first);
+      }
+
+      Iterator& operator++() {
+        if (FromLate()) {
+          ++m_late;
+          SkipLate();
+          return *this;
+        }
+        ++m_slice.first;
+        if (m_slice.first == m_slice.last) {
+          m_node = m_slice.final ? nullptr : NextNode(m_node);
+          Load();
+        }
+        return *this;
+      }
+      Iterator operator++(int) {
+        Iterator tmp = *this;
+        ++(*this);
+        return tmp;
+      }
+
+      friend bool operator==(const Iterator& a, const Iterator& b) {
+        return a.m_node == b.m_node && (a.m_node == nullptr || a.m_slice.first == b.m_slice.first)
+            && a.m_late == b.m_late;
+      }
+      friend bool operator!=(const Iterator& a, const Iterator& b) {
+        return !(a == b);
+      }
+
+    private:
+      [[nodiscard]] bool FromLate() const {
+        return !m_late.AtEnd()
+            && (m_node == nullptr || m_late->start < EntryAt(m_node, m_slice, m_slice.first).start);
+      }
+
+      // Moves on to the first late entry overlapping the range, the end iterator has none left
+      void SkipLate() {
+        while (!m_late.AtEnd() && m_late->end < m_start) {
+          ++m_late;
+        }
+        if (m_late.AtEnd() || m_late->start > m_end) {
+          m_late = LateCursor();
+        }
+      }
+
+      // Moves on to the first node with entries in range, or the end
+      void Load() {
+        while (m_node != nullptr) {
+          m_slice = SliceNode(m_snapshot, m_node, m_start, m_end, m_buffer);
+          if (m_slice.first != m_slice.last) {
+            return;
+          }
+          m_node = m_slice.final ? nullptr : NextNode(m_node);
+        }
+      }
+
+      Snapshot_t m_snapshot{};
+      Node* m_node{nullptr};
+      LateCursor m_late;
+      uint64_t m_start{0};
+      uint64_t m_end{0};
+      NodeSlice_t m_slice{0, 0, true, false, {}};
+      std::unique_ptr<Buffer> m_buffer;
+    };
+
+    EntryRange(EpochManager::Guard guard, const Snapshot_t& snapshot, Node* first, uint64_t start, uint64_t end)
+    : m_guard(std::move(guard))
+    , m_snapshot(snapshot)
+    , m_first(first)
+    , m_start(start)
+    , m_end(end) {}
+
+    [[nodiscard]] Iterator begin() const {
+      return Iterator(m_snapshot, m_first, m_start, m_end);
+    }
+    [[nodiscard]] Iterator end() const {
+      return Iterator();
+    }
+
+  private:
+    EpochManager::Guard m_guard;
+    Snapshot_t m_snapshot;
+    Node* m_first;
+    uint64_t m_start;
+    uint64_t m_end;
+  };
+
+  TimeTree()
+  // : m_root(std::make_unique<Node>(true, 0, std::numeric_limits<uint64_t>::max(), 0).release()) {
+  // : m_root(std::make_unique<Node>(true, 0, 0, 0).release()) {
+  : TimeTree(alloc()) {}
+
+  /**
+   * @brief tree taking its nodes from allocator
+   *
+   * Trees whose allocators draw from one pool can share their reader epochs as well, a reader pinned on any of them
+   * then holds back reclamation on all of them. Without epochs the tree keeps its own.
+   */
+  explicit TimeTree(alloc allocator, EpochManager* epochs = nullptr)
+  : m_allocator(std::move(allocator))
+  , m_root(m_allocator.GetNewLeaf(0, 0, 0))
+  , m_published(std::make_unique<Published_t>()) {
+    m_nodes.push_front({m_root});
+    if (epochs == nullptr) {
+      m_published->ownEpochs = std::make_unique<EpochManager>();
+      epochs = m_published->ownEpochs.get();
+    }
+    m_published->epochs = epochs;
+    Publish();
+  }
+
+  TimeTree(TimeTree&&) = default;
+
+  // The nodes of the tree assigned to go back to its allocator before it takes over the ones of other
+  TimeTree& operator=(TimeTree&& other) {
+    if (this != &other) {
+      std::destroy_at(this);
+      std::construct_at(this, std::move(other));
+    }
+    return *this;
+  }
+
+  // Hands every node back to the allocator, no reader may be left on the tree
+  ~TimeTree() {
+    // Moved from
+    if (m_published == nullptr) {
+      return;
+    }
+    for (const std::deque<Node*>& level : m_nodes) {
+      for (Node* node : level) {
+        m_allocator.Release(node);
+      }
+    }
+    for (const auto& [epoch, node] : m_retiredNodes) {
+      m_allocator.Release(node);
+    }
+  }
+
+  /**
+   * @brief inserts a single time range
+   *
+   * Ranges starting before the newest entry are late, they are kept in a small sorted buffer that queries merge into
+   * their results and which is merged into the leafs once it fills up. Late ranges falling inside data that has
+   * already been aggregated are rejected. The value is summarised by every node above the entry.
+   */
+  tl::expected<void, Errors_e> Insert(uint64_t start, uint64_t end, uint64_t ptr, double value = 0.0) {
+    if (start > end) {
+      return tl::unexpected(Errors_e::INVALID_TIME_RANGE);
+    }
+    if (m_collapsed && start <= m_collapsedEnd) {
+      return tl::unexpected(Errors_e::RANGE_AGGREGATED);
+    }
+    if (start < GetNewestStart()) {
+      BufferLateEntry({start, end, ptr, value});
+      Commit();
+      return {};
+    }
+    if (m_aryCounter == leafArity) {
+      AppendLeaf(start, end);
+    }
+
+    auto& leafs = m_nodes.front();
+    auto& newestLeaf = leafs.back();
+    m_aryCounter += 1;
+    auto insertRet = newestLeaf->Insert(start, end, ptr, value);
+    if (!insertRet) {
+      return tl::unexpected(insertRet.error());
+    }
+
+    Summary_t added;
+    added.Add(value);
+    AddToSpine(added);
+    UpdateTreeStats();
+    Commit();
+    return {};
+  }
+
+  /**
+   * @brief inserts a block of time ranges in one go
+   *
+   * The whole batch is validated up front so a bad entry leaves the tree untouched. Leafs are then filled a slice at a
+   * time, every new leaf is linked into its parents once and the right spine is only refreshed when a leaf fills up
+   * and at the end of the batch, instead of after every entry. Late entries in the batch go through the late buffer.
+   */
+  tl::expected<std::size_t, Errors_e> InsertBatch(std::span<const TimeRange_t> batch) {
+    for (const TimeRange_t& range : batch) {
+      if (range.start > range.end) {
+        return tl::unexpected(Errors_e::INVALID_TIME_RANGE);
+      }
+      if (m_collapsed && range.start <= m_collapsedEnd) {
+        return tl::unexpected(Errors_e::RANGE_AGGREGATED);
+      }
+    }
+
+    std::size_t offset = 0;
+    while (offset < batch.size()) {
+      // The longest run continuing in order from the newest entry goes straight into the leafs
+      uint64_t newest = GetNewestStart();
+      std::size_t runEnd = offset;
+      while (runEnd < batch.size() && batch[runEnd].start >= newest) {
+        newest = batch[runEnd].start;
+        ++runEnd;
+      }
+      AppendSorted(batch.subspan(offset, runEnd - offset));
+      offset = runEnd;
+      if (offset < batch.size()) {
+        BufferLateEntry(batch[offset]);
+        ++offset;
+      }
+    }
+
+    Commit();
+    return batch.size();
+  }
+
+  /**
+   * @brief merges the buffered late entries into the leafs
+   *
+   * Everything from the leaf holding the oldest late entry onwards is detached, merged with the buffer and appended
+   * again, so the cost depends on how late the entries are rather than on the size of the tree. The right edge of the
+   * tree is rewritten in place, concurrent readers are held off until the merge is done.
+   */
+  void FlushLateEntries() {
+    if (m_lateEntries.empty()) {
+      return;
+    }
+    ExcludeReaders();
+
+    auto& leafs = m_nodes.front();
+    // Last leaf starting at or before the oldest late entry, collapsed leafs are never rewritten
+    auto firstLeaf = std::upper_bound(
+        leafs.begin(), leafs.end(), m_lateEntries.front().start, [](uint64_t start, const Node* leaf) {
+          return start < leaf->GetNodeStart();
+        });
+    if (firstLeaf != leafs.begin()) {
+      firstLeaf = std::prev(firstLeaf);
+    }
+    while (firstLeaf != leafs.end() && (*firstLeaf)->GetAggregateLevel() != 0) {
+      ++firstLeaf;
+    }
+    const auto firstIndex = static_cast<std::size_t>(std::distance(leafs.begin(), firstLeaf));
+
+    std::vector<TimeRange_t> suffix;
+    std::unique_ptr<Buffer> buffer;
+    for (std::size_t i = firstIndex; i < leafs.size(); ++i) {
+      for (const TimeRange_t range : LeafEntries(leafs[i], buffer)) {
+        suffix.push_back(range);
+      }
+    }
+    std::vector<TimeRange_t> merged;
+    merged.reserve(suffix.size() + m_lateEntries.size());
+    std::merge(
+        suffix.begin(),
+        suffix.end(),
+        m_lateEntries.begin(),
+        m_lateEntries.end(),
+        std::back_inserter(merged),
+        [](const TimeRange_t& a, const TimeRange_t& b) { return a.start < b.start; });
+    m_lateEntries.clear();
+    m_lateSnapshot.reset();
+    m_lateChanged = false;
+
+    TruncateLeafs(firstIndex);
+    AppendSorted(merged);
+    Publish();
+  }
+
+  [[nodiscard]] std::size_t GetLateEntryCount() const {
+    return m_lateEntries.size();
+  }
+
+  // Number of late entries that are buffered before they are merged into the leafs
+  void SetLateBufferLimit(std::size_t limit) {
+    m_lateBufferLimit = std::max<std::size_t>(limit, 1);
+  }
+
+  // Decides the value collapsed nodes report, the mean by default. Only nodes collapsed afterwards are affected.
+  void SetAggregatePolicy(AggregatePolicy policy) {
+    m_aggregatePolicy = std::move(policy);
+  }
+
+  /**
+   * @brief keeps sealed leafs compressed, see CompressedLeafNode and codec::EncodeEntries()
+   *
+   * Every leaf but the newest is compressed right away, which covers trees that were bulk loaded or restored from a
+   * checkpoint. From then on a leaf is compressed as soon as the next one is started, the newest leaf keeps taking
+   * inserts as it is. Queries decode compressed leafs on the fly. Turning it off keeps the leafs compressed so far.
+   */
+  void SetLeafCompression(bool enabled) {
+    m_compressLeafs = enabled;
+    if (enabled) {
+      CompressSealedLeafs();
+      Commit();
+    }
+  }
+
+  /**
+   * @brief indexes everything left of the newest leaf in a pointer-free search tree, see SealedIndex
+   *
+   * Only the newest leaf and the right spine above it still change as entries are appended, the leafs and collapsed
+   * nodes before it keep their place until late entries are merged, nodes are collapsed or dropped, or leafs are
+   * compressed. Queries starting in that part find their first node with a branch free search over one contiguous
+   * array of node ends instead of descending through the inner nodes. The index covers what was sealed at the time
+   * of the call, queries past it descend as before. It is discarded on any of the changes above, call again to
+   * rebuild it, which takes a pass over the nodes it covers.
+   *
+   * Series written at a fixed interval are looked up without a search. Consecutive full leafs whose entries all start
+   * the same interval apart, continuing from one leaf into the next, are recorded as a run, and a query starting in a
+   * run computes which leaf holds its start. Runs end wherever the spacing breaks, queries there search as usual.
+   */
+  void Seal() {
+    DropSealedIndex();
+    std::vector<uint64_t> ends;
+    std::vector<Node*> nodes;
+    std::vector<typename Index::Run_t> runs;
+    std::unique_ptr<Buffer> buffer;
+    const Node* newest = m_nodes.front().back();
+    uint64_t end = 0;
+    for (Node* node = FindStartOfRange(m_root, 0); node != nullptr && node != newest; node = NextNode(node)) {
+      if (const uint64_t interval = RegularInterval(node, buffer); interval != 0) {
+        const uint64_t start = LeafEntries(node, buffer).GetStarts()[0];
+        typename Index::Run_t* run = runs.empty() ? nullptr : &runs.back();
+        if (run != nullptr && run->first + run->count == nodes.size() && run->step == interval * leafArity
+            && run->base + run->count * run->step == start) {
+          ++run->count;
+        } else {
+          runs.push_back({start, interval * leafArity, nodes.size(), 1});
+        }
+      }
+      // Kept ascending for the search, queries rely on ends ordered like starts anyway
+      end = std::max(end, node->GetNodeEnd());
+      ends.push_back(end);
+      nodes.push_back(node);
+    }
+    std::erase_if(runs, [](const typename Index::Run_t& run) { return run.count < MIN_REGULAR_RUN; });
+    if (!nodes.empty()) {
+      m_sealed = std::make_unique<const Index>(ends, nodes, std::move(runs));
+    }
+    Commit();
+  }
+
+  // Number of leafs and collapsed nodes the sealed index covers, 0 without one
+  [[nodiscard]] std::size_t GetSealedCount() const {
+    return m_sealed ? m_sealed->size() : 0;
+  }
+
+  // Number of regularly spaced runs of leafs the sealed index computes lookups for
+  [[nodiscard]] std::size_t GetRegularRunCount() const {
+    return m_sealed ? m_sealed->GetRunCount() : 0;
+  }
+
+  /**
+   * @brief builds a tree bottom-up from a sorted run of time ranges
+   *
+   * Packs every leaf full, then builds each inner level in a single pass over the level below, setting the back links
+   * and node times as it goes. The result has the same shape as inserting the entries one by one, so regular inserts
+   * can continue on it. With more than one thread the leafs are filled in parallel, the nodes themselves are still
+   * allocated up front from the calling thread.
+   */
+  static tl::expected<TimeTree, Errors_e> BulkLoad(std::span<const TimeRange_t> ranges, std::size_t threads = 1) {
+    for (std::size_t i = 0; i < ranges.size(); ++i) {
+      if (ranges[i].start > ranges[i].end || (i != 0 && ranges[i - 1].start > ranges[i].start)) {
+        return tl::unexpected(Errors_e::INVALID_TIME_RANGE);
+      }
+    }
+
+    TimeTree tree;
+    if (!ranges.empty()) {
+      tree.BuildFromSorted(ranges, std::max<std::size_t>(threads, 1));
+      tree.Publish();
+    }
+    return tree;
+  }
+
+  /**
+   * @brief writes a checkpoint of the tree to path
+   *
+   * See checkpoint::Header_t for the layout, buffered late entries are written as they are. The checkpoint is written
+   * next to path and only replaces it once synced, it is durable when Save returns.
+   */
+  tl::expected<void, Errors_e> Save(const std::string& path) const {
+    static_assert(sizeof(TimeRange_t) == 4 * sizeof(uint64_t));
+    const std::string temporary = path + ".tmp";
+    std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+    if (!out) {
+      return tl::unexpected(Errors_e::IO_ERROR);
+    }
+
+    checkpoint::Header_t header{};
+    header.magic = checkpoint::MAGIC;
+    header.version = checkpoint::VERSION;
+    header.leafArity = static_cast<uint32_t>(leafArity);
+    header.innerArity = static_cast<uint32_t>(innerArity);
+    header.height = static_cast<uint32_t>(m_nodes.size());
+    header.lateEntries = m_lateEntries.size();
+    header.collapsed = m_collapsed ? 1 : 0;
+    header.collapsedEnd = m_collapsedEnd;
+    header.logSequence = m_logSequence;
+    for (std::size_t level = 0; level < m_nodes.size(); ++level) {
+      header.levelSizes[level] = m_nodes[level].size();
+    }
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    auto leafRecord = std::make_unique<checkpoint::LeafRecord_t<leafArity>>();
+    std::unique_ptr<Buffer> buffer;
+    for (Node* node : m_nodes.front()) {
+      *leafRecord = {};
+      FillRecordHeader(leafRecord->node, node);
+      const EntryView data = LeafEntries(node, buffer);
+      for (std::size_t i = 0; i < data.size(); ++i) {
+        const TimeRange_t range = data[i];
+        leafRecord->starts[i] = range.start;
+        leafRecord->ends[i] = range.end;
+        leafRecord->ptrs[i] = range.ptr;
+        leafRecord->values[i] = range.value;
+      }
+      out.write(reinterpret_cast<const char*>(leafRecord.get()), sizeof(*leafRecord));
+    }
+
+    auto innerRecord = std::make_unique<checkpoint::InnerRecord_t<innerArity>>();
+    for (std::size_t level = 1; level < m_nodes.size(); ++level) {
+      // Children of the nodes that are not collapsed make up the level below, in order
+      std::size_t nextChild = 0;
+      for (Node* node : m_nodes[level]) {
+        *innerRecord = {};
+        FillRecordHeader(innerRecord->node, node);
+        std::copy_n(node->AsInner()->GetEnds(), node->GetChildCount(), innerRecord->ends.begin());
+        if (node->GetAggregateLevel() != 0) {
+          innerRecord->firstChild = checkpoint::NO_CHILD;
+        } else {
+          assert(m_nodes[level - 1][nextChild] == node->GetFirst());
+          innerRecord->firstChild = nextChild;
+          nextChild += node->GetChildCount();
+        }
+        out.write(reinterpret_cast<const char*>(innerRecord.get()), sizeof(*innerRecord));
+      }
+      assert(nextChild == m_nodes[level - 1].size());
+    }
+
+    out.write(
+        reinterpret_cast<const char*>(m_lateEntries.data()),
+        static_cast<std::streamsize>(m_lateEntries.size() * sizeof(TimeRange_t)));
+    out.close();
+    if (!out || !checkpoint::Replace(temporary, path)) {
+      std::remove(temporary.c_str());
+      return tl::unexpected(Errors_e::IO_ERROR);
+    }
+    return {};
+  }
+
+  /**
+   * @brief restores a tree from a checkpoint written by Save
+   *
+   * The file is mapped and all nodes are allocated up front from the calling thread, after which the nodes of all
+   * levels are filled in and linked in parallel. Checkpoints written with a different arity are rejected, as are
+   * checkpoints with a record pointing outside of its arrays or the level below.
+   */
+  static tl::expected<TimeTree, Errors_e> Load(const std::string& path, std::size_t threads = 1) {
+    const checkpoint::MappedFile file(path);
+    if (!file.IsOpen()) {
+      return tl::unexpected(Errors_e::IO_ERROR);
+    }
+    checkpoint::Header_t header{};
+    if (!checkpoint::ReadHeader<leafArity, innerArity>(file, header)
+        || !checkpoint::ValidateRecords<leafArity, innerArity>(file, header)) {
+      return tl::unexpected(Errors_e::INVALID_CHECKPOINT);
+    }
+    file.WillNeed();
+
+    TimeTree tree;
+    tree.m_allocator.Release(tree.m_root);
+    tree.m_nodes.clear();
+    std::size_t total = 0;
+    for (std::size_t level = 0; level < header.height; ++level) {
+      std::deque<Node*> nodes;
+      for (std::size_t i = 0; i < header.levelSizes[level]; ++i) {
+        nodes.push_back(
+            (level == 0) ? static_cast<Node*>(tree.m_allocator.GetNewLeaf(0, 0, 0))
+                         : static_cast<Node*>(tree.m_allocator.GetNewInner(0, 0)));
+      }
+      total += nodes.size();
+      tree.m_nodes.push_back(std::move(nodes));
+    }
+
+    // Work is split over the concatenation of all levels, leafs first
+    auto restore = [&tree, &header, &file](std::size_t first, std::size_t last) {
+      std::size_t levelFirst = 0;
+      for (std::size_t level = 0; level < header.height && levelFirst < last; ++level) {
+        const std::size_t levelSize = header.levelSizes[level];
+        const std::size_t begin = std::max(first, levelFirst) - levelFirst;
+        const std::size_t end = std::min(last, levelFirst + levelSize);
+        const std::byte* section = file.Data() + checkpoint::LevelOffset<leafArity, innerArity>(header, level);
+        for (std::size_t i = begin; i + levelFirst < end; ++i) {
+          if (level == 0) {
+            tree.RestoreLeaf(i, section + i * sizeof(checkpoint::LeafRecord_t<leafArity>));
+          } else {
+            tree.RestoreInner(level, i, section + i * sizeof(checkpoint::InnerRecord_t<innerArity>));
+          }
+        }
+        levelFirst += levelSize;
+      }
+    };
+
+    threads = std::clamp<std::size_t>(threads, 1, total);
+    if (threads > 1) {
+      std::vector<std::thread> workers;
+      const std::size_t perThread = (total + threads - 1) / threads;
+      for (std::size_t first = 0; first < total; first += perThread) {
+        workers.emplace_back(restore, first, std::min(first + perThread, total));
+      }
+      for (std::thread& worker : workers) {
+        worker.join();
+      }
+    } else {
+      restore(0, total);
+    }
+
+    tree.m_root = tree.m_nodes.back().front();
+    const Node* newest = tree.m_nodes.front().back();
+    tree.m_aryCounter = (newest->GetAggregateLevel() != 0) ? leafArity : newest->GetChildCount();
+    tree.m_collapsed = header.collapsed != 0;
+    tree.m_collapsedEnd = header.collapsedEnd;
+    tree.m_logSequence = header.logSequence;
+    const auto* late = reinterpret_cast<const TimeRange_t*>(
+        file.Data() + checkpoint::LevelOffset<leafArity, innerArity>(header, header.height));
+    tree.m_lateEntries.assign(late, late + header.lateEntries);
+    tree.m_lateChanged = true;
+    tree.Publish();
+    return tree;
+  }
+
+  // Sequence number of the last write-ahead log record applied to the tree, carried along in checkpoints
+  [[nodiscard]] uint64_t GetLogSequence() const {
+    return m_logSequence;
+  }
+
+  void SetLogSequence(uint64_t sequence) {
+    m_logSequence = sequence;
+  }
+
+  // Accessors handing out nodes or the level lists, like everything modifying the tree, belong to the writer thread
+  [[nodiscard]] std::size_t GetHeight() const {
+    return m_nodes.size();
+  }
+
+  [[nodiscard]] Node* GetRoot() const {
+    return m_root;
+  }
+
+  [[nodiscard]] auto GetLeafsIterator() const {
+    return m_nodes.front().begin();
+  }
+
+  [[nodiscard]] std::size_t GetNumberLeafs() const {
+    return m_nodes.front().size();
+  }
+
+  void PrintTree() const {
+    for (const auto& level : m_nodes) {
+      for (const Node* node : level) {
+        fmt::print("[{} {} {}] ", node->GetNodeStart(), node->GetNodeEnd(), node->GetChildCount());
+      }
+      fmt::print("\n");
+    }
+  }
+
+  auto& Data() {
+    return m_nodes;
+  }
+
+  [[nodiscard]] const alloc& GetAllocator() const {
+    return m_allocator;
+  }
+
+  // auto cbegin() const {
+  //   return m_nodes.front().cbegin();
+  // }
+  // auto cend() const {
+  //   return m_nodes.front().cend();
+  // }
+
+  /**
+   * @brief copies every entry overlapping [start, end] out of the tree, oldest first
+   *
+   * Queries may run from any number of threads while a single thread writes to the tree. A query sees every entry
+   * that was inserted before it started and possibly some that are inserted while it runs, each of them complete.
+   */
+  tl::expected<std::vector<TimeRange_t>, Errors_e> Query(uint64_t start, uint64_t end) const {
+    std::vector<TimeRange_t> res;
+    auto visited = QueryVisit(start, end, [&res](const TimeRange_t& range) { res.push_back(range); });
+    if (!visited) {
+      return tl::unexpected(visited.error());
+    }
+    return res;
+  }
+
+  /**
+   * @brief streams every entry overlapping [start, end] into visitor, oldest first
+   *
+   * Walks the leafs iteratively through the back links, nothing is allocated and the stack depth does not depend on
+   * the size of the range. Collapsed nodes are passed as a single entry carrying their aggregate ptr. The reader stays
+   * pinned while the visitor runs, keep it short when the writer is busy reclaiming nodes.
+   */
+  template<typename F> tl::expected<void, Errors_e> QueryVisit(uint64_t start, uint64_t end, F&& visitor) const {
+    EpochManager::Guard guard;
+    const Snapshot_t snapshot = Acquire(guard);
+    auto first = FindQueryStart(snapshot, start, end);
+    if (snapshot.late == nullptr || (!first && first.error() == Errors_e::INVALID_TIME_RANGE)) {
+      if (!first) {
+        return tl::unexpected(first.error());
+      }
+      CollectEntries(snapshot, *first, start, end, visitor);
+      return {};
+    }
+    if (!CollectMerged(snapshot, first ? *first : nullptr, start, end, visitor)) {
+      return tl::unexpected(first.error());
+    }
+    return {};
+  }
+
+  /**
+   * @brief copies the entries of several windows out of the tree in a single sweep
+   *
+   * Windows are [start, end] pairs sorted on their start, they may overlap or be empty. The entries of window i end up
+   * in out[offsets[i], offsets[i + 1]), oldest first, both vectors are cleared first so they can be reused across
+   * calls. Every window continues the descent of the one before it from the lowest node that still reaches its start,
+   * windows close together start from the same leaf without touching the levels above. All windows see the same
+   * state of the tree.
+   */
+  tl::expected<void, Errors_e> QueryMany(
+      std::span<const std::pair<uint64_t, uint64_t>> windows,
+      std::vector<TimeRange_t>& out,
+      std::vector<std::size_t>& offsets) const {
+    for (std::size_t i = 0; i < windows.size(); ++i) {
+      if (windows[i].first > windows[i].second || (i != 0 && windows[i].first < windows[i - 1].first)) {
+        return tl::unexpected(Errors_e::INVALID_TIME_RANGE);
+      }
+    }
+    out.clear();
+    offsets.clear();
+    offsets.reserve(windows.size() + 1);
+    offsets.push_back(0);
+
+    EpochManager::Guard guard;
+    const Snapshot_t snapshot = Acquire(guard);
+    std::vector<Node*> path{snapshot.root};
+    auto collect = [&out](const TimeRange_t& range) { out.push_back(range); };
+    for (const auto& [start, end] : windows) {
+      Node* first = FindStartFromPath(path, start);
+      if (snapshot.late != nullptr) {
+        CollectMerged(snapshot, first, start, end, collect);
+      } else if (first != nullptr) {
+        CollectEntries(snapshot, first, start, end, collect);
+      }
+      offsets.push_back(out.size());
+    }
+    return {};
+  }
+
+  /**
+   * @brief Query() spread over the threads of pool, for ranges covering a large part of the tree
+   *
+   * The range is split into subtrees at the first level below the root that has enough of them to keep every thread
+   * busy, each subtree is scanned into a buffer of its own and the buffers are copied into the result in parallel,
+   * with the buffered late entries merged in, so the entries come out in the same order as from Query(). The caller
+   * stays pinned for the whole query, which covers the nodes the pool threads read.
+   */
+  tl::expected<std::vector<TimeRange_t>, Errors_e> ParallelQuery(uint64_t start, uint64_t end, ThreadPool& pool) const {
+    EpochManager::Guard guard;
+    const Snapshot_t snapshot = Acquire(guard);
+    auto first = FindQueryStart(snapshot, start, end);
+    if (!first && (first.error() == Errors_e::INVALID_TIME_RANGE || snapshot.late == nullptr)) {
+      return tl::unexpected(first.error());
+    }
+    std::vector<TimeRange_t> late;
+    for (LateCursor cursor(snapshot.late); !cursor.AtEnd() && cursor->start <= end; ++cursor) {
+      if (cursor->end >= start) {
+        late.push_back(*cursor);
+      }
+    }
+    if (!first && late.empty()) {
+      return tl::unexpected(first.error());
+    }
+
+    std::vector<Node*> parts;
+    if (first) {
+      parts = SplitRange(snapshot.root, start, end, pool.GetThreadCount() * PARTS_PER_THREAD);
+    }
+    std::vector<std::vector<TimeRange_t>> scanned(parts.size());
+    std::vector<char> finals(parts.size(), 0);
+    pool.ParallelFor(parts.size(), [&snapshot, &parts, &scanned, &finals, start, end](std::size_t i) {
+      std::unique_ptr<Buffer> buffer;
+      auto collect = [&scanned, i](const TimeRange_t& range) { scanned[i].push_back(range); };
+      finals[i] = CollectSubtree(snapshot, parts[i], start, end, collect, buffer) ? 1 : 0;
+    });
+    // Like a serial query everything after the first final node is left out, which includes leafs appended since the
+    // snapshot was taken
+    const auto final = std::find(finals.begin(), finals.end(), 1);
+    if (final != finals.end()) {
+      parts.resize(static_cast<std::size_t>(final - finals.begin()) + 1);
+    }
+
+    // A late entry goes before the first entry from the leafs that starts after it, in whichever part that is
+    std::vector<std::size_t> offsets(parts.size() + 1, 0);
+    std::vector<std::size_t> lateEnds(parts.size() + 1, 0);
+    for (std::size_t i = 0; i < parts.size(); ++i) {
+      lateEnds[i + 1] = lateEnds[i];
+      if (!scanned[i].empty()) {
+        lateEnds[i + 1] = static_cast<std::size_t>(
+            std::lower_bound(
+                late.begin() + static_cast<std::ptrdiff_t>(lateEnds[i]),
+                late.end(),
+                scanned[i].back().start,
+                [](const TimeRange_t& range, uint64_t value) { return range.start < value; })
+            - late.begin());
+      }
+      offsets[i + 1] = offsets[i] + scanned[i].size() + lateEnds[i + 1] - lateEnds[i];
+    }
+    std::vector<TimeRange_t> res(offsets.back() + late.size() - lateEnds.back());
+    pool.ParallelFor(parts.size(), [&](std::size_t i) {
+      std::merge(
+          scanned[i].begin(),
+          scanned[i].end(),
+          late.begin() + static_cast<std::ptrdiff_t>(lateEnds[i]),
+          late.begin() + static_cast<std::ptrdiff_t>(lateEnds[i + 1]),
+          res.begin() + static_cast<std::ptrdiff_t>(offsets[i]),
+          [](const TimeRange_t& a, const TimeRange_t& b) { return a.start < b.start; });
+      scanned[i] = {};
+    });
+    std::copy(
+        late.begin() + static_cast<std::ptrdiff_t>(lateEnds.back()),
+        late.end(),
+        res.begin() + static_cast<std::ptrdiff_t>(offsets.back()));
+    return res;
+  }
+
+  /**
+   * @brief lazily evaluated query, entries are produced while iterating
+   *
+   * Keep the result in a variable before iterating, a range-for over *tree.QueryRange(...) outlives the temporary.
+   *   auto range = tree.QueryRange(start, end);
+   *   for (const TimeRange_t entry : *range) { ... }
+   * Nodes the writer unlinks are not reclaimed while any range is alive, drop ranges once done with them and before
+   * writing to the tree from the same thread, merging late entries waits for every live range.
+   */
+  tl::expected<EntryRange, Errors_e> QueryRange(uint64_t start, uint64_t end) const {
+    EpochManager::Guard guard;
+    const Snapshot_t snapshot = Acquire(guard);
+    auto first = FindQueryStart(snapshot, start, end);
+    if (!first) {
+      if (first.error() == Errors_e::INVALID_TIME_RANGE || snapshot.late == nullptr) {
+        return tl::unexpected(first.error());
+      }
+      return EntryRange(std::move(guard), snapshot, nullptr, start, end);
+    }
+    return EntryRange(std::move(guard), snapshot, *first, start, end);
+  }
+
+  /**
+   * @brief copies the n newest entries starting no later than before out of the tree, newest first
+   *
+   * Starts from the newest leaf, or the leaf holding before, and walks back through the reverse links, so only about
+   * n / leafArity leafs are read no matter how much older data there is. Collapsed nodes count as a single entry
+   * like they do in Query(), buffered late entries are interleaved. The result is Query(0, before) reversed and cut
+   * off after n entries.
+   */
+  tl::expected<std::vector<TimeRange_t>, Errors_e>
+      QueryLatest(std::size_t n, uint64_t before = std::numeric_limits<uint64_t>::max()) const {
+    EpochManager::Guard guard;
+    const Snapshot_t snapshot = Acquire(guard);
+    std::vector<TimeRange_t> res;
+    res.reserve(std::min<std::size_t>(n, 1 << 16));
+
+    // Late entries starting at or before before, taken from the back
+    LateCursor late = LateCursor::UpperBound(snapshot.late, before);
+    // Reverses the order of QueryVisit(), where late entries go before entries from the leafs with a later start
+    auto visitLate = [&](uint64_t from) {
+      for (; !late.AtBegin() && late.Prev().start >= from && res.size() < n; --late) {
+        res.push_back(late.Prev());
+      }
+    };
+
+    std::unique_ptr<Buffer> buffer;
+    for (Node* current = FindLatestUnit(snapshot, before); current != nullptr && res.size() < n;
+         current = PrevUnit(snapshot.root, current)) {
+      const NodeSlice_t slice = SliceNode(snapshot, current, 0, before, buffer);
+      if (late.AtBegin()) {
+        const std::size_t stop = slice.last - std::min(slice.last - slice.first, n - res.size());
+        for (std::size_t i = slice.last; i-- > stop;) {
+          res.push_back(EntryAt(current, slice, i));
+        }
+        continue;
+      }
+      for (std::size_t i = slice.last; i-- > slice.first && res.size() < n;) {
+        const TimeRange_t range = EntryAt(current, slice, i);
+        visitLate(range.start);
+        if (res.size() < n) {
+          res.push_back(range);
+        }
+      }
+    }
+    visitLate(0);
+    if (res.empty() && n != 0) {
+      return tl::unexpected(Errors_e::RANGE_NOT_IN_DB);
+    }
+    return res;
+  }
+
+  /**
+   * @brief the entry holding t, or the newest one before it, std::nullopt when every entry starts after t
+   *
+   * Same as QueryLatest(1, t) without building a vector. A single descent from the root takes the last child starting
+   * at or before t on every level, using the ends the inner nodes keep plus the start of the child it lands on, and
+   * a binary search over the starts of the leaf it ends in. Times in the newest leaf skip the descent. Nothing is
+   * allocated, compressed leafs are decoded on the stack. A collapsed node is returned as its aggregate entry.
+   */
+  [[nodiscard]] std::optional<TimeRange_t> AsOf(uint64_t t) const {
+    EpochManager::Guard guard;
+    const Snapshot_t snapshot = Acquire(guard);
+    std::optional<TimeRange_t> res = FindAsOf(snapshot, t);
+    // Late entries go after entries from the leafs with the same start, see QueryVisit()
+    const LateCursor late = LateCursor::UpperBound(snapshot.late, t);
+    if (!late.AtBegin() && (!res || late.Prev().start >= res->start)) {
+      res = late.Prev();
+    }
+    return res;
+  }
+
+  /**
+   * @brief count, sum, min and max over the values of every entry overlapping [start, end]
+   *
+   * Nodes lying entirely inside the range contribute the summary they keep, only the two edges of the range are
+   * descended into and only the leafs there are scanned, so the cost follows the height of the tree rather than the
+   * number of entries in the range. Collapsed nodes count with every entry they aggregated. The result matches
+   * summarising the entries of Query() as long as the ends of the entries are ordered like their starts. Summaries
+   * of nodes the writer is appending below may already include entries inserted while the query runs.
+   */
+  tl::expected<Summary_t, Errors_e> AggregateQuery(uint64_t start, uint64_t end) const {
+    EpochManager::Guard guard;
+    const Snapshot_t snapshot = Acquire(guard);
+    auto first = FindQueryStart(snapshot, start, end);
+    Summary_t summary;
+    bool found = false;
+    for (LateCursor late(snapshot.late); !late.AtEnd() && late->start <= end; ++late) {
+      if (late->end >= start) {
+        summary.Add(late->value);
+        found = true;
+      }
+    }
+    if (!first) {
+      if (first.error() == Errors_e::INVALID_TIME_RANGE || !found) {
+        return tl::unexpected(first.error());
+      }
+      return summary;
+    }
+    std::unique_ptr<Buffer> buffer;
+    SummarizeNode(snapshot, snapshot.root, start, end, summary, buffer);
+    return summary;
+  }
+
+  /**
+   * @brief number of entries overlapping [start, end], without copying any of them
+   *
+   * Counted the way AggregateQuery() counts: children lying entirely inside the range add the entry count their
+   * summary keeps, only the leafs at the two edges of the range are searched. Collapsed nodes count with every entry
+   * they aggregated, unlike Query() which returns them as a single entry. Ranges outside the tree count 0.
+   */
+  tl::expected<uint64_t, Errors_e> Count(uint64_t start, uint64_t end) const {
+    if (start > end) {
+      return tl::unexpected(Errors_e::INVALID_TIME_RANGE);
+    }
+    EpochManager::Guard guard;
+    const Snapshot_t snapshot = Acquire(guard);
+    uint64_t count = 0;
+    for (LateCursor late(snapshot.late); !late.AtEnd() && late->start <= end; ++late) {
+      count += late->end >= start ? 1 : 0;
+    }
+    std::unique_ptr<Buffer> buffer;
+    return count + CountNode(snapshot, snapshot.root, start, end, buffer);
+  }
+
+  // Whether any entry overlaps [start, end], stops at the first one found
+  [[nodiscard]] bool Any(uint64_t start, uint64_t end) const {
+    EpochManager::Guard guard;
+    const Snapshot_t snapshot = Acquire(guard);
+    for (LateCursor late(snapshot.late); !late.AtEnd() && late->start <= end; ++late) {
+      if (late->end >= start) {
+        return true;
+      }
+    }
+    auto first = FindQueryStart(snapshot, start, end);
+    if (!first) {
+      return false;
+    }
+    std::unique_ptr<Buffer> buffer;
+    for (Node* current = *first; current != nullptr; current = NextNode(current)) {
+      const NodeSlice_t slice = SliceNode(snapshot, current, start, end, buffer);
+      if (slice.first != slice.last) {
+        return true;
+      }
+      if (slice.final) {
+        return false;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * @brief aggregates nodes where all children are older than the cutoff
+   *
+   * This function will go through the tree and find nodes where the children are older than the
+   * cutoff value. The child nodes are aggregate into a tree node which then contains a collection of statistics.
+   * This operation makes the tree less accurate but achieves lossy compression.
+   * Nodes removed from the tree are handed back to the allocator once no reader can be on them anymore.
+   *
+   * Every collapsed node reports a single entry carrying the value the aggregation policy reduced its entries to,
+   * see SetAggregatePolicy(). Its aggregate ptr is 0 until the caller assigns one with UpdateAggregatePtrs().
+   * The entries that were replaced are appended to removed, so the caller can store the aggregate and GC the raw
+   * entries from storage.
+   *
+   * A leaf collapses to aggregation level 1, an inner node whose children have all collapsed to one level above the
+   * highest of theirs. Every call moves one level further up, nodes are not collapsed past maxLevel, so data of
+   * different ages can be kept at different resolutions by calling with an older cutoff and a higher level. Leafs
+   * always collapse, maxLevel is at least 1.
+   */
+  void Aggregate(
+      uint64_t cutoff, std::vector<TimeRange_t>& removed, std::size_t maxLevel = std::numeric_limits<uint8_t>::max()) {
+    // Late entries have to end up in the leafs they belong to before those are collapsed
+    FlushLateEntries();
+    // struct Remove {
+    //   Node* node;
+    //   std::size_t level;
+    // };
+    // // Node* start = FindEndOfRange(m_root, cutoff);
+    std::size_t level = m_nodes.size() - 1;
+    Node* node = m_root;
+    std::unique_ptr<Buffer> buffer;
+    // while (!node->IsLeaf()) {
+    while (node->GetAggregateLevel() == 0 && !node->IsLeaf()) {
+      // TODO first child can be aggregated, search for fist non-aggregated child
+      auto newNode =
+          std::find_if(node->GetChildren().begin(), node->GetChildren().end(), [](Node* child) {
+            return child->GetAggregateLevel() == 0;
+          });
+      if (newNode == node->GetChildren().end()) {
+        break;
+      } else {
+        node = *newNode;
+        --level;
+      }
+      // if (node->GetFirst()->GetAggregateLevel() == 0) {
+      //   node = node->GetFirst();
+      //   --level;
+      // } else if(node->GetLink() ) {
+
+      // } else {
+      //   break;
+      // }
+    }
+
+    // std::vector<Remove> toGC;
+    // // FIXME needs to be able to go down when encountering different levels of aggregation
+    // The newest node of every level keeps taking inserts and is never collapsed, it is the only one without a link
+    while (node != nullptr && node->GetLink() != nullptr && node->GetNodeEnd() <= cutoff) {
+      //   toGC.push_back({node, node->GetAggregateLevel()});
+
+      if (node->IsLeaf() && node->GetAggregateLevel() == 0) {
+        // Dealing with leafs
+        const std::size_t first = removed.size();
+        for (TimeRange_t range : LeafEntries(node, buffer)) {
+          removed.push_back(range);
+        }
+        Collapse(node, 1, std::span<const TimeRange_t>(removed).subspan(first));
+      } else if (!node->IsLeaf()) {
+        // Dealing with non-leafs
+        bool canAggregate =
+            std::all_of(node->GetChildren().begin(), node->GetChildren().end(), [](Node* child) {
+              return child->GetAggregateLevel() != 0;
+            });
+        std::size_t childLevel = 0;
+        for (Node* child : node->GetChildren()) {
+          childLevel = std::max(childLevel, child->GetAggregateLevel());
+        }
+
+        if (canAggregate && childLevel >= maxLevel) {
+          // Already as coarse as allowed, move on to the next node
+        } else if (canAggregate) {
+          // The entire subtree has already been aggregated so only the parent node needs to be removed
+          const std::size_t first = removed.size();
+          for (Node* child : node->GetChildren()) {
+            removed.push_back(
+                {child->GetNodeStart(), child->GetNodeEnd(), child->GetAggregatePtr(), child->GetAggregateValue()});
+          }
+
+          Collapse(node, childLevel + 1, std::span<const TimeRange_t>(removed).subspan(first));
+          DropSealedIndex();
+          for (std::size_t i = 0; i < node->GetChildCount(); ++i) {
+            Retire(m_nodes.at(level - 1).front());
+            m_nodes.at(level - 1).pop_front();
+            // Readers walking back from the new oldest node fall back to a descent
+            m_nodes.at(level - 1).front()->SetReverseLink(nullptr);
+          }
+        } else {
+          auto nextChild =
+              std::find_if(node->GetChildren().begin(), node->GetChildren().end(), [](Node* child) {
+                return child->GetAggregateLevel() == 0;
+              });
+
+          assert(nextChild != node->GetChildren().end());
+
+          --level;
+          node = *nextChild;
+          continue;
+        }
+      }
+
+      node = node->GetLink();
+
+      // A neighbour whose children have all collapsed is next in line itself
+      if (node != nullptr && node->GetAggregateLevel() == 0 && !node->IsLeaf()) {
+        auto newNode =
+            std::find_if(node->GetChildren().begin(), node->GetChildren().end(), [](Node* child) {
+              return child->GetAggregateLevel() == 0;
+            });
+        if (newNode != node->GetChildren().end()) {
+          node = *newNode;
+          --level;
+        }
+      }
+    }
+    Publish();
+    Reclaim();
+  }
+
+  /**
+   * @brief points collapsed nodes at where the caller stored their aggregate
+   *
+   * Every update names a collapsed node by its start and end, as reported by Aggregate(), and carries its new ptr.
+   * Updates for nodes that have since been collapsed further up, or never were, are skipped. Returns the number of
+   * nodes updated.
+   */
+  std::size_t UpdateAggregatePtrs(const std::vector<TimeRange_t>& updates) {
+    std::size_t updated = 0;
+    for (const TimeRange_t& update : updates) {
+      Node* node = FindStartOfRange(m_root, update.start);
+      if (node != nullptr && node->GetAggregateLevel() != 0 && node->GetNodeStart() == update.start
+          && node->GetNodeEnd() == update.end) {
+        node->SetAggregatePtr(update.ptr);
+        ++updated;
+      }
+    }
+    return updated;
+  }
+
+  /**
+   * @brief removes every node holding only entries that end before cutoff
+   *
+   * Whole subtrees are detached from the left edge of every level, leafs that straddle the cutoff are kept as they
+   * are. Each removed entry is passed to callback, collapsed nodes as the single entry they report, so the storage
+   * behind the ptrs can be deleted. Buffered late entries ending before the cutoff go as well. Only the nodes on the
+   * left edge are updated, the cost follows the number of nodes removed rather than the size of the tree. Concurrent
+   * readers are held off while the edge is rewritten. Returns the number of nodes removed.
+   */
+  template<typename F> std::size_t DropBefore(uint64_t cutoff, F&& callback) {
+    const std::size_t lateDropped = std::erase_if(m_lateEntries, [cutoff, &callback](const TimeRange_t& late) {
+      if (late.end >= cutoff) {
+        return false;
+      }
+      callback(late);
+      return true;
+    });
+    m_lateChanged = m_lateChanged || lateDropped != 0;
+    ExcludeReaders();
+    DropSealedIndex();
+    // Every collapsed node ends by m_collapsedEnd, none of them survives a later cutoff
+    if (m_collapsedEnd < cutoff) {
+      m_collapsed = false;
+      m_collapsedEnd = 0;
+    }
+
+    std::unique_ptr<Buffer> buffer;
+    auto drop = [this, &callback, &buffer](Node* node) {
+      if (node->GetAggregateLevel() != 0) {
+        callback(TimeRange_t{
+            node->GetNodeStart(), node->GetNodeEnd(), node->GetAggregatePtr(), node->GetAggregateValue()});
+      } else if (node->IsLeaf()) {
+        for (const TimeRange_t range : LeafEntries(node, buffer)) {
+          callback(range);
+        }
+      }
+      m_allocator.Release(node);
+    };
+
+    std::size_t removed = 0;
+    if (m_root->GetNodeEnd() < cutoff) {
+      // Nothing survives, the tree starts over from an empty leaf
+      for (const auto& level : m_nodes) {
+        for (Node* node : level) {
+          drop(node);
+          ++removed;
+        }
+      }
+      m_root = m_allocator.GetNewLeaf(0, 0, 0);
+      m_nodes.clear();
+      m_nodes.push_front({m_root});
+      m_aryCounter = 0;
+      Publish();
+      return removed;
+    }
+
+    // Top-down, the nodes dropped on a level are the children of the nodes dropped above plus the oldest children of
+    // the first survivor above. The newest node of every level ends at the root end, so each level keeps one.
+    std::vector<Inner*> edge;
+    std::size_t dropCount = 0;
+    for (auto level = m_nodes.rbegin(); level != m_nodes.rend(); ++level) {
+      std::size_t nextCount = 0;
+      for (; dropCount != 0; --dropCount) {
+        Node* node = level->front();
+        if (!node->IsLeaf() && node->GetAggregateLevel() == 0) {
+          nextCount += node->GetChildCount();
+        }
+        level->pop_front();
+        drop(node);
+        ++removed;
+      }
+      Node* first = level->front();
+      first->SetReverseLink(nullptr);
+      if (!first->IsLeaf() && first->GetAggregateLevel() == 0) {
+        Inner* inner = first->AsInner();
+        const std::size_t count = simd::FirstGreaterEqual(inner->GetEnds(), inner->GetChildCount(), cutoff);
+        if (count != 0) {
+          inner->DropChildren(count);
+          nextCount += count;
+        }
+        edge.push_back(inner);
+      }
+      dropCount = nextCount;
+    }
+    for (auto inner = edge.rbegin(); inner != edge.rend(); ++inner) {
+      (*inner)->UpdateNodeStart();
+      (*inner)->UpdateSummary();
+    }
+
+    while (m_nodes.size() > 1 && m_nodes.back().front()->GetChildCount() == 1) {
+      m_allocator.Release(m_nodes.back().front());
+      m_nodes.pop_back();
+      ++removed;
+    }
+    m_root = m_nodes.back().front();
+    Publish();
+    return removed;
+  }
+
+  // Walks the leafs and collapsed nodes, backwards through the reverse links, stepping back from end() starts at the
+  // newest leaf. Every copy shares the pin taken by begin() or end(), nodes stay allocated until the last one is gone.
+  struct Iterator {
+    using iterator_category = std::bidirectional_iterator_tag;
+    using difference_type = std::ptrdiff_t;
+    using value_type = Node;
+    using pointer = Node*;
+    using reference = Node&;
+    using TimeTreeType = std::deque<Node*>;
+
+    Iterator(pointer ptr, pointer root, std::shared_ptr<EpochManager::Guard> guard)
+    : m_ptr(ptr)
+    , m_root(root)
+    , m_guard(std::move(guard)) {}
+
+    reference operator*() const {
+      return *m_ptr;
+    }
+    pointer operator->() {
+      return m_ptr;
+    }
+
+    Iterator& operator++() {
+      m_ptr = m_ptr->GetLink();
+      while (m_ptr != nullptr && !(m_ptr->IsLeaf() || m_ptr->GetAggregateLevel() != 0)) {
+        m_ptr = m_ptr->GetFirst();
+      }
+      return *this;
+    }
+    Iterator operator++(int) {
+      Iterator tmp = *this;
+      ++(*this);
+      return tmp;
+    }
+
+    Iterator& operator--() {
+      m_ptr = m_ptr == nullptr ? LastUnit(m_root) : PrevUnit(m_root, m_ptr);
+      return *this;
+    }
+    Iterator operator--(int) {
+      Iterator tmp = *this;
+      --(*this);
+      return tmp;
+    }
+
+    friend bool operator==(const Iterator& a, const Iterator& b) {
+      return a.m_ptr == b.m_ptr;
+    }
+    friend bool operator!=(const Iterator& a, const Iterator& b) {
+      return a.m_ptr != b.m_ptr;
+    }
+
+  private:
+    pointer m_ptr;
+    pointer m_root;
+    std::shared_ptr<EpochManager::Guard> m_guard;
+  };
+
+  /**
+   * @brief iterators over the nodes, safe to use while another thread writes
+   *
+   * Both pin the reader and start from the published root. Like ranges from QueryRange() they hold off reclamation
+   * while alive, drop them before writing to the tree from the same thread, merging late entries waits for them.
+   */
+  auto begin() const {
+    auto guard = std::make_shared<EpochManager::Guard>();
+    Node* root = Acquire(*guard).root;
+    Node* res = root;
+    while (res->GetAggregateLevel() == 0 && !res->IsLeaf()) {
+      res = res->GetFirst();
+    }
+    return Iterator(res, root, std::move(guard));
+  }
+  auto end() const {
+    auto guard = std::make_shared<EpochManager::Guard>();
+    Node* root = Acquire(*guard).root;
+    return Iterator(nullptr, root, std::move(guard));
+  }
+
+private:
+  using ListIter = typename std::deque<std::deque<Node*>>::iterator;
+
+  void BuildFromSorted(std::span<const TimeRange_t> ranges, std::size_t threads) {
+    const std::size_t leafCount = (ranges.size() + leafArity - 1) / leafArity;
+
+    // The constructor already allocated the first leaf as root
+    auto& leafs = m_nodes.front();
+    for (std::size_t i = 1; i < leafCount; ++i) {
+      const TimeRange_t& first = ranges[i * leafArity];
+      Node* leaf = m_allocator.GetNewLeaf(first.start, first.end, 0);
+      leaf->SetReverseLink(leafs.back());
+      leafs.back()->SetBackLink(leaf);
+      leafs.push_back(leaf);
+    }
+
+    auto fillLeafs = [&leafs, ranges](std::size_t first, std::size_t last) {
+      for (std::size_t i = first; i < last; ++i) {
+        const std::size_t offset = i * leafArity;
+        leafs[i]->AsLeaf()->AppendBatch(ranges.subspan(offset, std::min(leafArity, ranges.size() - offset)));
+      }
+    };
+
+    threads = std::min(threads, leafCount);
+    if (threads > 1) {
+      std::vector<std::thread> workers;
+      const std::size_t perThread = (leafCount + threads - 1) / threads;
+      for (std::size_t first = 0; first < leafCount; first += perThread) {
+        workers.emplace_back(fillLeafs, first, std::min(first + perThread, leafCount));
+      }
+      for (std::thread& worker : workers) {
+        worker.join();
+      }
+    } else {
+      fillLeafs(0, leafCount);
+    }
+    m_aryCounter = leafs.back()->GetChildCount();
+
+    while (m_nodes.back().size() > 1) {
+      const std::deque<Node*>& children = m_nodes.back();
+      std::deque<Node*> parents;
+      for (std::size_t first = 0; first < children.size(); first += innerArity) {
+        Inner* parent = m_allocator.GetNewInner(children[first]->GetNodeStart(), 0);
+        const std::size_t last = std::min(first + innerArity, children.size());
+        for (std::size_t i = first; i < last; ++i) {
+          parent->InsertChild(children[i]);
+        }
+        parent->UpdateNodeEnd();
+        if (!parents.empty()) {
+          parent->SetReverseLink(parents.back());
+          parents.back()->SetBackLink(parent);
+        }
+        parents.push_back(parent);
+      }
+      m_nodes.push_back(std::move(parents));
+    }
+    m_root = m_nodes.back().front();
+  }
+
+  static void FillRecordHeader(checkpoint::NodeRecord_t& record, const Node* node) {
+    record.start = node->GetNodeStart();
+    record.end = node->GetNodeEnd();
+    record.aggregatePtr = node->GetAggregatePtr();
+    record.aggregateValue = node->GetAggregateValue();
+    record.count = static_cast<uint32_t>(node->GetChildCount());
+    record.aggregateLevel = static_cast<uint32_t>(node->GetAggregateLevel());
+    const Summary_t summary = node->GetSummary();
+    record.entries = summary.count;
+    record.sum = summary.sum;
+    record.min = summary.min;
+    record.max = summary.max;
+  }
+
+  static void RestoreNodeHeader(Node* node, const checkpoint::NodeRecord_t& record, Node* link, Node* reverse) {
+    std::ignore = node->UpdateTimeRange(record.start, record.end);
+    node->SetAggregatePtr(record.aggregatePtr);
+    node->SetAggregateValue(record.aggregateValue);
+    node->SetSummary({record.entries, record.sum, record.min, record.max});
+    node->SetAggregateLevel(record.aggregateLevel);
+    node->SetBackLink(link);
+    node->SetReverseLink(reverse);
+  }
+
+  void RestoreLeaf(std::size_t index, const std::byte* data) {
+    const auto* record = reinterpret_cast<const checkpoint::LeafRecord_t<leafArity>*>(data);
+    const std::deque<Node*>& leafs = m_nodes.front();
+    Node* node = leafs[index];
+    node->AsLeaf()->LoadEntries(
+        record->starts.data(), record->ends.data(), record->ptrs.data(), record->values.data(), record->node.count);
+    RestoreNodeHeader(
+        node,
+        record->node,
+        (index + 1 < leafs.size()) ? leafs[index + 1] : nullptr,
+        (index != 0) ? leafs[index - 1] : nullptr);
+  }
+
+  void RestoreInner(std::size_t level, std::size_t index, const std::byte* data) {
+    const auto* record = reinterpret_cast<const checkpoint::InnerRecord_t<innerArity>*>(data);
+    const std::deque<Node*>& nodes = m_nodes[level];
+    Node* node = nodes[index];
+    std::array<Node*, innerArity> children{};
+    std::span<Node* const> childSpan;
+    if (record->firstChild != checkpoint::NO_CHILD) {
+      const std::deque<Node*>& below = m_nodes[level - 1];
+      for (std::size_t i = 0; i < record->node.count; ++i) {
+        children[i] = below[record->firstChild + i];
+      }
+      childSpan = std::span<Node* const>(children.data(), record->node.count);
+    }
+    node->AsInner()->LoadChildren(childSpan, record->ends.data(), record->node.count);
+    RestoreNodeHeader(
+        node,
+        record->node,
+        (index + 1 < nodes.size()) ? nodes[index + 1] : nullptr,
+        (index != 0) ? nodes[index - 1] : nullptr);
+  }
+
+  // State readers start their queries from, written by the single writer as a seqlock
+  struct Published_t {
+    std::atomic<uint64_t> sequence{0};
+    std::atomic<Node*> root{nullptr};
+    std::atomic<Node*> newest{nullptr};
+    std::atomic<std::size_t> newestCount{0};
+    std::atomic<const LateSnapshot_t*> late{nullptr};
+    std::atomic<const Index*> sealed{nullptr};
+    // Shared with the other trees of a TimeTreeSet shard, owned by the tree otherwise
+    EpochManager* epochs{nullptr};
+    std::unique_ptr<EpochManager> ownEpochs;
+  };
+
+  // Leafs a query walks back from the newest one before it descends from the root instead
+  static constexpr std::size_t TAIL_LEAFS = 64;
+
+  // Shorter runs of regularly spaced leafs are searched for like the rest of the sealed index
+  static constexpr std::size_t MIN_REGULAR_RUN = 4;
+
+  // Subtrees a parallel query is split into per thread at least, so stealing can even out uneven ones
+  static constexpr std::size_t PARTS_PER_THREAD = 8;
+
+  // Retired nodes, late buffer copies and sealed indexes are reclaimed in batches, every reclaim scans all reader slots
+  static constexpr std::size_t RECLAIM_BATCH = 64;
+
+  // Late entries are published in chunks of LATE_CHUNK, a chunk growing to twice that is split
+  static constexpr std::size_t LATE_CHUNK = 256;
+
+  /**
+   * @brief makes the current state of the tree visible to readers
+   *
+   * The sequence is odd while the fields are being written, readers retry when they see it odd or changed.
+   */
+  void Publish() {
+    Published_t& published = *m_published;
+    if (m_lateChanged) {
+      auto late = std::make_unique<LateSnapshot_t>();
+      for (std::size_t first = 0; first < m_lateEntries.size(); first += LATE_CHUNK) {
+        const std::size_t last = std::min(first + LATE_CHUNK, m_lateEntries.size());
+        late->chunks.push_back(std::make_shared<const std::vector<TimeRange_t>>(
+            m_lateEntries.begin() + static_cast<std::ptrdiff_t>(first),
+            m_lateEntries.begin() + static_cast<std::ptrdiff_t>(last)));
+      }
+      ReplaceLateSnapshot(late->chunks.empty() ? nullptr : std::move(late));
+      m_lateChanged = false;
+    }
+
+    uint64_t sequence = published.sequence.load(std::memory_order_relaxed);
+    if (sequence % 2 == 0) {
+      published.sequence.store(++sequence, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+    }
+    Node* newest = m_nodes.front().back();
+    published.root.store(m_root, std::memory_order_relaxed);
+    published.newest.store(newest, std::memory_order_relaxed);
+    published.newestCount.store(newest->GetChildCount(), std::memory_order_relaxed);
+    published.late.store(m_lateSnapshot.get(), std::memory_order_relaxed);
+    published.sealed.store(m_sealed.get(), std::memory_order_relaxed);
+    published.sequence.store(sequence + 1, std::memory_order_release);
+  }
+
+  // Publishes the result of a write, then reclaims what readers can no longer reach
+  void Commit() {
+    Publish();
+    if (m_retiredNodes.size() + m_retiredLate.size() + m_retiredSealed.size() >= RECLAIM_BATCH) {
+      Reclaim();
+    }
+  }
+
+  // Pins the reader and takes a consistent snapshot of the published state, the guard keeps its nodes alive
+  Snapshot_t Acquire(EpochManager::Guard& guard) const {
+    Published_t& published = *m_published;
+    while (true) {
+      guard = published.epochs->Pin();
+      // Sequentially consistent so a reader pinning during ExcludeReaders() either is waited for or sees it odd
+      const uint64_t sequence = published.sequence.load(std::memory_order_seq_cst);
+      if (sequence % 2 == 0) {
+        const Snapshot_t snapshot{
+            published.root.load(std::memory_order_relaxed),
+            published.newest.load(std::memory_order_relaxed),
+            published.newestCount.load(std::memory_order_relaxed),
+            published.late.load(std::memory_order_relaxed),
+            published.sealed.load(std::memory_order_relaxed)};
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (published.sequence.load(std::memory_order_relaxed) == sequence) {
+          return snapshot;
+        }
+      }
+      guard.Unpin();
+      while (published.sequence.load(std::memory_order_acquire) == sequence) {
+        std::this_thread::yield();
+      }
+    }
+  }
+
+  /**
+   * @brief waits for every reader to leave and keeps new ones out until the next Publish()
+   *
+   * The tree can then be modified in place and nodes released right away, which is also done for everything retired.
+   */
+  void ExcludeReaders() {
+    Published_t& published = *m_published;
+    published.sequence.store(published.sequence.load(std::memory_order_relaxed) + 1, std::memory_order_seq_cst);
+    std::ignore = published.epochs->Advance();
+    published.epochs->WaitForReaders(published.epochs->GetEpoch());
+    for (const auto& [epoch, node] : m_retiredNodes) {
+      m_allocator.Release(node);
+    }
+    m_retiredNodes.clear();
+    m_retiredLate.clear();
+    m_retiredSealed.clear();
+  }
+
+  // Releases node once no reader can be on it anymore, it has to be unlinked from the tree already
+  void Retire(Node* node) {
+    m_retiredNodes.emplace_back(m_published->epochs->GetEpoch(), node);
+  }
+
+  // Called before any node the sealed index points to is unlinked or replaced, readers may still search it
+  void DropSealedIndex() {
+    if (m_sealed) {
+      m_retiredSealed.emplace_back(m_published->epochs->GetEpoch(), std::move(m_sealed));
+    }
+  }
+
+  // Frees everything retired before the oldest epoch a reader is still pinned at
+  void Reclaim() {
+    const uint64_t oldest = m_published->epochs->Advance();
+    std::erase_if(m_retiredNodes, [this, oldest](const std::pair<uint64_t, Node*>& retired) {
+      if (retired.first >= oldest) {
+        return false;
+      }
+      m_allocator.Release(retired.second);
+      return true;
+    });
+    std::erase_if(m_retiredLate, [oldest](const auto& retired) { return retired.first < oldest; });
+    std::erase_if(m_retiredSealed, [oldest](const auto& retired) { return retired.first < oldest; });
+  }
+
+  [[nodiscard]] uint64_t GetNewestStart() const {
+    const Node* newest = m_nodes.front().back();
+    if (newest->GetChildCount() == 0 || newest->GetAggregateLevel() != 0) {
+      return newest->GetNodeStart();
+    }
+    // The newest leaf is only compressed when merging late entries truncated back to a sealed one
+    std::unique_ptr<Buffer> buffer;
+    return LeafEntries(const_cast<Node*>(newest), buffer).GetStarts()[newest->GetChildCount() - 1];
+  }
+
+  void BufferLateEntry(const TimeRange_t& range) {
+    auto pos = std::upper_bound(
+        m_lateEntries.begin(), m_lateEntries.end(), range.start, [](uint64_t start, const TimeRange_t& late) {
+          return start < late.start;
+        });
+    const auto position = static_cast<std::size_t>(pos - m_lateEntries.begin());
+    m_lateEntries.insert(pos, range);
+    if (m_lateEntries.size() >= m_lateBufferLimit) {
+      FlushLateEntries();
+    } else if (!m_lateChanged) {
+      AddToLateSnapshot(position, range);
+    }
+  }
+
+  // Publishes range, just inserted at position into the late entries, copying only the chunk it lands in
+  void AddToLateSnapshot(std::size_t position, const TimeRange_t& range) {
+    auto late = std::make_unique<LateSnapshot_t>();
+    if (m_lateSnapshot) {
+      late->chunks = m_lateSnapshot->chunks;
+    }
+    if (late->chunks.empty()) {
+      late->chunks.push_back(std::make_shared<const std::vector<TimeRange_t>>(1, range));
+      ReplaceLateSnapshot(std::move(late));
+      return;
+    }
+    std::size_t chunk = 0;
+    while (chunk + 1 < late->chunks.size() && position > late->chunks[chunk]->size()) {
+      position -= late->chunks[chunk]->size();
+      ++chunk;
+    }
+    const std::vector<TimeRange_t>& old = *late->chunks[chunk];
+    std::vector<TimeRange_t> entries;
+    entries.reserve(old.size() + 1);
+    entries.insert(entries.end(), old.begin(), old.begin() + static_cast<std::ptrdiff_t>(position));
+    entries.push_back(range);
+    entries.insert(entries.end(), old.begin() + static_cast<std::ptrdiff_t>(position), old.end());
+    // Full chunks are split in half, so a copy never holds more than 2 * LATE_CHUNK entries
+    if (entries.size() == 2 * LATE_CHUNK) {
+      const auto half = entries.begin() + static_cast<std::ptrdiff_t>(LATE_CHUNK);
+      late->chunks.insert(
+          late->chunks.begin() + static_cast<std::ptrdiff_t>(chunk) + 1,
+          std::make_shared<const std::vector<TimeRange_t>>(half, entries.end()));
+      entries.erase(half, entries.end());
+    }
+    late->chunks[chunk] = std::make_shared<const std::vector<TimeRange_t>>(std::move(entries));
+    ReplaceLateSnapshot(std::move(late));
+  }
+
+  // Readers may still be on the current late snapshot, it is retired rather than freed
+  void ReplaceLateSnapshot(std::unique_ptr<const LateSnapshot_t> late) {
+    if (m_lateSnapshot) {
+      m_retiredLate.emplace_back(m_published->epochs->GetEpoch(), std::move(m_lateSnapshot));
+    }
+    m_lateSnapshot = std::move(late);
+  }
+
+  // Appends entries that are known to be sorted and not older than the newest entry
+  void AppendSorted(std::span<const TimeRange_t> ranges) {
+    std::size_t offset = 0;
+    while (offset < ranges.size()) {
+      if (m_aryCounter == leafArity) {
+        // The parents still carry the end the full leaf had when it was linked in
+        UpdateTreeStats();
+        AppendLeaf(ranges[offset].start, ranges[offset].end);
+      }
+      const std::size_t count = std::min(leafArity - m_aryCounter, ranges.size() - offset);
+      AddToSpine(m_nodes.front().back()->AsLeaf()->AppendBatch(ranges.subspan(offset, count)));
+      m_aryCounter += count;
+      offset += count;
+    }
+    UpdateTreeStats();
+  }
+
+  /**
+   * @brief detaches every leaf from index first onwards
+   *
+   * Parents that lose all their children are removed as well, the others drop their trailing children. The newest
+   * node on every level is unlinked and the root shrinks back while it has a single child.
+   */
+  void TruncateLeafs(std::size_t first) {
+    DropSealedIndex();
+    auto& leafs = m_nodes.front();
+    std::size_t removed = leafs.size() - first;
+    for (std::size_t i = first; i < leafs.size(); ++i) {
+      m_allocator.Release(leafs[i]);
+    }
+    leafs.erase(std::next(leafs.begin(), static_cast<std::ptrdiff_t>(first)), leafs.end());
+
+    for (auto level = std::next(m_nodes.begin()); level != m_nodes.end(); ++level) {
+      std::size_t removedChildren = removed;
+      removed = 0;
+      while (removedChildren != 0) {
+        Inner* parent = level->back()->AsInner();
+        const std::size_t count = parent->GetChildCount();
+        if (removedChildren >= count) {
+          m_allocator.Release(parent);
+          level->pop_back();
+          ++removed;
+          removedChildren -= count;
+        } else {
+          parent->TruncateChildren(count - removedChildren);
+          removedChildren = 0;
+        }
+      }
+    }
+
+    while (!m_nodes.empty() && m_nodes.back().empty()) {
+      m_nodes.pop_back();
+    }
+    if (m_nodes.empty()) {
+      m_root = m_allocator.GetNewLeaf(0, 0, 0);
+      m_nodes.push_front({m_root});
+      m_aryCounter = 0;
+      return;
+    }
+    while (m_nodes.size() > 1 && m_nodes.back().front()->GetChildCount() == 1) {
+      m_allocator.Release(m_nodes.back().front());
+      m_nodes.pop_back();
+    }
+    m_root = m_nodes.back().front();
+
+    for (auto& level : m_nodes) {
+      level.back()->SetBackLink(nullptr);
+    }
+    // Bottom-up, the newest node of every level may sit above a truncated one without losing children itself
+    for (auto level = std::next(m_nodes.begin()); level != m_nodes.end(); ++level) {
+      if (level->back()->GetAggregateLevel() == 0) {
+        level->back()->AsInner()->UpdateSummary();
+      }
+    }
+    // A collapsed leaf never takes new entries, the next append starts a fresh one
+    m_aryCounter = (leafs.back()->GetAggregateLevel() != 0) ? leafArity : leafs.back()->GetChildCount();
+    UpdateTreeStats();
+  }
+
+  // Starts a new newest leaf and links it into the tree
+  void AppendLeaf(uint64_t start, uint64_t end) {
+    Node* newLeaf = m_allocator.GetNewLeaf(start, end, 0);
+    const std::size_t height = m_nodes.size();
+    auto& leafs = m_nodes.front();
+    m_aryCounter = 0;
+    newLeaf->SetReverseLink(leafs.back());
+    leafs.back()->SetBackLink(newLeaf);
+    leafs.push_back(newLeaf);
+    UpdateTreeLevels(m_nodes.front(), (height > 1) ? std::next(m_nodes.begin()) : m_nodes.end());
+    if (m_compressLeafs) {
+      CompressSealedLeaf();
+    }
+  }
+
+  // The leaf before the newest one was just sealed, its parent is one of the newest two on the level above
+  void CompressSealedLeaf() {
+    const std::size_t index = m_nodes.front().size() - 2;
+    Node* leaf = m_nodes.front()[index];
+    if (leaf->IsCompressed()) {
+      return;
+    }
+    for (auto parent = m_nodes[1].rbegin(); parent != m_nodes[1].rend(); ++parent) {
+      // Collapsed parents keep their child count but not their children
+      if ((*parent)->GetAggregateLevel() != 0) {
+        continue;
+      }
+      const std::span<Node*> children = (*parent)->GetChildren();
+      const auto child = std::find(children.begin(), children.end(), leaf);
+      if (child != children.end()) {
+        CompressLeaf((*parent)->AsInner(), static_cast<std::size_t>(std::distance(children.begin(), child)), index);
+        return;
+      }
+    }
+  }
+
+  // Every leaf but the newest, the children of the parents that are not collapsed make up the leafs in order
+  void CompressSealedLeafs() {
+    if (m_nodes.size() == 1) {
+      return;
+    }
+    const std::deque<Node*>& leafs = m_nodes.front();
+    std::size_t index = 0;
+    for (Node* parent : m_nodes[1]) {
+      if (parent->GetAggregateLevel() != 0) {
+        continue;
+      }
+      for (std::size_t i = 0; i < parent->GetChildCount(); ++i, ++index) {
+        if (index + 1 < leafs.size() && !leafs[index]->IsCompressed()) {
+          CompressLeaf(parent->AsInner(), i, index);
+        }
       }
-      fmt::print("\n");
     }
   }
 
-  auto& Data() {
-    return m_nodes;
+  /**
+   * @brief swaps the leaf at index, child of parent, for a compressed copy
+   *
+   * The copy is complete before it is linked in, readers still on the old leaf keep it until it is reclaimed.
+   */
+  void CompressLeaf(Inner* parent, std::size_t child, std::size_t index) {
+    std::deque<Node*>& leafs = m_nodes.front();
+    Node* leaf = leafs[index];
+    if (m_sealed && leaf->GetNodeStart() <= m_sealed->GetLastKey()) {
+      DropSealedIndex();
+    }
+    Node* compressed = m_allocator.GetNewCompressedLeaf(*leaf->AsLeaf());
+    compressed->SetBackLink(leaf->GetLink());
+    compressed->SetReverseLink(leaf->GetReverseLink());
+    parent->ReplaceChild(child, compressed);
+    if (index != 0) {
+      leafs[index - 1]->SetBackLink(compressed);
+    }
+    if (index + 1 < leafs.size()) {
+      leafs[index + 1]->SetReverseLink(compressed);
+    }
+    leafs[index] = compressed;
+    Retire(leaf);
   }
 
-  // auto cbegin() const {
-  //   return m_nodes.front().cbegin();
-  // }
-  // auto cend() const {
-  //   return m_nodes.front().cend();
-  // }
-
-  tl::expected<std::vector<TimeRange_t>, Errors_e> Query(uint64_t start, uint64_t end) {
+  static tl::expected<Node*, Errors_e> FindQueryStart(const Snapshot_t& snapshot, uint64_t start, uint64_t end) {
     if (start > end) {
       return tl::unexpected(Errors_e::INVALID_TIME_RANGE);
     }
-    if (start > m_root->GetNodeEnd() || end < m_root->GetNodeStart()) {
+    if (start > snapshot.root->GetNodeEnd() || end < snapshot.root->GetNodeStart()) {
       return tl::unexpected(Errors_e::RANGE_NOT_IN_DB);
     }
-    std::vector<TimeRange_t> res;
-
-    // TimeTreeNode<arity>* node = FindEndOfRange(m_root, end);
-    TimeTreeNode<arity>* node = FindStartOfRange(m_root, start);
-    // while (!node->IsLeaf()) {
-    //   node = FindChildInRange(node, end);
-    //   if (node == nullptr) {
-    //     return tl::unexpected(Errors_e::RANGE_NOT_IN_DB);
-    //   }
-    // }
-
+    if (snapshot.sealed != nullptr) {
+      if (Node* const* sealed = snapshot.sealed->FindFirstGreaterEqual(start); sealed != nullptr) {
+        return *sealed;
+      }
+    }
+    if (end >= snapshot.newest->GetNodeStart()) {
+      if (Node* tail = FindTailStart(snapshot, start); tail != nullptr) {
+        return tail;
+      }
+    }
+    Node* node = FindStartOfRange(snapshot.root, start);
     if (node == nullptr) {
       return tl::unexpected(Errors_e::RANGE_NOT_IN_DB);
     }
-
-    // fmt::print("Found end at: {} ({} - {})\n", fmt::ptr(node), node->GetNodeStart(), node->GetNodeEnd());
-
-    // CollectEntries(res, node, start);
-    CollectEntries(res, node, start, end);
-
-    // for (const auto val : res) {
-    //   fmt::print("{} -> {}\n", val.start, val.end);
-    // }
-    // while (node->GetNodeStart() >= start) {
-    //   for (TimeRange_t ptr : node->GetData()) {
-    //     if (!(ptr.start <= start && start <= ptr.end)) {
-    //       fmt::print("New timerange : {} - {}\n", ptr.start, ptr.end);
-    //       res.push_back(&ptr);
-    //     }
-    //     // if (ptr.start < start) {
-    //     //   return res;
-    //     // }
-    //   }
-    //   // res.push_back(node);
-    //   if (node->GetLink() == nullptr) {
-    //     break;
-    //   }
-    //   node = node->GetLink();
-    // }
-
-    return res;
+    return node;
   }
 
   /**
-   * @brief aggregates nodes where all children are older than the cutoff
-   *
-   * This function will go through the tree and find nodes where the children are older than the
-   * cutoff value. The child nodes are aggregate into a tree node which then contains a collection of statistics.
-   * This operation makes the tree less accurate but achieves lossy compression.
-   *
-   * NOTE there needs to be some way in which the caller is able to see which nodes were removed.
-   * When using a log structure to store the tree this information needs to be known such that those nodes can be GC'ed
-   * from storage.
-   *
-   * - Find largest subtree where node end is smaller than cutoff.
-   * - Choice whether to collapse entire tree in one GC round or only one level
+   * @brief last leaf or collapsed node holding an entry starting no later than before, nullptr when there is none
    *
-   * - iterate over all leaf nodes, collect all leafs where leaf.end < cutoff
-   * - Maybe insert some criteria where there can only be a single level of aggregation
-   * - TODO think about some criteria when high levels of aggregations are allowed
+   * Nodes are ordered on their starts but the first one ending at or after before may start past it, or be followed by
+   * nodes that start at before as well, the walks on either side of it take a step at most for ordered entries.
    */
-  void Aggregate(uint64_t cutoff, std::vector<TimeRange_t>& removed) {
-    // struct Remove {
-    //   TimeTreeNode<arity>* node;
-    //   std::size_t level;
-    // };
-    // // TimeTreeNode<arity>* start = FindEndOfRange(m_root, cutoff);
-    std::size_t level = m_nodes.size() - 1;
-    TimeTreeNode<arity>* node = m_root;
-    // while (!node->IsLeaf()) {
-    while (node->GetAggregateLevel() == 0 && !node->IsLeaf()) {
-      // TODO first child can be aggregated, search for fist non-aggregated child
-      auto newNode =
-          std::find_if(node->GetChildren().begin(), node->GetChildren().end(), [](TimeTreeNode<arity>* child) {
-            return child->GetAggregateLevel() == 0;
-          });
-      if (newNode == node->GetChildren().end()) {
+  static Node* FindLatestUnit(const Snapshot_t& snapshot, uint64_t before) {
+    if (before >= snapshot.newest->GetNodeStart()) {
+      return snapshot.newest;
+    }
+    auto found = FindQueryStart(snapshot, before, before);
+    if (!found) {
+      return before > snapshot.root->GetNodeEnd() ? snapshot.newest : nullptr;
+    }
+    Node* current = *found;
+    while (current != snapshot.newest) {
+      Node* next = NextNode(current);
+      if (next == nullptr || next->GetNodeStart() > before) {
         break;
-      } else {
-        node = *newNode;
-        --level;
       }
-      // if (node->GetFirst()->GetAggregateLevel() == 0) {
-      //   node = node->GetFirst();
-      //   --level;
-      // } else if(node->GetLink() ) {
-
-      // } else {
-      //   break;
-      // }
+      current = next;
     }
+    while (current != nullptr && current->GetNodeStart() > before) {
+      current = PrevUnit(snapshot.root, current);
+    }
+    return current;
+  }
 
-    fmt::print("starting node: ({} - {}) leaf: {}\n", node->GetNodeStart(), node->GetNodeEnd(), node->IsLeaf());
-
-    // std::vector<Remove> toGC;
-    // // FIXME needs to be able to go down when encountering different levels of aggregation
-    while (node->GetNodeEnd() <= cutoff) {
-      fmt::print(
-          "Aggregating node {}-{} (level: {})\n",
-          node->GetNodeStart(),
-          node->GetNodeEnd(),
-          node->GetAggregateLevel());
-      //   toGC.push_back({node, node->GetAggregateLevel()});
-
-      if (node->IsLeaf() && node->GetAggregateLevel() == 0) {
-        // Dealing with leafs
-        for (TimeRange_t range : node->GetData()) {
-          removed.push_back(range);
+  static std::optional<TimeRange_t> FindAsOf(const Snapshot_t& snapshot, uint64_t t) {
+    Node* node = t >= snapshot.newest->GetNodeStart() ? snapshot.newest : snapshot.root;
+    while (node->GetAggregateLevel() == 0 && !node->IsLeaf()) {
+      Inner* inner = node->AsInner();
+      const std::size_t count = inner->GetChildCount();
+      // The first child ending at or after t holds it, unless t falls in the gap before that child
+      std::size_t index = simd::FirstGreaterEqual(inner->GetEnds(), count, t);
+      if (index == count || inner->GetChildren()[index]->GetNodeStart() > t) {
+        if (index == 0) {
+          return std::nullopt;
         }
-        node->SetAggregatePtr(1337);
-        node->IncAggregateLevel();
-        fmt::print(
-            "Aggregating {}-{} to aggregate level: {}\n",
-            node->GetNodeStart(),
-            node->GetNodeEnd(),
-            node->GetAggregateLevel());
-      } else if (!node->IsLeaf()) {
-        // Dealing with non-leafs
-        bool canAggregate =
-            std::all_of(node->GetChildren().begin(), node->GetChildren().end(), [](TimeTreeNode<arity>* child) {
-              return child->GetAggregateLevel() == 1;
-            });
-
-        if (canAggregate) {
-          fmt::print(
-              "Subtree of {}-{} is aggregated, aggregating now. Removing from level: {}\n",
-              node->GetNodeStart(),
-              node->GetNodeEnd(),
-              level - 1);
-
-          // The entire subtree has already been aggregated so only the parent node needs to be removed
-          for (TimeTreeNode<arity>* child : node->GetChildren()) {
-            removed.push_back({child->GetNodeStart(), child->GetNodeEnd(), child->GetAggregatePtr()});
-          }
+        --index;
+      }
+      node = inner->GetChildren()[index];
+    }
+    bool last = false;
+    std::optional<TimeRange_t> res = FindLatestInNode(snapshot, node, t, last);
+    // Entries overlapping t may continue into the nodes after it
+    while (last && node != snapshot.newest) {
+      node = NextNode(node);
+      if (node == nullptr || node->GetNodeStart() > t) {
+        break;
+      }
+      res = FindLatestInNode(snapshot, node, t, last);
+    }
+    return res;
+  }
 
-          node->SetAggregatePtr(1337);
-          node->IncAggregateLevel();
-          for (uint64_t i = 0; i < arity; ++i) {
-            std::unique_ptr<TimeTreeNode<arity>> nodePtr{m_nodes.at(level - 1).front()};
-            m_nodes.at(level - 1).pop_front();
-          }
-        } else {
-          fmt::print("Cannot aggregate subtree, moving to children, ");
+  // Entry of a leaf or collapsed node with the latest start at or before t, last is set when it is the final one
+  static std::optional<TimeRange_t> FindLatestInNode(const Snapshot_t& snapshot, Node* node, uint64_t t, bool& last) {
+    if (node->GetAggregateLevel() != 0) {
+      last = true;
+      if (node->GetNodeStart() > t) {
+        return std::nullopt;
+      }
+      return TimeRange_t{node->GetNodeStart(), node->GetNodeEnd(), node->GetAggregatePtr(), node->GetAggregateValue()};
+    }
+    auto latest = [&snapshot, node, t, &last](const EntryView& entries) -> std::optional<TimeRange_t> {
+      const std::size_t count = node == snapshot.newest ? snapshot.newestCount : entries.size();
+      const std::size_t index = simd::FirstGreater(entries.GetStarts(), count, t);
+      last = index == count;
+      if (index == 0) {
+        return std::nullopt;
+      }
+      return entries[index - 1];
+    };
+    if (node->IsCompressed()) {
+      Buffer buffer;
+      return latest(node->AsCompressed()->Unpack(buffer));
+    }
+    return latest(node->AsLeaf()->GetData());
+  }
 
-          auto nextChild =
-              std::find_if(node->GetChildren().begin(), node->GetChildren().end(), [](TimeTreeNode<arity>* child) {
-                return child->GetAggregateLevel() == 0;
-              });
+  /**
+   * @brief first leaf or collapsed node ending at or after start, nullptr when every node ends before it
+   *
+   * path runs from the root down to the node found for an earlier start that was at most start. Everything left of
+   * that node ends before start, so the node searched for sits below the lowest node on the path that ends at or
+   * after start. The levels below it are dropped and the descent continues from there, leaving the path for the next
+   * call.
+   */
+  static Node* FindStartFromPath(std::vector<Node*>& path, uint64_t start) {
+    while (path.size() > 1 && path.back()->GetNodeEnd() < start) {
+      path.pop_back();
+    }
+    Node* node = path.back();
+    if (node->GetNodeEnd() < start) {
+      return nullptr;
+    }
+    while (node->GetAggregateLevel() == 0 && !node->IsLeaf()) {
+      Inner* inner = node->AsInner();
+      const std::size_t count = inner->GetChildCount();
+      const std::size_t index = simd::FirstGreaterEqual(inner->GetEnds(), count, start);
+      if (index == count) {
+        return nullptr;
+      }
+      node = inner->GetChildren()[index];
+      path.push_back(node);
+    }
+    return node;
+  }
 
-          assert(nextChild != node->GetChildren().end());
+  /**
+   * Entries of [start, end] from first on interleaved with the late entries of the snapshot, first may be nullptr when
+   * no node reaches the range. Returns whether there was a node to start from or any late entry in range.
+   */
+  template<typename F>
+  static bool CollectMerged(const Snapshot_t& snapshot, Node* first, uint64_t start, uint64_t end, F& visitor) {
+    LateCursor late(snapshot.late);
+    bool found = false;
+    auto visitLate = [&](uint64_t before) {
+      for (; !late.AtEnd() && late->start < before; ++late) {
+        if (late->end >= start && late->start <= end) {
+          visitor(*late);
+          found = true;
+        }
+      }
+    };
+    if (first != nullptr) {
+      auto merging = [&](const TimeRange_t& range) {
+        visitLate(range.start);
+        visitor(range);
+      };
+      CollectEntries(snapshot, first, start, end, merging);
+      found = true;
+    }
+    visitLate(end == std::numeric_limits<uint64_t>::max() ? end : end + 1);
+    return found;
+  }
 
-          --level;
-          fmt::print("level: {}\n", level);
-          node = *nextChild;
+  /**
+   * @brief subtrees overlapping [start, end] that together hold every entry of the range, in order
+   *
+   * Starts from root and replaces every inner node with its children overlapping the range, one level at a time,
+   * until there are at least parts subtrees or only leafs and collapsed nodes are left.
+   */
+  static std::vector<Node*> SplitRange(Node* root, uint64_t start, uint64_t end, std::size_t parts) {
+    std::vector<Node*> frontier{root};
+    std::vector<Node*> next;
+    bool split = true;
+    while (split && frontier.size() < parts) {
+      split = false;
+      next.clear();
+      for (Node* node : frontier) {
+        if (node->IsLeaf() || node->GetAggregateLevel() != 0) {
+          next.push_back(node);
           continue;
         }
+        split = true;
+        Inner* inner = node->AsInner();
+        const std::size_t count = inner->GetChildCount();
+        for (std::size_t i = simd::FirstGreaterEqual(inner->GetEnds(), count, start); i < count; ++i) {
+          Node* child = inner->GetChildren()[i];
+          if (child->GetNodeStart() > end) {
+            break;
+          }
+          next.push_back(child);
+        }
       }
+      frontier.swap(next);
+    }
+    return frontier;
+  }
 
-      node = node->GetLink();
+  /**
+   * Streams the entries of [start, end] below node into visitor, going through the children instead of the links so
+   * the subtree can be scanned on its own. Returns true once a node is final, see SliceNode().
+   */
+  template<typename F>
+  static bool CollectSubtree(
+      const Snapshot_t& snapshot,
+      Node* node,
+      uint64_t start,
+      uint64_t end,
+      F& visitor,
+      std::unique_ptr<Buffer>& buffer) {
+    if (node->IsLeaf() || node->GetAggregateLevel() != 0) {
+      const NodeSlice_t slice = SliceNode(snapshot, node, start, end, buffer);
+      for (std::size_t i = slice.first; i < slice.last; ++i) {
+        visitor(EntryAt(node, slice, i));
+      }
+      return slice.final;
+    }
+    Inner* inner = node->AsInner();
+    const std::size_t count = inner->GetChildCount();
+    for (std::size_t i = simd::FirstGreaterEqual(inner->GetEnds(), count, start); i < count; ++i) {
+      Node* child = inner->GetChildren()[i];
+      if (child->GetNodeStart() > end || CollectSubtree(snapshot, child, start, end, visitor, buffer)) {
+        return true;
+      }
+    }
+    return false;
+  }
 
-      if (node->GetAggregateLevel() == 0 && !node->IsLeaf()) {
-        auto newNode =
-            std::find_if(node->GetChildren().begin(), node->GetChildren().end(), [](TimeTreeNode<arity>* child) {
-              return child->GetAggregateLevel() == 0;
-            });
-        if (newNode == node->GetChildren().end()) {
-          break;
-        } else {
-          node = *newNode;
-          --level;
-        }
+  template<typename F>
+  static void CollectEntries(const Snapshot_t& snapshot, Node* current, uint64_t start, uint64_t end, F& visitor) {
+    std::unique_ptr<Buffer> buffer;
+    while (current != nullptr) {
+      const NodeSlice_t slice = SliceNode(snapshot, current, start, end, buffer);
+      for (std::size_t i = slice.first; i < slice.last; ++i) {
+        visitor(EntryAt(current, slice, i));
+      }
+      if (slice.final) {
+        return;
       }
+      current = NextNode(current);
     }
   }
 
-  void UpdateAggregatePtrs(const std::vector<TimeRange_t>& updates) {
-    return;
+  /**
+   * @brief first node ending at or after start, found by walking back from the newest leaf
+   *
+   * Queries reaching the newest leaf scan every leaf the walk passes anyway, so the walk takes the place of the
+   * descent for ranges over the most recent data without touching the upper levels. Gives up with nullptr after
+   * TAIL_LEAFS leafs or at the oldest leaf, which may have collapsed nodes before it on the levels above.
+   */
+  static Node* FindTailStart(const Snapshot_t& snapshot, uint64_t start) {
+    Node* current = snapshot.newest;
+    for (std::size_t i = 0; i < TAIL_LEAFS; ++i) {
+      Node* prev = PrevNode(current);
+      if (prev == nullptr) {
+        return nullptr;
+      }
+      if (prev->GetNodeEnd() < start) {
+        return current;
+      }
+      current = prev;
+    }
+    return nullptr;
   }
 
-  struct Iterator {
-    using iterator_category = std::forward_iterator_tag;
-    using difference_type = std::ptrdiff_t;
-    using value_type = TimeTreeNode<arity>;
-    using pointer = TimeTreeNode<arity>*;
-    using reference = TimeTreeNode<arity>&;
-    using TimeTreeType = std::deque<TimeTreeNode<arity>*>;
+  static Node* PrevNode(Node* current) {
+    Node* prev = current->GetReverseLink();
+    while (prev != nullptr && prev->GetAggregateLevel() == 0 && !prev->IsLeaf()) {
+      prev = prev->GetChildren().back();
+    }
+    return prev;
+  }
 
-    Iterator(pointer ptr): m_ptr(ptr) {}
+  // Leaf or collapsed node before current, nullptr for the oldest one
+  static Node* PrevUnit(Node* root, Node* current) {
+    Node* prev = PrevNode(current);
+    return prev != nullptr ? prev : FindPrecedingUnit(root, current);
+  }
 
-    reference operator*() const {
-      return *m_ptr;
+  /**
+   * @brief leaf or collapsed node right before target, the oldest node of its level
+   *
+   * Nothing links the oldest node of a level to the collapsed nodes before it, those hang off the levels above, left
+   * of the path down to target. Starts grow from child to child, so the path follows the child starting last at or
+   * before target, only trying the next one as well when both start at the same time. The last node found left of the
+   * path is the one target follows, or its newest leaf when it is not collapsed. A path missing target means it has
+   * been collapsed away since it was reached, nothing is returned then rather than a node newer than target.
+   */
+  static Node* FindPrecedingUnit(Node* root, Node* target) {
+    Node* preceding = nullptr;
+    return (FindPathTo(root, target, preceding) && preceding != nullptr) ? LastUnit(preceding) : nullptr;
+  }
+
+  // Descends from node to target, keeping the newest node seen left of the path in preceding
+  static bool FindPathTo(Node* node, Node* target, Node*& preceding) {
+    if (node == target) {
+      return true;
     }
-    pointer operator->() {
-      return m_ptr;
+    if (node->IsLeaf() || node->GetAggregateLevel() != 0) {
+      return false;
     }
-
-    Iterator& operator++() {
-      m_ptr = m_ptr->GetLink();
-      while (m_ptr != nullptr && !(m_ptr->IsLeaf() || m_ptr->GetAggregateLevel() == 1)) {
-        m_ptr = m_ptr->GetFirst();
+    const uint64_t start = target->GetNodeStart();
+    const std::span<Node*> children = node->GetChildren();
+    for (std::size_t index = 0; index < children.size() && children[index]->GetNodeStart() <= start; ++index) {
+      if (index + 1 < children.size() && children[index + 1]->GetNodeStart() < start) {
+        continue;
       }
-      return *this;
-    }
-    Iterator operator++(int) {
-      Iterator tmp = *this;
-      ++(*this);
-      return tmp;
+      Node* const before = preceding;
+      if (index != 0) {
+        preceding = children[index - 1];
+      }
+      if (FindPathTo(children[index], target, preceding)) {
+        return true;
+      }
+      preceding = before;
     }
+    return false;
+  }
 
-    friend bool operator==(const Iterator& a, const Iterator& b) {
-      return a.m_ptr == b.m_ptr;
-    }
-    friend bool operator!=(const Iterator& a, const Iterator& b) {
-      return a.m_ptr != b.m_ptr;
+  // Newest leaf or collapsed node below node
+  static Node* LastUnit(Node* node) {
+    while (node->GetAggregateLevel() == 0 && !node->IsLeaf()) {
+      node = node->GetChildren().back();
     }
+    return node;
+  }
 
-  private:
-    pointer m_ptr;
-  };
+  static Node* NextNode(Node* current) {
+    Node* next = current->GetLink();
+    while (next != nullptr && next->GetAggregateLevel() == 0 && !next->IsLeaf()) {
+      next = next->GetFirst();
+    }
+    return next;
+  }
 
-  // auto begin() {
-  //   return m_nodes.front().begin();
-  // }
-  // auto end() {
-  //   return m_nodes.front().end();
-  // }
-  auto begin() {
-    TimeTreeNode<arity>* res = m_root;
-    while (res->GetAggregateLevel() == 0 && !res->IsLeaf()) {
-      res = res->GetFirst();
+  static TimeRange_t EntryAt(Node* current, const NodeSlice_t& slice, std::size_t index) {
+    if (!slice.collapsed) {
+      return slice.entries[index];
     }
-    return Iterator(res);
-    // return Iterator(m_nodes.front().at(0));
+    return {current->GetNodeStart(), current->GetNodeEnd(), current->GetAggregatePtr(), current->GetAggregateValue()};
   }
-  auto end() {
-    return Iterator(nullptr);
+
+  // Distance between the starts of the entries of a full leaf if it is the same for all of them, 0 otherwise
+  static uint64_t RegularInterval(Node* node, std::unique_ptr<Buffer>& buffer) {
+    if (!node->IsLeaf() || node->GetAggregateLevel() != 0 || node->GetChildCount() != leafArity || leafArity < 2) {
+      return 0;
+    }
+    const uint64_t* starts = LeafEntries(node, buffer).GetStarts();
+    const uint64_t interval = starts[1] - starts[0];
+    for (std::size_t i = 2; i < leafArity; ++i) {
+      if (starts[i] - starts[i - 1] != interval) {
+        return 0;
+      }
+    }
+    return interval;
   }
 
-private:
-  using ListIter = typename std::deque<std::deque<TimeTreeNode<arity>*>>::iterator;
+  // Entries of a leaf, a compressed one is decoded into buffer which is allocated on first use
+  static EntryView LeafEntries(Node* leaf, std::unique_ptr<Buffer>& buffer) {
+    if (!leaf->IsCompressed()) {
+      return leaf->AsLeaf()->GetData();
+    }
+    if (!buffer) {
+      buffer = std::make_unique<Buffer>();
+    }
+    return leaf->AsCompressed()->Unpack(*buffer);
+  }
 
-  void CollectEntries(std::vector<TimeRange_t>& results, TimeTreeNode<arity>* current, uint64_t start, uint64_t end) {
-    // if (current->GetNodeStart() >= start) {
-    //   return;
-    // }
-    if (current->GetAggregateLevel() == 0 && current->IsLeaf()) {
-      for (TimeRange_t ptr : current->GetData()) {
-        if (ptr.end < start || ptr.start > end) {
-          continue;
-        }
-        if (ptr.start <= end && end <= ptr.end) {
-          // fmt::print("Found {} -> {}\n", ptr.start, ptr.end);
-          results.push_back(ptr);
-          return;
-        }
-        // fmt::print("Found {} -> {}\n", ptr.start, ptr.end);
-        results.push_back(ptr);
-      }
-    } else if (current->GetAggregateLevel() == 1) {
-      TimeRange_t ptr{current->GetNodeStart(), current->GetNodeEnd(), current->GetAggregatePtr()};
-      // TODO check that time range is correct here
-      // if (ptr.end < start || ptr.start > end) {
-      //   continue;
-      // }
-      if (ptr.start <= end && end <= ptr.end) {
-        // fmt::print("Found {} -> {}\n", ptr.start, ptr.end);
-        results.push_back(ptr);
-        return;
+  /**
+   * Adds the values of the entries overlapping [start, end] below node to summary. Children lying entirely inside the
+   * range are taken as a whole, the others are descended into.
+   */
+  static void SummarizeNode(
+      const Snapshot_t& snapshot,
+      Node* node,
+      uint64_t start,
+      uint64_t end,
+      Summary_t& summary,
+      std::unique_ptr<Buffer>& buffer) {
+    if (node->GetAggregateLevel() != 0) {
+      if (node->GetNodeEnd() >= start && node->GetNodeStart() <= end) {
+        summary.Merge(node->GetSummary());
       }
-      // fmt::print("Found {} -> {}\n", ptr.start, ptr.end);
-      results.push_back(ptr);
+      return;
     }
-
-    if (current->GetLink() == nullptr) {
+    if (node->IsLeaf()) {
+      const NodeSlice_t slice = SliceNode(snapshot, node, start, end, buffer);
+      const double* values = slice.entries.GetValues();
+      for (std::size_t i = slice.first; i < slice.last; ++i) {
+        summary.Add(values[i]);
+      }
       return;
     }
+    Inner* inner = node->AsInner();
+    const std::size_t count = inner->GetChildCount();
+    for (std::size_t i = simd::FirstGreaterEqual(inner->GetEnds(), count, start); i < count; ++i) {
+      Node* child = inner->GetChildren()[i];
+      const uint64_t childStart = child->GetNodeStart();
+      if (childStart > end) {
+        break;
+      }
+      if (childStart >= start && child->GetNodeEnd() <= end) {
+        summary.Merge(child->GetSummary());
+      } else {
+        SummarizeNode(snapshot, child, start, end, summary, buffer);
+      }
+    }
+  }
 
-    TimeTreeNode<arity>* next = current->GetLink();
-    if (next->GetAggregateLevel() == 0 && !next->IsLeaf()) {
-      next = next->GetFirst();
+  // Entries overlapping [start, end] below node, taken from the entry counts like SummarizeNode() merges summaries
+  static uint64_t CountNode(
+      const Snapshot_t& snapshot, Node* node, uint64_t start, uint64_t end, std::unique_ptr<Buffer>& buffer) {
+    if (node->GetAggregateLevel() != 0) {
+      return node->GetNodeEnd() >= start && node->GetNodeStart() <= end ? node->GetEntryCount() : 0;
+    }
+    if (node->IsLeaf()) {
+      const NodeSlice_t slice = SliceNode(snapshot, node, start, end, buffer);
+      return slice.last - slice.first;
+    }
+    Inner* inner = node->AsInner();
+    const std::size_t count = inner->GetChildCount();
+    uint64_t entries = 0;
+    for (std::size_t i = simd::FirstGreaterEqual(inner->GetEnds(), count, start); i < count; ++i) {
+      Node* child = inner->GetChildren()[i];
+      const uint64_t childStart = child->GetNodeStart();
+      if (childStart > end) {
+        break;
+      }
+      if (childStart >= start && child->GetNodeEnd() <= end) {
+        entries += child->GetEntryCount();
+      } else {
+        entries += CountNode(snapshot, child, start, end, buffer);
+      }
     }
+    return entries;
+  }
 
-    CollectEntries(results, next, start, end);
+  /**
+   * Entries [first, last) of a leaf or collapsed node overlap the range, final is set when no later node can.
+   * Either an entry starts past the end of the range or the newest one covers it. Entries appended to the newest leaf
+   * of the snapshot after it was taken are left out. Compressed leafs are decoded into buffer.
+   *
+   * A walk can still get past the snapshot once its newest leaf has been swapped for a compressed copy. Out there a
+   * leaf is only complete once the next one is linked to it, so the link is read before the entries, and a leaf
+   * without one ends the walk.
+   */
+  static NodeSlice_t SliceNode(
+      const Snapshot_t& snapshot, Node* current, uint64_t start, uint64_t end, std::unique_ptr<Buffer>& buffer) {
+    if (current->GetAggregateLevel() != 0) {
+      const bool overlaps = current->GetNodeEnd() >= start && current->GetNodeStart() <= end;
+      return {0, overlaps ? 1U : 0U, current->GetNodeEnd() >= end || current->GetNodeStart() > end, true, {}};
+    }
+    const bool newest = current == snapshot.newest;
+    const bool followed = !newest && current->GetLink() != nullptr;
+    const EntryView entries = LeafEntries(current, buffer);
+    const std::size_t count = newest ? snapshot.newestCount : entries.size();
+    const std::size_t first = simd::FirstGreaterEqual(entries.GetEnds(), count, start);
+    const std::size_t last = first + simd::FirstGreater(entries.GetStarts() + first, count - first, end);
+    const bool final = !followed || last != count || (count != 0 && entries.GetEnds()[count - 1] >= end);
+    return {first, last, final, false, entries};
   }
 
-  TimeTreeNode<arity>* FindChildInRange(TimeTreeNode<arity>* node, uint64_t end) {
-    for (auto child : node->GetChildren()) {
-      if (child->GetNodeStart() <= end && end <= child->GetNodeEnd()) {
-        return child;
-      }
+  Node* FindChildInRange(Node* node, uint64_t end) {
+    Inner* inner = node->AsInner();
+    const std::size_t count = inner->GetChildCount();
+    const std::size_t index = simd::FirstGreaterEqual(inner->GetEnds(), count, end);
+    if (index == count || inner->GetChildren()[index]->GetNodeStart() > end) {
+      return nullptr;
     }
-    return nullptr;
+    return inner->GetChildren()[index];
   }
 
-  TimeTreeNode<arity>* FindEndOfRange(TimeTreeNode<arity>* node, uint64_t end) {
+  Node* FindEndOfRange(Node* node, uint64_t end) {
     fmt::print("Search for end: {}\n", end);
     if (node->IsLeaf()) {
       return node;
     }
-    TimeTreeNode<arity>* res = nullptr;
-    for (TimeTreeNode<arity>* child : node->GetChildren()) {
-      // fmt::print("Query -> node {} -> {}\n", child->GetNodeStart(), child->GetNodeEnd());
-      if (child->GetNodeStart() <= end && end <= child->GetNodeEnd()) {
-        // fmt::print("Child found\n");
-        res = child;
-        break;
-      }
-    }
+    Node* res = FindChildInRange(node, end);
     if (res == nullptr) {
       return nullptr;
     }
@@ -664,47 +3274,45 @@ private:
   }
 
   // TODO start not at leaf level, take aggregated subtree into account
-  TimeTreeNode<arity>* FindStartOfRange(TimeTreeNode<arity>* node, uint64_t start) {
+  static Node* FindStartOfRange(Node* node, uint64_t start) {
     // fmt::print("Search for start: {}\n", start);
-    if (node->IsLeaf() || node->GetAggregateLevel() == 1) {
+    if (node->IsLeaf() || node->GetAggregateLevel() != 0) {
       return node;
     }
-    // If the start does not lie with the range of a node, but we cam across a value before the
-    // start we cap the start value to the end of that node.
-    uint64_t startCap = 0;
-    TimeTreeNode<arity>* res = nullptr;
-    for (TimeTreeNode<arity>* child : node->GetChildren()) {
-      // fmt::print("Query -> node {} -> {}\n", child->GetNodeStart(), child->GetNodeEnd());
-      if (child->GetNodeStart() <= start && start <= child->GetNodeEnd()) {
-        // fmt::print("Child found\n");
-        res = child;
-        break;
-      }
-      // Start lies between previous node and this node
-      if (child->GetNodeStart() > start && startCap != 0) {
-        res = child;
-        // fmt::print("Clamping to older node, start set to: ({}-{})", res->GetNodeStart(), res->GetNodeEnd());
-        break;
-      }
-      if (child->GetNodeEnd() < start) {
-        startCap = child->GetNodeEnd();
-        // res = child;
-      }
-    }
-    if (res == nullptr) {
+    // The first child ending at or after start either holds start, or start falls in the gap before it and the
+    // range is clamped to that child.
+    Inner* inner = node->AsInner();
+    const std::size_t count = inner->GetChildCount();
+    const std::size_t index = simd::FirstGreaterEqual(inner->GetEnds(), count, start);
+    if (index == count) {
       return nullptr;
     }
-    return FindStartOfRange(res, start);
+    return FindStartOfRange(inner->GetChildren()[index], start);
   }
 
-  // TimeTreeNode<arity>* FindOldest(TimeTreeNode<arity>* node) { }
+  // Node* FindOldest(Node* node) { }
+
+  // Marks node as collapsed to level, reporting the value the policy reduces entries to
+  void Collapse(Node* node, std::size_t level, std::span<const TimeRange_t> entries) {
+    node->SetAggregateValue(m_aggregatePolicy(node->GetSummary(), entries));
+    node->SetAggregateLevel(level);
+    m_collapsed = true;
+    m_collapsedEnd = std::max(m_collapsedEnd, node->GetNodeEnd());
+  }
+
+  // Adds the summary of entries appended to the newest leaf to every node above it
+  void AddToSpine(const Summary_t& added) {
+    for (auto level = std::next(m_nodes.begin()); level != m_nodes.end(); ++level) {
+      level->back()->AddSummary(added);
+    }
+  }
 
   void UpdateTreeStats() {
     // for (const auto& level : m_nodes) {
-    //   TimeTreeNode<arity>* newestLeaf = level.back();
+    //   Node* newestLeaf = level.back();
     ListIter iter = std::next(m_nodes.begin());
     for (; iter != m_nodes.end(); ++iter) {
-      TimeTreeNode<arity>* newestParent = iter->back();
+      Inner* newestParent = iter->back()->AsInner();
       newestParent->UpdateNodeEnd();
       // uint64_t end = newestParent->GetChildren().at(newestParent->GetChildCount())->GetNodeEnd();
       // newestParent->SetNodeEnd(end);
@@ -713,8 +3321,8 @@ private:
     // for (; iter != m_nodes.end(); ++iter) {
     //   // // Another option might be to get the n of child nodes for the parent and take
     //   // // the last n nodes of the iter level
-    //   // std::deque<TimeTreeNode<arity>>& parent = iter->back();
-    //   // std::array<TimeTreeNode<arity>*, arity>& children = parent.back().GetChildren();
+    //   // std::deque<Node>& parent = iter->back();
+    //   // std::array<Node*, arity>& children = parent.back().GetChildren();
     //   auto parentLevel = std::next(iter);
     //   auto& children = parentLevel->back()->GetChildren();
 
@@ -731,24 +3339,24 @@ private:
    * - Link parent of new node
    * - Create new root if root is full
    * */
-  void UpdateTreeLevels(std::deque<TimeTreeNode<arity>*>& childList, ListIter rest, std::size_t level = 0) {
+  void UpdateTreeLevels(std::deque<Node*>& childList, ListIter rest, std::size_t level = 0) {
     if (rest == m_nodes.end()) {
       // fmt::print("Updating root level\n");
       const std::size_t rootLength = childList.size();
       if (rootLength > 1) {
         // fmt::print("Constructing new root\n");
-        const std::size_t offset = std::min(arity, rootLength);
+        const std::size_t offset = std::min(innerArity, rootLength);
         const uint64_t tsStart = (*std::prev(childList.end(), offset))->GetNodeStart();
         const uint64_t tsEnd = childList.back()->GetNodeEnd();
-        // auto newRoot = std::make_unique<TimeTreeNode<arity>>(false, tsStart, tsEnd, 0);
-        TimeTreeNode<arity>* newRoot = m_allocator.GetNew(false, tsStart, tsEnd, 0);
+        // auto newRoot = std::make_unique<Node>(false, tsStart, tsEnd, 0);
+        Inner* newRoot = m_allocator.GetNewInner(tsStart, tsEnd);
 
         // m_root = newRoot.release();
         m_root = newRoot;
         m_nodes.push_back({m_root});
 
         for (auto it = std::prev(childList.end(), offset); it != childList.end(); ++it) {
-          m_root->InsertChild(*it);
+          newRoot->InsertChild(*it);
         }
 
         // m_root->UpdateNodeStart();
@@ -762,30 +3370,56 @@ private:
       const std::size_t parentChildCount = rightMostParent->GetChildCount();
       const auto& leftMostChild = childList.back();
 
-      if (parentChildCount >= arity) {
+      if (parentChildCount >= innerArity) {
         // fmt::print("Inserting new parent\n");
         // auto newNode =
-        //     std::make_unique<TimeTreeNode<arity>>(false, leftMostChild->GetNodeStart(), leftMostChild->GetNodeEnd(), 0);
+        //     std::make_unique<Node>(false, leftMostChild->GetNodeStart(), leftMostChild->GetNodeEnd(), 0);
 
-        TimeTreeNode<arity>* newNode = m_allocator.GetNew(false, leftMostChild->GetNodeStart(), leftMostChild->GetNodeEnd(), 0);
+        // Readers may follow the link as soon as it is set, the child has to be in place before
+        Inner* newNode = m_allocator.GetNewInner(leftMostChild->GetNodeStart(), leftMostChild->GetNodeEnd());
+        newNode->InsertChild(leftMostChild);
+        newNode->SetReverseLink(m_nodes.at(level + 1).back());
         m_nodes.at(level + 1).back()->SetBackLink(newNode);
         m_nodes.at(level + 1).push_back(newNode);
         UpdateTreeLevels(*rest, std::next(rest), level + 1);
-        m_nodes.at(level + 1).back()->InsertChild(leftMostChild);
       } else {
-        rightMostParent->InsertChild(leftMostChild);
+        rightMostParent->AsInner()->InsertChild(leftMostChild);
       }
     }
   }
 
-  // std::unique_ptr<TimeTreeNode<arity>> m_root;
-  TimeTreeNode<arity>* m_root;
-  // std::deque<TimeTreeNode<arity>*> m_nodes;
-  std::deque<std::deque<TimeTreeNode<arity>*>> m_nodes;
+  // Declared before m_root, the constructor allocates the root from it
+  alloc m_allocator;
+
+  // std::unique_ptr<Node> m_root;
+  Node* m_root;
+  // std::deque<Node*> m_nodes;
+  std::deque<std::deque<Node*>> m_nodes;
 
   std::size_t m_aryCounter{0};
 
-  alloc m_allocator;
+  // Entries that arrived after newer ones, sorted on start
+  std::vector<TimeRange_t> m_lateEntries;
+  // Late entries as handed to readers, rebuilt by Publish() when m_lateChanged is set and patched by every late insert
+  // otherwise
+  std::unique_ptr<const LateSnapshot_t> m_lateSnapshot;
+  bool m_lateChanged{false};
+  std::size_t m_lateBufferLimit{4 * leafArity};
+  AggregatePolicy m_aggregatePolicy{aggregate::Mean};
+  bool m_compressLeafs{false};
+  // Built by Seal(), dropped as soon as any of the nodes it points to changes
+  std::unique_ptr<const Index> m_sealed;
+  // Everything up to m_collapsedEnd has been aggregated and can't take late entries anymore
+  bool m_collapsed{false};
+  uint64_t m_collapsedEnd{0};
+  uint64_t m_logSequence{0};
+
+  // Behind a pointer so the tree stays movable
+  std::unique_ptr<Published_t> m_published;
+  // Unlinked while readers may still be on them, stamped with the epoch they were unlinked in
+  std::vector<std::pair<uint64_t, Node*>> m_retiredNodes;
+  std::vector<std::pair<uint64_t, std::unique_ptr<const LateSnapshot_t>>> m_retiredLate;
+  std::vector<std::pair<uint64_t, std::unique_ptr<const Index>>> m_retiredSealed;
 };
 
 #endif // TIMETREE_H_
@@ -0,0 +1,242 @@
+#ifndef TIMETREESET_H_
+#define TIMETREESET_H_
+
+#include "Epoch.hpp"
+#include "ThreadPool.hpp"
+#include "TimeTree.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <span>
+#include <thread>
+#include <tl/expected.hpp>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief collection of time trees keyed by series id
+ *
+ * Series are striped over shards by id, every shard has its own lock, node pool and reader epochs that all of its
+ * trees share. A series starts out as a small sorted array and only becomes a tree once it holds more entries than a
+ * single leaf, so the many series with a handful of points don't pay for nodes and level lists they barely use.
+ * Writes to a shard are serialised by a writer lock of their own. Queries take the shard lock shared and keep running
+ * while a tree takes inserts, only adding a series, changing inline entries or moving them into a tree shuts them out.
+ */
+template<std::size_t leafArity, std::size_t innerArity = leafArity> class TimeTreeSet {
+public:
+  using Allocator = SharedSlabAllocator<leafArity, innerArity>;
+  using Tree = TimeTree<leafArity, innerArity, Allocator>;
+
+  explicit TimeTreeSet(
+      std::size_t shards = std::thread::hardware_concurrency(),
+      std::size_t threads = std::thread::hardware_concurrency())
+  : m_pool(threads) {
+    for (std::size_t i = 0; i < std::max<std::size_t>(shards, 1); ++i) {
+      m_shards.push_back(std::make_unique<Shard_t>());
+    }
+  }
+
+  tl::expected<void, Errors_e> Insert(uint64_t series, uint64_t start, uint64_t end, uint64_t ptr, double value = 0.0) {
+    if (start > end) {
+      return tl::unexpected(Errors_e::INVALID_TIME_RANGE);
+    }
+    Shard_t& shard = GetShard(series);
+    std::lock_guard<std::mutex> writer(shard.writer);
+    // Only writers change the map, holding the writer lock is enough to look it up
+    auto found = shard.series.find(series);
+    if (found != shard.series.end() && found->second.tree != nullptr) {
+      // A tree takes one writer alongside any number of readers
+      std::shared_lock<std::shared_mutex> lock(shard.mutex);
+      return found->second.tree->Insert(start, end, ptr, value);
+    }
+    if (found == shard.series.end() || found->second.small.size() < leafArity) {
+      std::unique_lock<std::shared_mutex> lock(shard.mutex);
+      std::vector<TimeRange_t>& small = shard.series[series].small;
+      auto pos = std::upper_bound(small.begin(), small.end(), start, [](uint64_t key, const TimeRange_t& range) {
+        return key < range.start;
+      });
+      small.insert(pos, {start, end, ptr, value});
+      return {};
+    }
+
+    // Outgrew a single leaf, move the entries into a tree of their own. Readers keep seeing the inline entries until
+    // the tree holds all of them, a failed move leaves the series as it was
+    Series_t& entry = found->second;
+    auto tree = std::make_unique<Tree>(Allocator(&shard.allocator), &shard.epochs);
+    auto moved = tree->InsertBatch(entry.small);
+    if (!moved) {
+      return tl::unexpected(moved.error());
+    }
+    auto inserted = tree->Insert(start, end, ptr, value);
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    entry.tree = std::move(tree);
+    entry.small = {};
+    ++shard.trees;
+    return inserted;
+  }
+
+  /**
+   * @brief entries of a single series overlapping [start, end], oldest first
+   *
+   * Follows TimeTree::Query, unknown series are reported as RANGE_NOT_IN_DB.
+   */
+  tl::expected<std::vector<TimeRange_t>, Errors_e> Query(uint64_t series, uint64_t start, uint64_t end) const {
+    if (start > end) {
+      return tl::unexpected(Errors_e::INVALID_TIME_RANGE);
+    }
+    const Shard_t& shard = GetShard(series);
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
+    auto found = shard.series.find(series);
+    if (found == shard.series.end()) {
+      return tl::unexpected(Errors_e::RANGE_NOT_IN_DB);
+    }
+    const Series_t& entry = found->second;
+    if (entry.tree != nullptr) {
+      return entry.tree->Query(start, end);
+    }
+    if (entry.small.empty() || start > entry.small.back().end || end < entry.small.front().start) {
+      return tl::unexpected(Errors_e::RANGE_NOT_IN_DB);
+    }
+    std::vector<TimeRange_t> res;
+    for (const TimeRange_t& range : entry.small) {
+      if (range.start > end) {
+        break;
+      }
+      if (range.end >= start) {
+        res.push_back(range);
+      }
+    }
+    return res;
+  }
+
+  /**
+   * @brief entries of all given series overlapping [start, end], merged into a single run ordered on start
+   *
+   * The series are queried in parallel on the pool of the set. Series that are unknown or hold nothing in the range
+   * add nothing to the result.
+   */
+  tl::expected<std::vector<TimeRange_t>, Errors_e>
+      QueryMany(std::span<const uint64_t> series, uint64_t start, uint64_t end) const {
+    if (start > end) {
+      return tl::unexpected(Errors_e::INVALID_TIME_RANGE);
+    }
+    std::vector<std::vector<TimeRange_t>> parts(series.size());
+    m_pool.ParallelFor(series.size(), [this, &parts, series, start, end](std::size_t i) {
+      auto res = Query(series[i], start, end);
+      if (res) {
+        parts[i] = std::move(*res);
+      }
+    });
+    return Merge(parts);
+  }
+
+  [[nodiscard]] std::size_t GetSeriesCount() const {
+    std::size_t count = 0;
+    for (const auto& shard : m_shards) {
+      std::shared_lock<std::shared_mutex> lock(shard->mutex);
+      count += shard->series.size();
+    }
+    return count;
+  }
+
+  // Number of series that outgrew their inline entries and are backed by a tree
+  [[nodiscard]] std::size_t GetTreeCount() const {
+    std::size_t count = 0;
+    for (const auto& shard : m_shards) {
+      std::shared_lock<std::shared_mutex> lock(shard->mutex);
+      count += shard->trees;
+    }
+    return count;
+  }
+
+  // Node pools and inline entries, the bookkeeping of the trees and the hash maps are not included
+  [[nodiscard]] std::size_t GetBytesHeld() const {
+    std::size_t bytes = 0;
+    for (const auto& shard : m_shards) {
+      // The node pool grows under the writer lock alone
+      std::lock_guard<std::mutex> writer(shard->writer);
+      std::shared_lock<std::shared_mutex> lock(shard->mutex);
+      bytes += shard->allocator.GetBytesHeld();
+      for (const auto& [id, entry] : shard->series) {
+        bytes += entry.small.capacity() * sizeof(TimeRange_t);
+      }
+    }
+    return bytes;
+  }
+
+private:
+  struct Series_t {
+    // Entries sorted on start until the series outgrows a leaf, empty afterwards
+    std::vector<TimeRange_t> small;
+    std::unique_ptr<Tree> tree;
+  };
+
+  struct Shard_t {
+    mutable std::shared_mutex mutex;
+    mutable std::mutex writer;
+    SlabAllocator<leafArity, innerArity> allocator;
+    EpochManager epochs;
+    std::unordered_map<uint64_t, Series_t> series;
+    std::size_t trees{0};
+  };
+
+  [[nodiscard]] Shard_t& GetShard(uint64_t series) const {
+    return *m_shards[std::hash<uint64_t>{}(series) % m_shards.size()];
+  }
+
+  /**
+   * @brief merges runs that are each ordered on start into one
+   *
+   * The runs are laid out back to back and merged pairwise, every round halves their number and writes into the other
+   * of two buffers. The merges of a round run in parallel.
+   */
+  std::vector<TimeRange_t> Merge(const std::vector<std::vector<TimeRange_t>>& parts) const {
+    std::vector<std::size_t> bounds{0};
+    for (const std::vector<TimeRange_t>& part : parts) {
+      if (!part.empty()) {
+        bounds.push_back(bounds.back() + part.size());
+      }
+    }
+    std::vector<TimeRange_t> runs;
+    runs.reserve(bounds.back());
+    for (const std::vector<TimeRange_t>& part : parts) {
+      runs.insert(runs.end(), part.begin(), part.end());
+    }
+
+    std::vector<TimeRange_t> merged(bounds.size() > 2 ? runs.size() : 0);
+    while (bounds.size() > 2) {
+      const std::size_t runCount = bounds.size() - 1;
+      m_pool.ParallelFor((runCount + 1) / 2, [&runs, &merged, &bounds, runCount](std::size_t pair) {
+        const std::size_t first = bounds[2 * pair];
+        const std::size_t middle = bounds[2 * pair + 1];
+        const std::size_t last = (2 * pair + 1 < runCount) ? bounds[2 * pair + 2] : middle;
+        auto out = std::next(merged.begin(), static_cast<std::ptrdiff_t>(first));
+        auto at = [&runs](std::size_t index) { return std::next(runs.begin(), static_cast<std::ptrdiff_t>(index)); };
+        std::merge(at(first), at(middle), at(middle), at(last), out, [](const TimeRange_t& a, const TimeRange_t& b) {
+          return a.start < b.start;
+        });
+      });
+      std::vector<std::size_t> next;
+      for (std::size_t i = 0; i < bounds.size(); i += 2) {
+        next.push_back(bounds[i]);
+      }
+      if (next.back() != bounds.back()) {
+        next.push_back(bounds.back());
+      }
+      bounds = std::move(next);
+      runs.swap(merged);
+    }
+    return runs;
+  }
+
+  std::vector<std::unique_ptr<Shard_t>> m_shards;
+  mutable ThreadPool m_pool;
+};
+
+#endif // TIMETREESET_H_
@@ -0,0 +1,296 @@
+#ifndef WRITEAHEADLOG_H_
+#define WRITEAHEADLOG_H_
+
+#include "TimeTree.hpp"
+
+#include <bit>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <limits>
+#include <string>
+#include <tl/expected.hpp>
+#include <tuple>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief append-only log of the operations applied to a tree
+ *
+ * Every Insert, Aggregate and DropBefore is appended as a fixed size, checksummed record carrying a sequence number.
+ * Records are buffered and written out together with a single fdatasync once enough records are pending or enough time
+ * has passed since the last commit, so the cost of the sync is shared by the whole group. Only committed records are
+ * durable, Sync() forces a commit. Recovery replays the log on top of the latest checkpoint, records already contained
+ * in the checkpoint are skipped by their sequence number and a torn record at the tail ends the replay.
+ */
+class WriteAheadLog {
+public:
+  enum RecordType_e : uint32_t { INSERT = 1, AGGREGATE = 2, DROP = 3 };
+
+  struct Record_t {
+    uint32_t type;
+    uint32_t checksum;
+    uint64_t sequence;
+    uint64_t start;
+    uint64_t end;
+    uint64_t ptr;
+    double value;
+  };
+
+  // A commit happens once either limit is reached
+  struct GroupCommit_t {
+    std::size_t records{1024};
+    std::chrono::microseconds interval{std::chrono::milliseconds(10)};
+  };
+
+  /**
+   * @brief opens or creates the log at path
+   *
+   * Existing records are kept, a torn record at the tail is cut off. New records continue after the newest sequence in
+   * the log or after sequence, whichever is larger. Pass the log sequence of the tree the log is applied to.
+   */
+  static tl::expected<WriteAheadLog, Errors_e>
+      Open(const std::string& path, GroupCommit_t commit, uint64_t sequence = 0) {
+    const int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+      return tl::unexpected(Errors_e::IO_ERROR);
+    }
+    WriteAheadLog log(fd, commit);
+
+    uint64_t valid = 0;
+    auto scanned = Scan(fd, [&sequence, &valid](const Record_t& record) {
+      sequence = std::max(sequence, record.sequence);
+      valid += sizeof(Record_t);
+    });
+    if (!scanned || ::ftruncate(fd, static_cast<off_t>(valid)) != 0) {
+      return tl::unexpected(Errors_e::IO_ERROR);
+    }
+    log.m_sequence = sequence;
+    log.m_durable = sequence;
+    return log;
+  }
+
+  WriteAheadLog(const WriteAheadLog&) = delete;
+  WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+  WriteAheadLog(WriteAheadLog&& other) noexcept
+  : m_fd(std::exchange(other.m_fd, -1))
+  , m_commit(other.m_commit)
+  , m_pending(std::move(other.m_pending))
+  , m_written(std::exchange(other.m_written, 0))
+  , m_lastCommit(other.m_lastCommit)
+  , m_sequence(other.m_sequence)
+  , m_durable(other.m_durable) {}
+
+  WriteAheadLog& operator=(WriteAheadLog&& other) noexcept {
+    std::swap(m_fd, other.m_fd);
+    std::swap(m_commit, other.m_commit);
+    std::swap(m_pending, other.m_pending);
+    std::swap(m_written, other.m_written);
+    std::swap(m_lastCommit, other.m_lastCommit);
+    std::swap(m_sequence, other.m_sequence);
+    std::swap(m_durable, other.m_durable);
+    return *this;
+  }
+
+  ~WriteAheadLog() {
+    if (m_fd >= 0) {
+      std::ignore = Sync();
+      ::close(m_fd);
+    }
+  }
+
+  // Returns the sequence number of the record, it is durable once GetDurableSequence() reaches it
+  tl::expected<uint64_t, Errors_e> LogInsert(uint64_t start, uint64_t end, uint64_t ptr, double value = 0.0) {
+    return Append(INSERT, start, end, ptr, value);
+  }
+
+  // The maximum level travels in the ptr field, the tree replayed into needs the same aggregation policy
+  tl::expected<uint64_t, Errors_e>
+      LogAggregate(uint64_t cutoff, std::size_t maxLevel = std::numeric_limits<uint8_t>::max()) {
+    return Append(AGGREGATE, cutoff, cutoff, maxLevel, 0.0);
+  }
+
+  // Replay discards the dropped entries, whatever storage they point to is expected to be gone already
+  tl::expected<uint64_t, Errors_e> LogDropBefore(uint64_t cutoff) {
+    return Append(DROP, cutoff, cutoff, 0, 0.0);
+  }
+
+  /**
+   * @brief writes out and syncs every pending record
+   *
+   * After a failed write the records that made it to the file are no longer pending, the next call continues right
+   * behind them, so no record is written twice.
+   */
+  tl::expected<void, Errors_e> Sync() {
+    m_lastCommit = std::chrono::steady_clock::now();
+    const auto* data = reinterpret_cast<const char*>(m_pending.data());
+    const std::size_t size = m_pending.size() * sizeof(Record_t);
+    while (m_written != size) {
+      const ssize_t written = ::write(m_fd, data + m_written, size - m_written);
+      if (written < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        DropWritten();
+        return tl::unexpected(Errors_e::IO_ERROR);
+      }
+      m_written += static_cast<std::size_t>(written);
+    }
+    DropWritten();
+    if (m_durable == m_sequence) {
+      return {};
+    }
+    if (::fdatasync(m_fd) != 0) {
+      return tl::unexpected(Errors_e::IO_ERROR);
+    }
+    m_durable = m_sequence;
+    return {};
+  }
+
+  /**
+   * @brief drops every record, once a checkpoint holding them has been written
+   *
+   * Sequence numbers keep counting up.
+   */
+  tl::expected<void, Errors_e> Truncate() {
+    auto synced = Sync();
+    if (!synced) {
+      return synced;
+    }
+    if (::ftruncate(m_fd, 0) != 0 || ::fdatasync(m_fd) != 0) {
+      return tl::unexpected(Errors_e::IO_ERROR);
+    }
+    return {};
+  }
+
+  [[nodiscard]] uint64_t GetSequence() const {
+    return m_sequence;
+  }
+
+  [[nodiscard]] uint64_t GetDurableSequence() const {
+    return m_durable;
+  }
+
+  /**
+   * @brief applies the records of the log at path that are newer than the log sequence of tree
+   *
+   * Returns the number of records applied, the log sequence of the tree is moved along with them.
+   */
+  template<typename Tree> static tl::expected<std::size_t, Errors_e> Replay(const std::string& path, Tree& tree) {
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      return tl::unexpected(Errors_e::IO_ERROR);
+    }
+    std::size_t applied = 0;
+    std::vector<TimeRange_t> removed;
+    auto scanned = Scan(fd, [&tree, &applied, &removed](const Record_t& record) {
+      if (record.sequence <= tree.GetLogSequence()) {
+        return;
+      }
+      if (record.type == INSERT) {
+        std::ignore = tree.Insert(record.start, record.end, record.ptr, record.value);
+      } else if (record.type == AGGREGATE) {
+        tree.Aggregate(record.start, removed, record.ptr);
+        removed.clear();
+      } else {
+        tree.DropBefore(record.start, [](const TimeRange_t&) {});
+      }
+      tree.SetLogSequence(record.sequence);
+      ++applied;
+    });
+    ::close(fd);
+    if (!scanned) {
+      return tl::unexpected(scanned.error());
+    }
+    return applied;
+  }
+
+private:
+  WriteAheadLog(int fd, GroupCommit_t commit)
+  : m_fd(fd)
+  , m_commit(commit)
+  , m_lastCommit(std::chrono::steady_clock::now()) {
+    m_pending.reserve(m_commit.records);
+  }
+
+  // Removes the records written out in full from the pending ones, the bytes written of the next one stay counted
+  void DropWritten() {
+    const std::size_t records = m_written / sizeof(Record_t);
+    m_pending.erase(m_pending.begin(), m_pending.begin() + static_cast<std::ptrdiff_t>(records));
+    m_written -= records * sizeof(Record_t);
+  }
+
+  // FNV-1a over every field but the checksum itself
+  static uint32_t Checksum(const Record_t& record) {
+    uint32_t hash = 2166136261U;
+    auto mix = [&hash](uint64_t value) {
+      for (std::size_t i = 0; i < sizeof(value); ++i) {
+        hash = (hash ^ static_cast<uint8_t>(value >> (8 * i))) * 16777619U;
+      }
+    };
+    mix(record.type);
+    mix(record.sequence);
+    mix(record.start);
+    mix(record.end);
+    mix(record.ptr);
+    mix(std::bit_cast<uint64_t>(record.value));
+    return hash;
+  }
+
+  // Calls visitor for every intact record from the start of the file, stopping at the first torn one
+  template<typename F> static tl::expected<void, Errors_e> Scan(int fd, F&& visitor) {
+    std::vector<Record_t> block(4096);
+    off_t offset = 0;
+    uint64_t previous = 0;
+    while (true) {
+      const ssize_t bytes = ::pread(fd, block.data(), block.size() * sizeof(Record_t), offset);
+      if (bytes < 0) {
+        return tl::unexpected(Errors_e::IO_ERROR);
+      }
+      const std::size_t count = static_cast<std::size_t>(bytes) / sizeof(Record_t);
+      for (std::size_t i = 0; i < count; ++i) {
+        const Record_t& record = block[i];
+        if (record.checksum != Checksum(record) || (record.type < INSERT || record.type > DROP)
+            || record.sequence <= previous) {
+          return {};
+        }
+        previous = record.sequence;
+        visitor(record);
+      }
+      if (count != block.size()) {
+        return {};
+      }
+      offset += bytes;
+    }
+  }
+
+  tl::expected<uint64_t, Errors_e>
+      Append(RecordType_e type, uint64_t start, uint64_t end, uint64_t ptr, double value) {
+    Record_t record{type, 0, ++m_sequence, start, end, ptr, value};
+    record.checksum = Checksum(record);
+    m_pending.push_back(record);
+    if (m_pending.size() >= m_commit.records || std::chrono::steady_clock::now() - m_lastCommit >= m_commit.interval) {
+      auto synced = Sync();
+      if (!synced) {
+        return tl::unexpected(synced.error());
+      }
+    }
+    return record.sequence;
+  }
+
+  int m_fd;
+  GroupCommit_t m_commit;
+  std::vector<Record_t> m_pending;
+  // Bytes of the first pending record that are already in the file
+  std::size_t m_written{0};
+  std::chrono::steady_clock::time_point m_lastCommit;
+  uint64_t m_sequence{0};
+  uint64_t m_durable{0};
+};
+
+#endif // WRITEAHEADLOG_H_
@@ -1,11 +1,32 @@
 #include <cstdint>
 #define ANKERL_NANOBENCH_IMPLEMENT
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "src/MappedTimeTree.hpp"
+#include "src/ThreadPool.hpp"
 #include "src/TimeTree.hpp"
+#include "src/TimeTreeSet.hpp"
+#include "src/WriteAheadLog.hpp"
 
+#include <atomic>
+#include <chrono>
 #include <doctest.h>
+#include <filesystem>
+#include <fstream>
 #include <list>
+#include <string>
+#include <thread>
+#include <vector>
 #include <nanobench.h>
+#include <unistd.h>
+
+// Resident set size of the process, as reported by /proc
+static std::size_t ResidentBytes() {
+  std::ifstream statm("/proc/self/statm");
+  std::size_t pages = 0;
+  std::size_t resident = 0;
+  statm >> pages >> resident;
+  return resident * static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+}
 
 #define GEN_INSERT_TEST(SIZE)                                                                                          \
   SUBCASE("Arity of " #SIZE) {                                                                                         \
@@ -21,6 +42,25 @@
         });                                                                                                            \
   };
 
+#define GEN_ALLOC_INSERT_TEST(SIZE)                                                                                    \
+  SUBCASE("Arity of " #SIZE) {                                                                                         \
+    ankerl::nanobench::Bench bench;                                                                                    \
+    bench.title("Allocators, arity of " #SIZE).unit("Insert").relative(true);                                          \
+    bench.minEpochIterations(1000000).performanceCounters(true);                                                       \
+    TimeTree<SIZE, SIZE, SimpleAllocator<SIZE>> simpleTree;                                                            \
+    uint64_t simpleTs = 1;                                                                                             \
+    bench.run("Arity: " #SIZE " SimpleAllocator insertion", [&] {                                                      \
+      simpleTree.Insert(simpleTs, simpleTs, 0);                                                                        \
+      ++simpleTs;                                                                                                      \
+    });                                                                                                                \
+    TimeTree<SIZE, SIZE, SlabAllocator<SIZE>> slabTree;                                                                \
+    uint64_t slabTs = 1;                                                                                               \
+    bench.run("Arity: " #SIZE " SlabAllocator insertion", [&] {                                                        \
+      slabTree.Insert(slabTs, slabTs, 0);                                                                              \
+      ++slabTs;                                                                                                        \
+    });                                                                                                                \
+  };
+
 #define GEN_QUERY_TEST(SIZE)                                                                                           \
   SUBCASE("Arity of " #SIZE) {                                                                                         \
     std::ofstream output("QueryArity" #SIZE);                                                                          \
@@ -57,6 +97,22 @@
       auto res = tree.Query(100'000, 200'000);                                                                         \
       ankerl::nanobench::doNotOptimizeAway(res);                                                                       \
     });                                                                                                                \
+    bench.run("Arity: " #SIZE " last 1k", [&] {                                                                        \
+      auto res = tree.Query(999'000, 1'000'000);                                                                       \
+      ankerl::nanobench::doNotOptimizeAway(res);                                                                       \
+    });                                                                                                                \
+    bench.run("Arity: " #SIZE " last 10k", [&] {                                                                       \
+      auto res = tree.Query(990'000, 1'000'000);                                                                       \
+      ankerl::nanobench::doNotOptimizeAway(res);                                                                       \
+    });                                                                                                                \
+    bench.run("Arity: " #SIZE " latest 1k", [&] {                                                                      \
+      auto res = tree.QueryLatest(1'000);                                                                              \
+      ankerl::nanobench::doNotOptimizeAway(res);                                                                       \
+    });                                                                                                                \
+    bench.run("Arity: " #SIZE " latest 1k before 500k", [&] {                                                          \
+      auto res = tree.QueryLatest(1'000, 500'000);                                                                     \
+      ankerl::nanobench::doNotOptimizeAway(res);                                                                       \
+    });                                                                                                                \
     bench                                                                                                              \
         .run(                                                                                                          \
             "Arity: " #SIZE " lookup 1M",                                                                              \
@@ -67,6 +123,606 @@
         .render(ankerl::nanobench::templates::csv(), output);                                                          \
   };
 
+#define GEN_MEMORY_TEST(LEAF, INNER)                                                                                   \
+  SUBCASE("Leaf arity " #LEAF ", inner arity " #INNER) {                                                               \
+    TimeTree<LEAF, INNER> tree;                                                                                        \
+    for (uint64_t ts = 1; ts <= 1'000'000; ++ts) {                                                                     \
+      tree.Insert(ts, ts, 0);                                                                                          \
+    }                                                                                                                  \
+    fmt::print(                                                                                                        \
+        "Leaf arity: {:>3} inner arity: {:>3} -> {:>10} bytes per 1M entries (leaf {} B, inner {} B)\n",               \
+        LEAF,                                                                                                          \
+        INNER,                                                                                                         \
+        tree.GetAllocator().GetBytesHeld(),                                                                            \
+        sizeof(LeafNode<LEAF, INNER>),                                                                                 \
+        sizeof(InnerNode<LEAF, INNER>));                                                                               \
+  };
+
+#define GEN_RETENTION_TEST(ALLOCATOR, SIZE)                                                                            \
+  SUBCASE(#ALLOCATOR ", arity of " #SIZE) {                                                                            \
+    TimeTree<SIZE, SIZE, ALLOCATOR<SIZE>> tree;                                                                        \
+    std::vector<TimeRange_t> removed;                                                                                  \
+    uint64_t ts = 1;                                                                                                   \
+    const double baseline = static_cast<double>(ResidentBytes());                                                      \
+    for (int round = 1; round <= 30; ++round) {                                                                        \
+      const auto started = std::chrono::steady_clock::now();                                                           \
+      for (int i = 0; i < 1'000'000; ++i, ++ts) {                                                                      \
+        tree.Insert(ts, ts, ts, static_cast<double>(ts % 1'000));                                                      \
+      }                                                                                                                \
+      for (std::size_t level = 0; level < tree.GetHeight(); ++level) {                                                 \
+        tree.Aggregate(ts - 1'000'000, removed);                                                                       \
+      }                                                                                                                \
+      removed.clear();                                                                                                 \
+      const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - started;            \
+      fmt::print(                                                                                                      \
+          "{} arity: {:>3} round {:>2}: {:>7.1f} MB resident, {:>7.1f} MB held, {:>5.0f} ms\n",                        \
+          #ALLOCATOR,                                                                                                  \
+          SIZE,                                                                                                        \
+          round,                                                                                                       \
+          (static_cast<double>(ResidentBytes()) - baseline) / 1e6,                                                     \
+          static_cast<double>(tree.GetAllocator().GetBytesHeld()) / 1e6,                                               \
+          elapsed.count());                                                                                            \
+    }                                                                                                                  \
+  };
+
+#define GEN_DROP_TEST(SIZE, HISTORY)                                                                                   \
+  SUBCASE("Arity of " #SIZE ", history of " #HISTORY) {                                                                \
+    ankerl::nanobench::Bench bench;                                                                                    \
+    bench.title("Rolling hard retention, arity of " #SIZE).unit("Insert").batch(1'000);                                \
+    bench.minEpochIterations(100);                                                                                     \
+    TimeTree<SIZE> tree;                                                                                               \
+    uint64_t ts = 1;                                                                                                   \
+    for (; ts <= (HISTORY); ++ts) {                                                                                    \
+      tree.Insert(ts, ts, ts);                                                                                         \
+    }                                                                                                                  \
+    std::size_t dropped = 0;                                                                                           \
+    bench.run("History: " #HISTORY " Insert and DropBefore", [&] {                                                     \
+      for (int i = 0; i < 1'000; ++i, ++ts) {                                                                          \
+        tree.Insert(ts, ts, ts);                                                                                       \
+      }                                                                                                                \
+      tree.DropBefore(ts - (HISTORY), [&dropped](const TimeRange_t&) { ++dropped; });                                  \
+    });                                                                                                                \
+    ankerl::nanobench::doNotOptimizeAway(dropped);                                                                     \
+  };
+
+#define GEN_BATCH_INSERT_TEST(SIZE)                                                                                    \
+  SUBCASE("Arity of " #SIZE) {                                                                                         \
+    ankerl::nanobench::Bench bench;                                                                                    \
+    bench.title("Batched insertion, arity of " #SIZE).unit("Insert").batch(4096).relative(true);                       \
+    bench.minEpochIterations(100).performanceCounters(true);                                                           \
+    std::vector<TimeRange_t> block(4096);                                                                              \
+    TimeTree<SIZE> loopTree;                                                                                           \
+    uint64_t loopTs = 1;                                                                                               \
+    bench.run("Arity: " #SIZE " Insert loop", [&] {                                                                    \
+      for (TimeRange_t& range : block) {                                                                               \
+        range = {loopTs, loopTs, 0};                                                                                   \
+        ++loopTs;                                                                                                      \
+      }                                                                                                                \
+      for (const TimeRange_t& range : block) {                                                                         \
+        loopTree.Insert(range.start, range.end, range.ptr);                                                            \
+      }                                                                                                                \
+    });                                                                                                                \
+    TimeTree<SIZE> batchTree;                                                                                          \
+    uint64_t batchTs = 1;                                                                                              \
+    bench.run("Arity: " #SIZE " InsertBatch", [&] {                                                                    \
+      for (TimeRange_t& range : block) {                                                                               \
+        range = {batchTs, batchTs, 0};                                                                                 \
+        ++batchTs;                                                                                                     \
+      }                                                                                                                \
+      auto res = batchTree.InsertBatch(block);                                                                         \
+      ankerl::nanobench::doNotOptimizeAway(res);                                                                       \
+    });                                                                                                                \
+  };
+
+#define GEN_LATE_INSERT_TEST(SIZE)                                                                                     \
+  SUBCASE("Arity of " #SIZE) {                                                                                         \
+    ankerl::nanobench::Bench bench;                                                                                    \
+    bench.title("Late insertion, arity of " #SIZE).unit("Insert").batch(4096).relative(true);                          \
+    bench.minEpochIterations(100).performanceCounters(true);                                                           \
+    for (uint64_t rate : {0, 1, 10}) {                                                                                 \
+      TimeTree<SIZE> tree;                                                                                             \
+      uint64_t ts = 1'000;                                                                                             \
+      uint64_t counter = 0;                                                                                            \
+      bench.run("Arity: " #SIZE " " + std::to_string(rate) + "% late", [&] {                                           \
+        for (std::size_t i = 0; i < 4096; ++i) {                                                                       \
+          /* Late entries lag a few leafs behind the newest one */                                                     \
+          const uint64_t start = (rate != 0 && (++counter * rate) % 100 < rate) ? ts - 4 * SIZE : ts;                  \
+          tree.Insert(start, start, 0);                                                                                \
+          ++ts;                                                                                                        \
+        }                                                                                                              \
+      });                                                                                                              \
+    }                                                                                                                  \
+  };
+
+#define GEN_BULK_LOAD_TEST(SIZE, ENTRIES)                                                                              \
+  SUBCASE("Arity of " #SIZE ", " #ENTRIES " entries") {                                                                \
+    ankerl::nanobench::Bench bench;                                                                                    \
+    bench.title("Bulk load, arity of " #SIZE).unit("Entry").batch(ENTRIES).relative(true);                             \
+    bench.epochs(1).epochIterations(1).performanceCounters(true);                                                      \
+    std::vector<TimeRange_t> ranges;                                                                                   \
+    ranges.reserve(ENTRIES);                                                                                           \
+    for (uint64_t ts = 1; ts <= (ENTRIES); ++ts) {                                                                     \
+      ranges.push_back({ts, ts, ts});                                                                                  \
+    }                                                                                                                  \
+    bench.run("Arity: " #SIZE " " #ENTRIES " sequential Insert", [&] {                                                 \
+      TimeTree<SIZE> tree;                                                                                             \
+      for (const TimeRange_t& range : ranges) {                                                                        \
+        tree.Insert(range.start, range.end, range.ptr);                                                                \
+      }                                                                                                                \
+      ankerl::nanobench::doNotOptimizeAway(tree);                                                                      \
+    });                                                                                                                \
+    bench.run("Arity: " #SIZE " " #ENTRIES " BulkLoad", [&] {                                                          \
+      auto tree = TimeTree<SIZE>::BulkLoad(ranges);                                                                    \
+      ankerl::nanobench::doNotOptimizeAway(tree);                                                                      \
+    });                                                                                                                \
+    bench.run("Arity: " #SIZE " " #ENTRIES " parallel BulkLoad", [&] {                                                 \
+      auto tree = TimeTree<SIZE>::BulkLoad(ranges, std::thread::hardware_concurrency());                               \
+      ankerl::nanobench::doNotOptimizeAway(tree);                                                                      \
+    });                                                                                                                \
+  };
+
+#define GEN_CHECKPOINT_TEST(SIZE, ENTRIES)                                                                             \
+  SUBCASE("Arity of " #SIZE ", " #ENTRIES " entries") {                                                                \
+    ankerl::nanobench::Bench bench;                                                                                    \
+    bench.title("Checkpoint, arity of " #SIZE).unit("Entry").batch(ENTRIES).relative(true);                            \
+    bench.epochs(1).epochIterations(1).performanceCounters(true);                                                      \
+    const std::string path = (std::filesystem::temp_directory_path() / "timetree-bench-" #SIZE).string();              \
+    std::vector<TimeRange_t> ranges;                                                                                   \
+    ranges.reserve(ENTRIES);                                                                                           \
+    for (uint64_t ts = 1; ts <= (ENTRIES); ++ts) {                                                                     \
+      ranges.push_back({ts, ts, ts});                                                                                  \
+    }                                                                                                                  \
+    auto tree = TimeTree<SIZE>::BulkLoad(ranges, std::thread::hardware_concurrency());                                 \
+    ranges = {};                                                                                                       \
+    bench.run("Arity: " #SIZE " " #ENTRIES " Save", [&] {                                                              \
+      auto res = tree->Save(path);                                                                                     \
+      ankerl::nanobench::doNotOptimizeAway(res);                                                                       \
+    });                                                                                                                \
+    bench.run("Arity: " #SIZE " " #ENTRIES " Load", [&] {                                                              \
+      auto loaded = TimeTree<SIZE>::Load(path);                                                                        \
+      ankerl::nanobench::doNotOptimizeAway(loaded);                                                                    \
+    });                                                                                                                \
+    bench.run("Arity: " #SIZE " " #ENTRIES " parallel Load", [&] {                                                     \
+      auto loaded = TimeTree<SIZE>::Load(path, std::thread::hardware_concurrency());                                   \
+      ankerl::nanobench::doNotOptimizeAway(loaded);                                                                    \
+    });                                                                                                                \
+    std::filesystem::remove(path);                                                                                     \
+  };
+
+#define GEN_STREAMING_QUERY_TEST(SIZE)                                                                                 \
+  SUBCASE("Arity of " #SIZE) {                                                                                         \
+    ankerl::nanobench::Bench bench;                                                                                    \
+    bench.title("Streaming queries, arity of " #SIZE).unit("Query").relative(true);                                    \
+    bench.performanceCounters(true);                                                                                   \
+    TimeTree<SIZE> tree;                                                                                               \
+    for (uint64_t ts = 1; ts != 1'000'000; ++ts) {                                                                     \
+      tree.Insert(ts, ts, ts);                                                                                         \
+    }                                                                                                                  \
+    bench.run("Arity: " #SIZE " Query 1M", [&] {                                                                       \
+      auto res = tree.Query(1, 1'000'000);                                                                             \
+      ankerl::nanobench::doNotOptimizeAway(res);                                                                       \
+    });                                                                                                                \
+    bench.run("Arity: " #SIZE " QueryVisit 1M", [&] {                                                                  \
+      uint64_t sum = 0;                                                                                                \
+      auto res = tree.QueryVisit(1, 1'000'000, [&sum](const TimeRange_t& range) { sum += range.ptr; });                \
+      ankerl::nanobench::doNotOptimizeAway(res);                                                                       \
+      ankerl::nanobench::doNotOptimizeAway(sum);                                                                       \
+    });                                                                                                                \
+    bench.run("Arity: " #SIZE " QueryRange 1M", [&] {                                                                  \
+      uint64_t sum = 0;                                                                                                \
+      auto range = tree.QueryRange(1, 1'000'000);                                                                      \
+      for (const TimeRange_t entry : *range) {                                                                         \
+        sum += entry.ptr;                                                                                              \
+      }                                                                                                                \
+      ankerl::nanobench::doNotOptimizeAway(sum);                                                                       \
+    });                                                                                                                \
+  };
+
+#define GEN_MAPPED_QUERY_TEST(SIZE)                                                                                    \
+  SUBCASE("Arity of " #SIZE) {                                                                                         \
+    ankerl::nanobench::Bench bench;                                                                                    \
+    bench.title("Mapped queries, arity of " #SIZE).unit("Query").relative(true);                                       \
+    bench.performanceCounters(true);                                                                                   \
+    const std::string path = (std::filesystem::temp_directory_path() / "timetree-mapped-" #SIZE).string();             \
+    TimeTree<SIZE> tree;                                                                                               \
+    for (uint64_t ts = 1; ts != 10'000'000; ++ts) {                                                                    \
+      tree.Insert(ts, ts, ts);                                                                                         \
+    }                                                                                                                  \
+    REQUIRE(tree.Save(path).has_value());                                                                              \
+    ankerl::nanobench::Rng rng(42);                                                                                    \
+    bench.run("Arity: " #SIZE " TimeTree 1K window", [&] {                                                             \
+      const uint64_t start = rng.bounded(9'999'000) + 1;                                                               \
+      uint64_t sum = 0;                                                                                                \
+      auto res = tree.QueryVisit(start, start + 1'000, [&sum](const TimeRange_t& range) { sum += range.ptr; });        \
+      ankerl::nanobench::doNotOptimizeAway(res);                                                                       \
+      ankerl::nanobench::doNotOptimizeAway(sum);                                                                       \
+    });                                                                                                                \
+    auto mapped = MappedTimeTree<SIZE>::Open(path);                                                                    \
+    bench.run("Arity: " #SIZE " MappedTimeTree 1K window", [&] {                                                       \
+      const uint64_t start = rng.bounded(9'999'000) + 1;                                                               \
+      uint64_t sum = 0;                                                                                                \
+      auto res = mapped->QueryVisit(start, start + 1'000, [&sum](const TimeRange_t& range) { sum += range.ptr; });     \
+      ankerl::nanobench::doNotOptimizeAway(res);                                                                       \
+      ankerl::nanobench::doNotOptimizeAway(sum);                                                                       \
+    });                                                                                                                \
+    bench.run("Arity: " #SIZE " Open", [&] {                                                                           \
+      auto opened = MappedTimeTree<SIZE>::Open(path);                                                                  \
+      ankerl::nanobench::doNotOptimizeAway(opened);                                                                    \
+    });                                                                                                                \
+    std::filesystem::remove(path);                                                                                     \
+  };
+
+#define GEN_WAL_INSERT_TEST(RECORDS, INTERVAL_MS)                                                                      \
+  SUBCASE("Commit every " #RECORDS " records or " #INTERVAL_MS "ms") {                                                 \
+    ankerl::nanobench::Bench bench;                                                                                    \
+    bench.title("Durable insertion, arity of 64").unit("Insert").batch(4096).relative(true);                           \
+    bench.minEpochIterations(10).performanceCounters(true);                                                            \
+    const std::string path = (std::filesystem::temp_directory_path() / "timetree-bench-wal").string();                 \
+    std::filesystem::remove(path);                                                                                     \
+    auto log = WriteAheadLog::Open(path, {RECORDS, std::chrono::milliseconds(INTERVAL_MS)});                           \
+    TimeTree<64> tree;                                                                                                 \
+    uint64_t ts = 1;                                                                                                   \
+    bench.run("Commit every " #RECORDS " records or " #INTERVAL_MS "ms", [&] {                                         \
+      for (std::size_t i = 0; i < 4096; ++i) {                                                                         \
+        log->LogInsert(ts, ts, 0);                                                                                     \
+        tree.Insert(ts, ts, 0);                                                                                        \
+        ++ts;                                                                                                          \
+      }                                                                                                                \
+    });                                                                                                                \
+    std::filesystem::remove(path);                                                                                     \
+  };
+
+#define GEN_CONCURRENT_QUERY_TEST(READERS)                                                                             \
+  SUBCASE(#READERS " readers") {                                                                                       \
+    ankerl::nanobench::Bench bench;                                                                                    \
+    bench.title("Insertion with concurrent readers, arity of 64").unit("Insert").batch(4096).relative(true);           \
+    bench.minEpochIterations(10).performanceCounters(true);                                                            \
+    TimeTree<64> tree;                                                                                                 \
+    uint64_t ts = 1;                                                                                                   \
+    for (; ts != 1'000'000; ++ts) {                                                                                    \
+      tree.Insert(ts, ts, ts);                                                                                         \
+    }                                                                                                                  \
+    std::atomic<bool> done{false};                                                                                     \
+    std::atomic<uint64_t> queries{0};                                                                                  \
+    std::vector<std::thread> readers;                                                                                  \
+    for (uint64_t r = 0; r != READERS; ++r) {                                                                          \
+      readers.emplace_back([&tree, &done, &queries, r]() {                                                             \
+        ankerl::nanobench::Rng rng(r + 1);                                                                             \
+        uint64_t count = 0;                                                                                            \
+        uint64_t sum = 0;                                                                                              \
+        while (!done.load(std::memory_order_relaxed)) {                                                                \
+          const uint64_t start = rng.bounded(1'000'000);                                                               \
+          auto visit = [&sum](const TimeRange_t& range) { sum += range.ptr; };                                         \
+          std::ignore = tree.QueryVisit(start, start + 1'000, visit);                                                  \
+          ++count;                                                                                                     \
+        }                                                                                                              \
+        ankerl::nanobench::doNotOptimizeAway(sum);                                                                     \
+        queries += count;                                                                                              \
+      });                                                                                                              \
+    }                                                                                                                  \
+    const auto started = std::chrono::steady_clock::now();                                                             \
+    bench.run(#READERS " readers", [&] {                                                                               \
+      for (std::size_t i = 0; i < 4096; ++i) {                                                                         \
+        tree.Insert(ts, ts, ts);                                                                                       \
+        ++ts;                                                                                                          \
+      }                                                                                                                \
+    });                                                                                                                \
+    done = true;                                                                                                       \
+    for (std::thread& reader : readers) {                                                                              \
+      reader.join();                                                                                                   \
+    }                                                                                                                  \
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - started;                          \
+    fmt::print("{} readers: {:.0f} queries/s\n", READERS, static_cast<double>(queries.load()) / elapsed.count());      \
+  };
+
+#define GEN_TREE_SET_QUERY_TEST(THREADS)                                                                               \
+  SUBCASE(#THREADS " threads") {                                                                                       \
+    ankerl::nanobench::Bench bench;                                                                                    \
+    bench.title("Fan-out query over 2000 series, arity of 64").unit("Query").relative(true);                           \
+    bench.performanceCounters(true);                                                                                   \
+    TimeTreeSet<64> set(THREADS, THREADS);                                                                             \
+    std::vector<uint64_t> ids;                                                                                         \
+    for (uint64_t series = 0; series != 100'000; ++series) {                                                           \
+      /* Most series hold a handful of points, every hundredth a few thousand */                                       \
+      const uint64_t points = (series % 100 == 0) ? 5'000 : 4;                                                         \
+      for (uint64_t ts = 1; ts <= points; ++ts) {                                                                      \
+        set.Insert(series, ts * 10, ts * 10 + 5, ts);                                                                  \
+      }                                                                                                                \
+      if (series % 100 <= 1) {                                                                                         \
+        ids.push_back(series);                                                                                         \
+      }                                                                                                                \
+    }                                                                                                                  \
+    const std::size_t seriesCount = set.GetSeriesCount();                                                              \
+    fmt::print("{} series, {} bytes held per series\n", seriesCount, set.GetBytesHeld() / seriesCount);                \
+    bench.run(#THREADS " threads", [&] {                                                                               \
+      auto res = set.QueryMany(ids, 10'000, 20'000);                                                                   \
+      ankerl::nanobench::doNotOptimizeAway(res);                                                                       \
+    });                                                                                                                \
+  };
+
+#define GEN_SIMD_QUERY_TEST(SIZE)                                                                                      \
+  SUBCASE("Arity of " #SIZE) {                                                                                         \
+    ankerl::nanobench::Bench bench;                                                                                    \
+    bench.title("Key search, arity of " #SIZE).unit("Query").relative(true);                                           \
+    bench.performanceCounters(true);                                                                                   \
+    TimeTree<SIZE> tree;                                                                                               \
+    for (uint64_t ts = 1; ts != 1'000'000; ++ts) {                                                                     \
+      tree.Insert(ts, ts, 0);                                                                                          \
+    }                                                                                                                  \
+    const simd::Kernel_e best = simd::GetKernel();                                                                     \
+    for (simd::Kernel_e kernel : {simd::SCALAR, best}) {                                                               \
+      simd::SetKernel(kernel);                                                                                         \
+      const std::string path = (kernel == simd::SCALAR) ? " scalar" : " simd";                                         \
+      bench.run("Arity: " #SIZE " lookup 10" + path, [&] {                                                             \
+        auto res = tree.Query(10, 20);                                                                                 \
+        ankerl::nanobench::doNotOptimizeAway(res);                                                                     \
+      });                                                                                                              \
+      bench.run("Arity: " #SIZE " lookup 1k" + path, [&] {                                                             \
+        auto res = tree.Query(500'000, 501'000);                                                                       \
+        ankerl::nanobench::doNotOptimizeAway(res);                                                                     \
+      });                                                                                                              \
+      bench.run("Arity: " #SIZE " lookup 100k" + path, [&] {                                                           \
+        auto res = tree.Query(100'000, 200'000);                                                                       \
+        ankerl::nanobench::doNotOptimizeAway(res);                                                                     \
+      });                                                                                                              \
+    }                                                                                                                  \
+    simd::SetKernel(best);                                                                                             \
+  };
+
+#define GEN_AGGREGATE_QUERY_TEST(SIZE)                                                                                 \
+  SUBCASE("Arity of " #SIZE) {                                                                                         \
+    ankerl::nanobench::Bench bench;                                                                                    \
+    bench.title("Range aggregates, arity of " #SIZE).unit("Query").relative(true);                                     \
+    bench.performanceCounters(true);                                                                                   \
+    TimeTree<SIZE> tree;                                                                                               \
+    for (uint64_t ts = 1; ts != 1'000'000; ++ts) {                                                                     \
+      tree.Insert(ts, ts, ts, static_cast<double>(ts % 1'000));                                                        \
+    }                                                                                                                  \
+    ankerl::nanobench::Rng rng(42);                                                                                    \
+    for (uint64_t window : {1'000, 100'000}) {                                                                         \
+      const std::string name = fmt::format("Arity: {} {} window", SIZE, window);                                       \
+      bench.run(name + " scan over Query", [&] {                                                                       \
+        const uint64_t start = rng.bounded(1'000'000 - window) + 1;                                                    \
+        Summary_t summary;                                                                                             \
+        auto res = tree.QueryVisit(start, start + window, [&summary](const TimeRange_t& range) {                       \
+          summary.Add(range.value);                                                                                    \
+        });                                                                                                            \
+        ankerl::nanobench::doNotOptimizeAway(res);                                                                     \
+        ankerl::nanobench::doNotOptimizeAway(summary);                                                                 \
+      });                                                                                                              \
+      bench.run(name + " AggregateQuery", [&] {                                                                        \
+        const uint64_t start = rng.bounded(1'000'000 - window) + 1;                                                    \
+        auto res = tree.AggregateQuery(start, start + window);                                                         \
+        ankerl::nanobench::doNotOptimizeAway(res);                                                                     \
+      });                                                                                                              \
+    }                                                                                                                  \
+  };
+
+#define GEN_COMPRESSED_QUERY_TEST(SIZE)                                                                                \
+  SUBCASE("Arity of " #SIZE) {                                                                                         \
+    ankerl::nanobench::Bench bench;                                                                                    \
+    bench.title("Compressed leafs, arity of " #SIZE).unit("Query").relative(true);                                     \
+    bench.performanceCounters(true);                                                                                   \
+    TimeTree<SIZE> plain;                                                                                              \
+    TimeTree<SIZE> compressed;                                                                                         \
+    compressed.SetLeafCompression(true);                                                                               \
+    for (uint64_t i = 1; i != 1'000'000; ++i) {                                                                        \
+      plain.Insert(i * 15, i * 15 + 10, i * 4'096, static_cast<double>(i % 1'000));                                    \
+      compressed.Insert(i * 15, i * 15 + 10, i * 4'096, static_cast<double>(i % 1'000));                               \
+    }                                                                                                                  \
+    fmt::print(                                                                                                        \
+        "Arity: {:>3} {:>7.1f} MB plain, {:>7.1f} MB compressed\n",                                                    \
+        SIZE,                                                                                                          \
+        static_cast<double>(plain.GetAllocator().GetBytesHeld()) / 1e6,                                                \
+        static_cast<double>(compressed.GetAllocator().GetBytesHeld()) / 1e6);                                          \
+    ankerl::nanobench::Rng rng(42);                                                                                    \
+    for (uint64_t window : {100, 10'000}) {                                                                            \
+      const std::string name = fmt::format("Arity: {} {} entries", SIZE, window);                                      \
+      for (auto* tree : {&plain, &compressed}) {                                                                       \
+        bench.run(name + (tree == &plain ? " plain" : " compressed"), [&] {                                            \
+          const uint64_t start = (rng.bounded(1'000'000 - window) + 1) * 15;                                           \
+          std::size_t count = 0;                                                                                       \
+          auto res = tree->QueryVisit(start, start + window * 15, [&count](const TimeRange_t&) { ++count; });          \
+          ankerl::nanobench::doNotOptimizeAway(res);                                                                   \
+          ankerl::nanobench::doNotOptimizeAway(count);                                                                 \
+        });                                                                                                            \
+      }                                                                                                                \
+    }                                                                                                                  \
+  };
+
+// Cold lookups rewrite a buffer larger than the last level cache before every query
+#define GEN_SEALED_LOOKUP_TEST(SIZE, ENTRIES)                                                                          \
+  SUBCASE("Arity of " #SIZE ", " #ENTRIES " entries") {                                                                \
+    ankerl::nanobench::Bench bench;                                                                                    \
+    bench.title("Sealed lookups, arity of " #SIZE ", " #ENTRIES " entries").unit("Query").relative(true);              \
+    bench.minEpochIterations(100'000).performanceCounters(true);                                                       \
+    std::vector<TimeRange_t> ranges;                                                                                   \
+    ranges.reserve(ENTRIES);                                                                                           \
+    for (uint64_t i = 1; i <= (ENTRIES); ++i) {                                                                        \
+      ranges.push_back({i * 10, i * 10 + 5, i});                                                                       \
+    }                                                                                                                  \
+    auto tree = *TimeTree<SIZE>::BulkLoad(ranges);                                                                     \
+    ranges = {};                                                                                                       \
+    auto lookup = [&tree](uint64_t start) {                                                                            \
+      std::size_t count = 0;                                                                                           \
+      auto res = tree.QueryVisit(start, start, [&count](const TimeRange_t&) { ++count; });                             \
+      ankerl::nanobench::doNotOptimizeAway(res);                                                                       \
+      return count;                                                                                                    \
+    };                                                                                                                 \
+    ankerl::nanobench::Rng rng(42);                                                                                    \
+    std::array<uint64_t, 64> hot{};                                                                                    \
+    for (uint64_t& start : hot) {                                                                                      \
+      start = (rng.bounded(ENTRIES) + 1) * 10;                                                                         \
+    }                                                                                                                  \
+    std::vector<uint64_t> evict(std::size_t{64} << 20);                                                                \
+    auto measure = [&](const std::string& name) {                                                                      \
+      std::size_t next = 0;                                                                                            \
+      bench.run(name + " hot", [&] { ankerl::nanobench::doNotOptimizeAway(lookup(hot[next++ % hot.size()])); });       \
+      bench.run(name + " random", [&] {                                                                                \
+        ankerl::nanobench::doNotOptimizeAway(lookup((rng.bounded(ENTRIES) + 1) * 10));                                 \
+      });                                                                                                              \
+      std::vector<double> samples;                                                                                     \
+      for (int i = 0; i < 50; ++i) {                                                                                   \
+        for (uint64_t& word : evict) {                                                                                 \
+          word += 1;                                                                                                   \
+        }                                                                                                              \
+        const uint64_t start = (rng.bounded(ENTRIES) + 1) * 10;                                                        \
+        const auto started = std::chrono::steady_clock::now();                                                         \
+        ankerl::nanobench::doNotOptimizeAway(lookup(start));                                                           \
+        const std::chrono::duration<double, std::nano> took = std::chrono::steady_clock::now() - started;              \
+        samples.push_back(took.count());                                                                               \
+      }                                                                                                                \
+      std::nth_element(samples.begin(), std::next(samples.begin(), 25), samples.end());                                \
+      fmt::print("{} cold: {:>7.0f} ns median\n", name, samples[25]);                                                  \
+    };                                                                                                                 \
+    measure(fmt::format("Arity: {} {} entries pointer tree", SIZE, ENTRIES));                                          \
+    const auto started = std::chrono::steady_clock::now();                                                             \
+    tree.Seal();                                                                                                       \
+    const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - started;              \
+    fmt::print("Arity: {} sealed {} nodes in {:.1f} ms\n", SIZE, tree.GetSealedCount(), elapsed.count());              \
+    measure(fmt::format("Arity: {} {} entries sealed", SIZE, ENTRIES));                                                \
+  };
+
+#define GEN_REGULAR_LOOKUP_TEST(SIZE, ENTRIES)                                                                         \
+  SUBCASE("Arity of " #SIZE ", " #ENTRIES " entries") {                                                                \
+    ankerl::nanobench::Bench bench;                                                                                    \
+    bench.title("Regular series lookups, arity of " #SIZE ", " #ENTRIES " entries").unit("Query").relative(true);      \
+    bench.minEpochIterations(100'000).performanceCounters(true);                                                       \
+    std::vector<TimeRange_t> regular;                                                                                  \
+    std::vector<TimeRange_t> jittered;                                                                                 \
+    regular.reserve(ENTRIES);                                                                                          \
+    jittered.reserve(ENTRIES);                                                                                         \
+    for (uint64_t i = 1; i <= (ENTRIES); ++i) {                                                                        \
+      regular.push_back({i * 10, i * 10 + 5, i});                                                                      \
+      jittered.push_back({i * 10 + i % 3, i * 10 + 5, i});                                                             \
+    }                                                                                                                  \
+    auto regularTree = *TimeTree<SIZE>::BulkLoad(regular);                                                             \
+    auto jitteredTree = *TimeTree<SIZE>::BulkLoad(jittered);                                                           \
+    regular = {};                                                                                                      \
+    jittered = {};                                                                                                     \
+    ankerl::nanobench::Rng rng(42);                                                                                    \
+    auto lookup = [&rng](const TimeTree<SIZE>& tree) {                                                                 \
+      const uint64_t start = (rng.bounded(ENTRIES) + 1) * 10;                                                          \
+      std::size_t count = 0;                                                                                           \
+      auto res = tree.QueryVisit(start, start, [&count](const TimeRange_t&) { ++count; });                             \
+      ankerl::nanobench::doNotOptimizeAway(res);                                                                       \
+      ankerl::nanobench::doNotOptimizeAway(count);                                                                     \
+    };                                                                                                                 \
+    const std::string name = fmt::format("Arity: {} {} entries", SIZE, ENTRIES);                                       \
+    bench.run(name + " pointer tree", [&] { lookup(regularTree); });                                                   \
+    regularTree.Seal();                                                                                                \
+    jitteredTree.Seal();                                                                                               \
+    fmt::print(                                                                                                        \
+        "Arity: {} {} regular runs, {} jittered runs\n",                                                               \
+        SIZE,                                                                                                          \
+        regularTree.GetRegularRunCount(),                                                                              \
+        jitteredTree.GetRegularRunCount());                                                                            \
+    bench.run(name + " sealed, jittered series", [&] { lookup(jitteredTree); });                                       \
+    bench.run(name + " sealed, regular series", [&] { lookup(regularTree); });                                         \
+  };
+
+// Entries are inserted one by one, the sorted copy BulkLoad() takes would not fit next to 100M entries
+#define GEN_AS_OF_TEST(SIZE, ENTRIES)                                                                                  \
+  SUBCASE("Arity of " #SIZE ", " #ENTRIES " entries") {                                                                \
+    ankerl::nanobench::Bench bench;                                                                                    \
+    bench.title("Point lookups, arity of " #SIZE ", " #ENTRIES " entries").unit("Lookup").relative(true);              \
+    bench.minEpochIterations(100'000).performanceCounters(true);                                                       \
+    TimeTree<SIZE> tree;                                                                                               \
+    for (uint64_t i = 1; i <= (ENTRIES); ++i) {                                                                        \
+      tree.Insert(i * 10, i * 10 + 5, i);                                                                              \
+    }                                                                                                                  \
+    ankerl::nanobench::Rng rng(42);                                                                                    \
+    bench.run("Arity: " #SIZE " Query(t, t)", [&] {                                                                    \
+      const uint64_t t = (rng.bounded(ENTRIES) + 1) * 10 + 3;                                                          \
+      ankerl::nanobench::doNotOptimizeAway(tree.Query(t, t));                                                          \
+    });                                                                                                                \
+    bench.run("Arity: " #SIZE " AsOf(t) holding t", [&] {                                                              \
+      const uint64_t t = (rng.bounded(ENTRIES) + 1) * 10 + 3;                                                          \
+      ankerl::nanobench::doNotOptimizeAway(tree.AsOf(t));                                                              \
+    });                                                                                                                \
+    bench.run("Arity: " #SIZE " AsOf(t) before t", [&] {                                                               \
+      const uint64_t t = (rng.bounded(ENTRIES) + 1) * 10 + 7;                                                          \
+      ankerl::nanobench::doNotOptimizeAway(tree.AsOf(t));                                                              \
+    });                                                                                                                \
+  };
+
+#define GEN_QUERY_MANY_TEST(SIZE)                                                                                      \
+  SUBCASE("Arity of " #SIZE) {                                                                                         \
+    ankerl::nanobench::Bench bench;                                                                                    \
+    bench.title("Batched windows, arity of " #SIZE).unit("Request").relative(true);                                    \
+    bench.minEpochIterations(10'000).performanceCounters(true);                                                        \
+    TimeTree<SIZE> tree;                                                                                               \
+    for (uint64_t i = 1; i <= 1'000'000; ++i) {                                                                        \
+      tree.Insert(i, i, i);                                                                                            \
+    }                                                                                                                  \
+    std::vector<TimeRange_t> out;                                                                                      \
+    std::vector<std::size_t> offsets;                                                                                  \
+    auto measure = [&](const std::string& name, const std::vector<std::pair<uint64_t, uint64_t>>& windows) {           \
+      bench.run(name + " one query each", [&] {                                                                        \
+        for (const auto& [start, end] : windows) {                                                                     \
+          ankerl::nanobench::doNotOptimizeAway(tree.Query(start, end));                                                \
+        }                                                                                                              \
+      });                                                                                                              \
+      bench.run(name + " QueryMany", [&] {                                                                             \
+        ankerl::nanobench::doNotOptimizeAway(tree.QueryMany(windows, out, offsets));                                   \
+      });                                                                                                              \
+    };                                                                                                                 \
+    std::vector<std::pair<uint64_t, uint64_t>> hours;                                                                  \
+    std::vector<std::pair<uint64_t, uint64_t>> points;                                                                 \
+    for (uint64_t i = 0; i < 24; ++i) {                                                                                \
+      hours.emplace_back(i * 40'000 + 1, i * 40'000 + 1'000);                                                          \
+    }                                                                                                                  \
+    for (uint64_t i = 0; i < 64; ++i) {                                                                                \
+      points.emplace_back(900'000 + i * 100, 900'000 + i * 100 + 9);                                                   \
+    }                                                                                                                  \
+    measure("Arity: " #SIZE " 24 windows of 1k over 1M", hours);                                                       \
+    measure("Arity: " #SIZE " 64 windows of 10 over 6.4k", points);                                                    \
+  };
+
+#define GEN_COUNT_TEST(SIZE)                                                                                           \
+  SUBCASE("Arity of " #SIZE) {                                                                                         \
+    ankerl::nanobench::Bench bench;                                                                                    \
+    bench.title("Counts, arity of " #SIZE).unit("Query").relative(true);                                               \
+    bench.minEpochIterations(1'000).performanceCounters(true);                                                         \
+    TimeTree<SIZE> tree;                                                                                               \
+    for (uint64_t i = 1; i <= 1'000'000; ++i) {                                                                        \
+      tree.Insert(i, i, i, static_cast<double>(i));                                                                    \
+    }                                                                                                                  \
+    for (uint64_t width : {1'000, 100'000, 900'000}) {                                                                 \
+      const std::string name = fmt::format("Arity: {} {} entries", SIZE, width);                                       \
+      bench.run(name + " Query().size()", [&] {                                                                        \
+        ankerl::nanobench::doNotOptimizeAway(tree.Query(50'000, 50'000 + width - 1)->size());                          \
+      });                                                                                                              \
+      bench.run(name + " AggregateQuery().count", [&] {                                                                \
+        ankerl::nanobench::doNotOptimizeAway(tree.AggregateQuery(50'000, 50'000 + width - 1)->count);                  \
+      });                                                                                                              \
+      bench.run(name + " Count()", [&] {                                                                               \
+        ankerl::nanobench::doNotOptimizeAway(tree.Count(50'000, 50'000 + width - 1));                                  \
+      });                                                                                                              \
+      bench.run(name + " Any()", [&] {                                                                                 \
+        ankerl::nanobench::doNotOptimizeAway(tree.Any(50'000, 50'000 + width - 1));                                    \
+      });                                                                                                              \
+    }                                                                                                                  \
+  };
+
+#define GEN_PARALLEL_QUERY_TEST(SIZE, ENTRIES)                                                                         \
+  SUBCASE("Arity of " #SIZE ", " #ENTRIES " entries") {                                                                \
+    ankerl::nanobench::Bench bench;                                                                                    \
+    bench.title("Parallel scans, arity of " #SIZE ", " #ENTRIES " entries").unit("Query").relative(true);              \
+    bench.performanceCounters(true);                                                                                   \
+    TimeTree<SIZE> tree;                                                                                               \
+    for (uint64_t i = 1; i <= (ENTRIES); ++i) {                                                                        \
+      tree.Insert(i, i, i);                                                                                            \
+    }                                                                                                                  \
+    bench.run("Arity: " #SIZE " serial", [&] { ankerl::nanobench::doNotOptimizeAway(tree.Query(1, ENTRIES)); });       \
+    for (std::size_t threads : {1, 2, 4, 8}) {                                                                         \
+      ThreadPool pool(threads);                                                                                        \
+      bench.run(fmt::format("Arity: {} {} threads", SIZE, threads), [&] {                                              \
+        ankerl::nanobench::doNotOptimizeAway(tree.ParallelQuery(1, ENTRIES, pool));                                    \
+      });                                                                                                              \
+    }                                                                                                                  \
+  };
+
 TEST_CASE("Insertion Bench") {
   GEN_INSERT_TEST(8);
   GEN_INSERT_TEST(16);
@@ -81,6 +737,173 @@ TEST_CASE("Insertion Bench") {
   GEN_INSERT_TEST(256);
 }
 
+TEST_CASE("Batched insertion Bench") {
+  GEN_BATCH_INSERT_TEST(8);
+  GEN_BATCH_INSERT_TEST(16);
+  GEN_BATCH_INSERT_TEST(32);
+  GEN_BATCH_INSERT_TEST(64);
+  GEN_BATCH_INSERT_TEST(128);
+  GEN_BATCH_INSERT_TEST(256);
+}
+
+TEST_CASE("Late insertion Bench") {
+  GEN_LATE_INSERT_TEST(8);
+  GEN_LATE_INSERT_TEST(64);
+  GEN_LATE_INSERT_TEST(256);
+}
+
+TEST_CASE("Bulk load Bench") {
+  GEN_BULK_LOAD_TEST(64, 1'000'000);
+  GEN_BULK_LOAD_TEST(64, 100'000'000);
+  GEN_BULK_LOAD_TEST(256, 1'000'000);
+  GEN_BULK_LOAD_TEST(256, 100'000'000);
+}
+
+TEST_CASE("Checkpoint Bench") {
+  GEN_CHECKPOINT_TEST(64, 10'000'000);
+  GEN_CHECKPOINT_TEST(64, 100'000'000);
+  GEN_CHECKPOINT_TEST(256, 10'000'000);
+  GEN_CHECKPOINT_TEST(256, 100'000'000);
+}
+
+TEST_CASE("Allocator Bench") {
+  GEN_ALLOC_INSERT_TEST(8);
+  GEN_ALLOC_INSERT_TEST(16);
+  GEN_ALLOC_INSERT_TEST(32);
+  GEN_ALLOC_INSERT_TEST(64);
+  GEN_ALLOC_INSERT_TEST(128);
+  GEN_ALLOC_INSERT_TEST(160);
+  GEN_ALLOC_INSERT_TEST(180);
+  GEN_ALLOC_INSERT_TEST(200);
+  GEN_ALLOC_INSERT_TEST(220);
+  GEN_ALLOC_INSERT_TEST(240);
+  GEN_ALLOC_INSERT_TEST(256);
+}
+
+TEST_CASE("Memory usage") {
+  GEN_MEMORY_TEST(8, 8);
+  GEN_MEMORY_TEST(16, 16);
+  GEN_MEMORY_TEST(32, 32);
+  GEN_MEMORY_TEST(64, 64);
+  GEN_MEMORY_TEST(128, 128);
+  GEN_MEMORY_TEST(256, 256);
+  GEN_MEMORY_TEST(64, 8);
+  GEN_MEMORY_TEST(128, 16);
+}
+
+// Rolling retention keeping the newest 1M entries at full resolution, memory should level off after the first rounds
+TEST_CASE("Retention memory") {
+  GEN_RETENTION_TEST(SimpleAllocator, 8);
+  GEN_RETENTION_TEST(SimpleAllocator, 64);
+  GEN_RETENTION_TEST(SlabAllocator, 64);
+}
+
+TEST_CASE("Hard retention Bench") {
+  GEN_DROP_TEST(64, 100'000);
+  GEN_DROP_TEST(64, 1'000'000);
+  GEN_DROP_TEST(64, 10'000'000);
+}
+
+TEST_CASE("Key search Bench") {
+  GEN_SIMD_QUERY_TEST(8);
+  GEN_SIMD_QUERY_TEST(16);
+  GEN_SIMD_QUERY_TEST(32);
+  GEN_SIMD_QUERY_TEST(64);
+  GEN_SIMD_QUERY_TEST(128);
+  GEN_SIMD_QUERY_TEST(160);
+  GEN_SIMD_QUERY_TEST(180);
+  GEN_SIMD_QUERY_TEST(200);
+  GEN_SIMD_QUERY_TEST(220);
+  GEN_SIMD_QUERY_TEST(240);
+  GEN_SIMD_QUERY_TEST(256);
+}
+
+TEST_CASE("Streaming query Bench") {
+  GEN_STREAMING_QUERY_TEST(8);
+  GEN_STREAMING_QUERY_TEST(64);
+  GEN_STREAMING_QUERY_TEST(256);
+}
+
+TEST_CASE("Mapped query Bench") {
+  GEN_MAPPED_QUERY_TEST(8);
+  GEN_MAPPED_QUERY_TEST(64);
+  GEN_MAPPED_QUERY_TEST(256);
+}
+
+TEST_CASE("Durable insertion Bench") {
+  GEN_WAL_INSERT_TEST(1, 1'000);
+  GEN_WAL_INSERT_TEST(64, 1'000);
+  GEN_WAL_INSERT_TEST(1'024, 1'000);
+  GEN_WAL_INSERT_TEST(16'384, 1'000);
+  GEN_WAL_INSERT_TEST(1'000'000, 1);
+  GEN_WAL_INSERT_TEST(1'000'000, 10);
+}
+
+TEST_CASE("Concurrent query Bench") {
+  GEN_CONCURRENT_QUERY_TEST(0);
+  GEN_CONCURRENT_QUERY_TEST(1);
+  GEN_CONCURRENT_QUERY_TEST(2);
+  GEN_CONCURRENT_QUERY_TEST(4);
+  GEN_CONCURRENT_QUERY_TEST(8);
+  GEN_CONCURRENT_QUERY_TEST(16);
+  GEN_CONCURRENT_QUERY_TEST(32);
+}
+
+TEST_CASE("Tree set Bench") {
+  GEN_TREE_SET_QUERY_TEST(1);
+  GEN_TREE_SET_QUERY_TEST(2);
+  GEN_TREE_SET_QUERY_TEST(4);
+  GEN_TREE_SET_QUERY_TEST(8);
+  GEN_TREE_SET_QUERY_TEST(16);
+}
+
+TEST_CASE("Range aggregate Bench") {
+  GEN_AGGREGATE_QUERY_TEST(8);
+  GEN_AGGREGATE_QUERY_TEST(64);
+  GEN_AGGREGATE_QUERY_TEST(256);
+}
+
+TEST_CASE("Compressed leaf Bench") {
+  GEN_COMPRESSED_QUERY_TEST(16);
+  GEN_COMPRESSED_QUERY_TEST(64);
+  GEN_COMPRESSED_QUERY_TEST(256);
+}
+
+TEST_CASE("Sealed lookup Bench") {
+  GEN_SEALED_LOOKUP_TEST(8, 10'000'000);
+  GEN_SEALED_LOOKUP_TEST(64, 10'000'000);
+  GEN_SEALED_LOOKUP_TEST(64, 30'000'000);
+}
+
+TEST_CASE("Regular series lookup Bench") {
+  GEN_REGULAR_LOOKUP_TEST(8, 10'000'000);
+  GEN_REGULAR_LOOKUP_TEST(64, 10'000'000);
+  GEN_REGULAR_LOOKUP_TEST(64, 30'000'000);
+}
+
+TEST_CASE("Point lookup Bench") {
+  GEN_AS_OF_TEST(8, 1'000'000);
+  GEN_AS_OF_TEST(64, 1'000'000);
+  GEN_AS_OF_TEST(64, 100'000'000);
+}
+
+TEST_CASE("Batched query Bench") {
+  GEN_QUERY_MANY_TEST(8);
+  GEN_QUERY_MANY_TEST(64);
+  GEN_QUERY_MANY_TEST(256);
+}
+
+TEST_CASE("Count Bench") {
+  GEN_COUNT_TEST(8);
+  GEN_COUNT_TEST(64);
+  GEN_COUNT_TEST(256);
+}
+
+TEST_CASE("Parallel query Bench") {
+  GEN_PARALLEL_QUERY_TEST(64, 1'000'000);
+  GEN_PARALLEL_QUERY_TEST(64, 10'000'000);
+}
+
 TEST_CASE("Lookup Bench") {
   GEN_QUERY_TEST(8);
   GEN_QUERY_TEST(16);
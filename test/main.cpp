@@ -1,9 +1,20 @@
+#include <array>
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
 #include <deque>
+#include <filesystem>
+#include <fstream>
+#include <thread>
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 
 #include "doctest.h"
+#include "src/MappedTimeTree.hpp"
+#include "src/SealedIndex.hpp"
+#include "src/ThreadPool.hpp"
 #include "src/TimeTree.hpp"
+#include "src/TimeTreeSet.hpp"
+#include "src/WriteAheadLog.hpp"
 
 TEST_CASE("Basic tree insertion tests") {
   SUBCASE("Arity of 2") {
@@ -39,7 +50,7 @@ TEST_CASE("Basic tree insertion tests") {
     for (TimeTreeNode<2>& node : tree) {
       CHECK(node.GetNodeStart() != 0);
       CHECK(node.GetNodeEnd() != 0);
-      const std::span<TimeRange_t> range = node.GetData();
+      const EntryView range = node.GetData();
       for (const TimeRange_t r : range) {
         CHECK(r.start == tester);
         CHECK(r.end == tester);
@@ -113,7 +124,7 @@ TEST_CASE("Basic tree insertion tests") {
     for (TimeTreeNode<8>& node : tree) {
       CHECK(node.GetNodeStart() != 0);
       CHECK(node.GetNodeEnd() != 0);
-      const std::span<TimeRange_t> range = node.GetData();
+      const EntryView range = node.GetData();
       for (const TimeRange_t r : range) {
         CHECK(r.start == tester);
         CHECK(r.end == tester);
@@ -149,13 +160,13 @@ TEST_CASE("Basic tree insertion tests") {
 }
 
 TEST_CASE("Basic node tests") {
-  auto leafNode = TimeTreeNode<2>(true, 0, 10, 0);
+  auto leafNode = LeafNode<2>(0, 10, 0);
   CHECK(leafNode.GetNodeStart() == 0);
   CHECK(leafNode.GetNodeEnd() == 10);
   CHECK(leafNode.Insert(12, 11, 0) == tl::unexpected(Errors_e::INVALID_TIME_RANGE));
   // CHECK(leafNode.Insert(9, 11, 0) == tl::unexpected(Errors_e::INVALID_TIME_RANGE));
 
-  auto treeNode = TimeTreeNode<2>(false, 0, 10, 0);
+  auto treeNode = InnerNode<2>(0, 10);
   CHECK(treeNode.Insert(11, 12, 0) == tl::unexpected(Errors_e::NON_LEAF_PTR_INSERT));
   CHECK(treeNode.GetNodeStart() == 0);
   CHECK(treeNode.GetNodeEnd() == 10);
@@ -260,7 +271,8 @@ TEST_CASE("TimeTree leaf iterator") {
 
   std::deque<std::deque<TimeTreeNode<4>*>>& nodes = tree.Data();
   nodes.at(0).erase(nodes.at(0).begin(), nodes.at(0).begin() + 4);
-  nodes.at(1).front()->ConvertToLeaf();
+  // Inner nodes can't become leafs, mark it as collapsed so the iterator stops there instead
+  nodes.at(1).front()->IncAggregateLevel();
 
   for (TimeTreeNode<4>& node : tree) {
     fmt::print("{} -> {}\n", node.GetNodeStart(), node.GetNodeEnd());
@@ -286,7 +298,7 @@ TEST_CASE("TimeTree aggregation") {
   CHECK(res.size() == 4);
 
   fmt::print("removed size: {}\n", res.size());
-  for (TimeTreeNode<4> node : tree) {
+  for (const TimeTreeNode<4>& node : tree) {
     fmt::print("{} -> {}\n", node.GetNodeStart(), node.GetNodeEnd());
   }
 
@@ -344,3 +356,2236 @@ TEST_CASE("TimeTree aggregation") {
     fmt::print("{} -> {}\n", node.GetNodeStart(), node.GetNodeEnd());
   }
 }
+
+TEST_CASE("Aggregation policies") {
+  const std::string path = (std::filesystem::temp_directory_path() / "timetree-policy-test").string();
+
+  // 256 entries give 64 leafs, 16 and 4 inner nodes and the root
+  TimeTree<4> tree;
+  for (uint64_t i = 1; i <= 256; ++i) {
+    tree.Insert(i, i, i, static_cast<double>(i));
+  }
+  auto values = [&tree](uint64_t start, uint64_t end) {
+    std::vector<double> res;
+    CHECK(tree.QueryVisit(start, end, [&res](const TimeRange_t& range) { res.push_back(range.value); }));
+    return res;
+  };
+  std::vector<TimeRange_t> removed;
+
+  SUBCASE("Mean over every level") {
+    tree.Aggregate(128, removed);
+    CHECK(removed.size() == 128);
+    CHECK(values(1, 8) == std::vector<double>{2.5, 6.5});
+    CHECK(tree.Query(1, 4)->front().ptr == 0);
+
+    // Stand-ins for the collapsed leafs are reported when their parents collapse
+    removed.clear();
+    tree.Aggregate(128, removed);
+    REQUIRE(removed.size() == 32);
+    CHECK(removed.front().start == 1);
+    CHECK(removed.front().end == 4);
+    CHECK(removed.front().value == 2.5);
+    CHECK(values(1, 32) == std::vector<double>{8.5, 24.5});
+
+    tree.Aggregate(128, removed);
+    CHECK(values(1, 128) == std::vector<double>{32.5, 96.5});
+    CHECK(tree.GetRoot()->GetChildren()[0]->GetAggregateLevel() == 3);
+    // Nothing is left to collapse below the cutoff, the newest nodes of every level are kept
+    removed.clear();
+    tree.Aggregate(128, removed);
+    tree.Aggregate(1'000, removed);
+    CHECK(tree.GetRoot()->GetAggregateLevel() == 0);
+    CHECK(tree.Insert(257, 257, 257).has_value());
+    CHECK(tree.Query(255, 257)->size() == 3);
+  };
+
+  SUBCASE("Maximum level") {
+    for (int round = 0; round < 4; ++round) {
+      tree.Aggregate(128, removed, 2);
+    }
+    CHECK(values(1, 128).size() == 8);
+    CHECK(tree.GetRoot()->GetChildren()[0]->GetAggregateLevel() == 0);
+    tree.Aggregate(128, removed, 3);
+    CHECK(values(1, 128).size() == 2);
+  };
+
+  SUBCASE("Built-in and custom policies") {
+    const std::vector<std::pair<AggregatePolicy, double>> policies{
+        {aggregate::Min, 1},
+        {aggregate::Max, 64},
+        {aggregate::Sum, 64 * 65 / 2},
+        {aggregate::Last, 64},
+        {[](const Summary_t& summary, std::span<const TimeRange_t>) { return summary.max - summary.min; }, 63}};
+    for (const auto& [policy, expected] : policies) {
+      TimeTree<4> other;
+      other.SetAggregatePolicy(policy);
+      for (uint64_t i = 1; i <= 256; ++i) {
+        other.Insert(i, i, i, static_cast<double>(i));
+      }
+      for (int round = 0; round < 3; ++round) {
+        other.Aggregate(128, removed);
+      }
+      auto res = other.Query(1, 64);
+      REQUIRE(res->size() == 1);
+      CHECK(res->front().value == expected);
+    }
+  };
+
+  SUBCASE("Aggregate ptrs") {
+    tree.Aggregate(8, removed);
+    CHECK(tree.UpdateAggregatePtrs({{1, 4, 100}, {5, 8, 101}, {6, 8, 102}, {300, 400, 103}}) == 2);
+    auto res = tree.Query(1, 9);
+    REQUIRE(res->size() == 3);
+    CHECK(res->at(0).ptr == 100);
+    CHECK(res->at(1).ptr == 101);
+    CHECK(res->at(2).ptr == 9);
+  };
+
+  SUBCASE("Checkpoints keep collapsed values") {
+    tree.SetAggregatePolicy(aggregate::Max);
+    tree.Aggregate(128, removed);
+    tree.Aggregate(128, removed);
+    CHECK(tree.Save(path).has_value());
+    auto loaded = TimeTree<4>::Load(path);
+    REQUIRE(loaded.has_value());
+    auto mapped = MappedTimeTree<4>::Open(path);
+    REQUIRE(mapped.has_value());
+    const auto want = *tree.Query(1, 256);
+    const auto fromLoaded = *loaded->Query(1, 256);
+    const auto fromMapped = *mapped->Query(1, 256);
+    REQUIRE(fromLoaded.size() == want.size());
+    REQUIRE(fromMapped.size() == want.size());
+    for (std::size_t i = 0; i < want.size(); ++i) {
+      CHECK(fromLoaded[i].value == want[i].value);
+      CHECK(fromMapped[i].value == want[i].value);
+    }
+    CHECK(want.front().value == 16);
+    CHECK(loaded->GetRoot()->GetChildren()[0]->GetChildren()[0]->GetAggregateLevel() == 2);
+  };
+
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("Slab allocator") {
+  SUBCASE("Reuses released nodes") {
+    SlabAllocator<4> allocator;
+    CHECK(allocator.GetBytesHeld() == 0);
+
+    TimeTreeNode<4>* first = allocator.GetNewLeaf(1, 1, 0);
+    TimeTreeNode<4>* second = allocator.GetNewInner(2, 2);
+    const std::size_t held = allocator.GetBytesHeld();
+    CHECK(held > 0);
+    CHECK(allocator.GetLiveNodes() == 2);
+    CHECK(first != second);
+
+    allocator.Release(first);
+    CHECK(allocator.GetLiveNodes() == 1);
+    TimeTreeNode<4>* third = allocator.GetNewLeaf(3, 3, 0);
+    CHECK(third == first);
+    CHECK(third->GetNodeStart() == 3);
+    CHECK(third->GetChildCount() == 0);
+    CHECK(allocator.GetBytesHeld() == held);
+  };
+
+  SUBCASE("Grows by whole slabs") {
+    // Small slabs so that a handful of nodes spill into a second one
+    SlabAllocator<4, 4, 1024> allocator;
+    allocator.GetNewLeaf(1, 1, 0);
+    const std::size_t slab = allocator.GetBytesHeld();
+    for (int i = 0; i < 64; ++i) {
+      allocator.GetNewLeaf(1, 1, 0);
+    }
+    CHECK(allocator.GetBytesHeld() > slab);
+    CHECK(allocator.GetBytesHeld() % slab == 0);
+  };
+
+  SUBCASE("Backing a tree") {
+    TimeTree<4, 4, SlabAllocator<4>> tree;
+    for (int i = 1; i <= 1000; ++i) {
+      tree.Insert(i, i, 0);
+    }
+    auto qRes = tree.Query(100, 200);
+    CHECK(qRes.has_value());
+    CHECK(qRes->size() == 101);
+
+    const std::size_t liveBefore = tree.GetAllocator().GetLiveNodes();
+    std::vector<TimeRange_t> removed;
+    tree.Aggregate(16, removed);
+    tree.Aggregate(16, removed);
+    CHECK(tree.GetAllocator().GetLiveNodes() < liveBefore);
+  };
+}
+
+TEST_CASE("Memory reclamation") {
+  // Rolling retention, the newest 1'000 entries stay at full resolution and everything older is aggregated
+  auto roll = [](auto& tree, uint64_t& ts, std::size_t rounds) {
+    std::vector<TimeRange_t> removed;
+    for (std::size_t round = 0; round < rounds; ++round) {
+      for (int i = 0; i < 1'000; ++i, ++ts) {
+        tree.Insert(ts, ts, ts, 1.0);
+      }
+      for (std::size_t level = 0; level < tree.GetHeight(); ++level) {
+        tree.Aggregate(ts - 1'000, removed);
+      }
+      removed.clear();
+    }
+  };
+
+  SUBCASE("Simple allocator") {
+    TimeTree<8> tree;
+    uint64_t ts = 1;
+    roll(tree, ts, 10);
+    const std::size_t warm = tree.GetAllocator().GetLiveNodes();
+    roll(tree, ts, 90);
+    // Without releasing there would be 12'500 leafs by now
+    CHECK(tree.GetAllocator().GetLiveNodes() < warm + 64);
+    CHECK(tree.GetAllocator().GetLiveNodes() < 400);
+    CHECK(tree.AggregateQuery(0, ts)->count == ts - 1);
+  };
+
+  SUBCASE("Slab allocator") {
+    TimeTree<8, 8, SlabAllocator<8>> tree;
+    uint64_t ts = 1;
+    roll(tree, ts, 10);
+    const std::size_t held = tree.GetAllocator().GetBytesHeld();
+    roll(tree, ts, 90);
+    CHECK(tree.GetAllocator().GetBytesHeld() == held);
+    CHECK(tree.GetAllocator().GetLiveNodes() < 400);
+    CHECK(tree.AggregateQuery(0, ts)->count == ts - 1);
+  };
+}
+
+TEST_CASE("Hard retention") {
+  TimeTree<4> tree;
+  for (uint64_t i = 1; i <= 1'000; ++i) {
+    tree.Insert(i * 10, i * 10 + 5, i, static_cast<double>(i));
+  }
+  std::vector<TimeRange_t> dropped;
+  auto collect = [&dropped](const TimeRange_t& range) { dropped.push_back(range); };
+
+  SUBCASE("Whole leafs before the cutoff") {
+    // Leafs hold 4 entries, the one holding 197-200 ends at 2'005 and stays
+    CHECK(tree.DropBefore(2'000, collect) > 49);
+    REQUIRE(dropped.size() == 196);
+    for (std::size_t i = 0; i < dropped.size(); ++i) {
+      CHECK(dropped[i].ptr == i + 1);
+    }
+    CHECK(tree.GetRoot()->GetNodeStart() == 1'970);
+    auto res = tree.Query(0, 1'000'000);
+    REQUIRE(res.has_value());
+    CHECK(res->size() == 804);
+    CHECK(res->front().ptr == 197);
+    auto summary = tree.AggregateQuery(0, 1'000'000);
+    CHECK(summary->count == 804);
+    CHECK(summary->sum == (197.0 + 1'000.0) * 804.0 / 2.0);
+    CHECK(summary->min == 197.0);
+
+    // Nothing left to drop, nothing is visited
+    dropped.clear();
+    CHECK(tree.DropBefore(2'000, collect) == 0);
+    CHECK(dropped.empty());
+
+    tree.Insert(10'010, 10'015, 1'001);
+    CHECK(tree.Query(0, 1'000'000)->size() == 805);
+  };
+
+  SUBCASE("Root shrinks") {
+    const std::size_t height = tree.GetHeight();
+    tree.DropBefore(9'000, collect);
+    CHECK(tree.GetHeight() < height);
+    CHECK(tree.GetRoot()->GetNodeStart() == tree.Query(0, 1'000'000)->front().start);
+    CHECK(tree.Query(0, 1'000'000)->size() + dropped.size() == 1'000);
+  };
+
+  SUBCASE("Collapsed nodes") {
+    std::vector<TimeRange_t> removed;
+    tree.Aggregate(4'000, removed);
+    tree.Aggregate(4'000, removed);
+    tree.DropBefore(3'000, collect);
+    REQUIRE(!dropped.empty());
+    uint64_t last = 0;
+    for (const TimeRange_t& range : dropped) {
+      CHECK(range.end < 3'000);
+      last = std::max(last, range.end);
+    }
+    CHECK(tree.Query(0, 1'000'000)->front().start > last);
+    CHECK(tree.Query(5'000, 5'000)->front().ptr == 500);
+  };
+
+  SUBCASE("Late entries") {
+    tree.Insert(1'005, 1'006, 5'000);
+    tree.Insert(9'005, 9'006, 5'001);
+    CHECK(tree.GetLateEntryCount() == 2);
+    tree.DropBefore(2'000, collect);
+    CHECK(tree.GetLateEntryCount() == 1);
+    CHECK(std::count_if(dropped.begin(), dropped.end(), [](const TimeRange_t& range) {
+      return range.ptr == 5'000;
+    }) == 1);
+    CHECK(tree.Query(9'005, 9'005)->size() == 2);
+  };
+
+  SUBCASE("Everything") {
+    std::vector<TimeRange_t> removed;
+    tree.Aggregate(2'000, removed);
+    REQUIRE(tree.Insert(1'000, 1'001, 1) == tl::unexpected(Errors_e::RANGE_AGGREGATED));
+    const std::size_t live = tree.GetAllocator().GetLiveNodes();
+    CHECK(tree.DropBefore(1'000'000, collect) == live);
+    CHECK(tree.GetAllocator().GetLiveNodes() == 1);
+    CHECK(dropped.back().ptr == 1'000);
+    CHECK(tree.GetHeight() == 1);
+
+    // The collapsed range is gone with the rest, it takes inserts again
+    CHECK(tree.Insert(1'000, 1'001, 1).has_value());
+    tree.Insert(20'000, 20'005, 2);
+    CHECK(tree.Query(0, 1'000'000)->size() == 2);
+  };
+
+  SUBCASE("Every collapsed node") {
+    std::vector<TimeRange_t> removed;
+    tree.Aggregate(2'000, removed);
+    tree.DropBefore(3'000, collect);
+    CHECK(tree.Insert(2'500, 2'501, 1).has_value());
+    CHECK(tree.Query(2'500, 2'500)->size() == 1);
+  };
+
+  SUBCASE("Readable after a checkpoint") {
+    const std::string path = (std::filesystem::temp_directory_path() / "timetree-drop-test").string();
+    tree.DropBefore(5'000, collect);
+    REQUIRE(tree.Save(path).has_value());
+    auto loaded = TimeTree<4>::Load(path);
+    REQUIRE(loaded.has_value());
+    CHECK(loaded->Query(0, 1'000'000)->size() == tree.Query(0, 1'000'000)->size());
+    CHECK(loaded->AggregateQuery(0, 1'000'000)->count == tree.AggregateQuery(0, 1'000'000)->count);
+    std::filesystem::remove(path);
+  };
+}
+
+TEST_CASE("Separate leaf and inner arity") {
+  CHECK(sizeof(InnerNode<64>) < sizeof(LeafNode<64>));
+  CHECK(sizeof(InnerNode<64, 8>) < sizeof(InnerNode<64, 64>));
+
+  TimeTree<8, 3> tree;
+  for (int i = 1; i <= 1000; ++i) {
+    tree.Insert(i, i, 0);
+  }
+  // 125 leafs under ternary inner nodes
+  CHECK(tree.GetNumberLeafs() == 125);
+  CHECK(tree.GetHeight() == 6);
+  CHECK(tree.GetRoot()->GetNodeStart() == 1);
+  CHECK(tree.GetRoot()->GetNodeEnd() == 1000);
+
+  auto qRes = tree.Query(17, 923);
+  CHECK(qRes.has_value());
+  CHECK(qRes->size() == 907);
+
+  uint64_t tester = 1;
+  for (TimeTreeNode<8, 3>& node : tree) {
+    for (const TimeRange_t r : node.GetData()) {
+      CHECK(r.start == tester);
+      ++tester;
+    }
+  }
+  CHECK(tester == 1001);
+}
+
+TEST_CASE("Leaf compression") {
+  SUBCASE("Codec round trip") {
+    const std::vector<uint64_t> starts{0, 5, 5, 1'000, 1'001, std::numeric_limits<uint64_t>::max() - 10};
+    const std::vector<uint64_t> ends{3, 5, 900, 1'000, 50'000, std::numeric_limits<uint64_t>::max()};
+    const std::vector<uint64_t> ptrs{std::numeric_limits<uint64_t>::max(), 0, 4'096, 8'192, 3, 3};
+    const std::vector<double> values{-0.0, 1.5, 1.5, std::numeric_limits<double>::infinity(), -1e300, 0.1};
+    std::vector<uint8_t> encoded;
+    codec::EncodeEntries(starts.data(), ends.data(), ptrs.data(), values.data(), starts.size(), encoded);
+    LeafBuffer_t<8> buffer{};
+    codec::DecodeEntries(
+        encoded.data(),
+        starts.size(),
+        buffer.starts.data(),
+        buffer.ends.data(),
+        buffer.ptrs.data(),
+        buffer.values.data());
+    for (std::size_t i = 0; i < starts.size(); ++i) {
+      CHECK(buffer.starts[i] == starts[i]);
+      CHECK(buffer.ends[i] == ends[i]);
+      CHECK(buffer.ptrs[i] == ptrs[i]);
+      CHECK(std::bit_cast<uint64_t>(buffer.values[i]) == std::bit_cast<uint64_t>(values[i]));
+    }
+  };
+
+  SUBCASE("Regular series take a byte per field") {
+    std::array<uint64_t, 64> starts{};
+    std::array<uint64_t, 64> ends{};
+    std::array<uint64_t, 64> ptrs{};
+    std::array<double, 64> values{};
+    for (std::size_t i = 0; i < 64; ++i) {
+      starts[i] = 1'700'000'000 + i * 15;
+      ends[i] = starts[i] + 10;
+      ptrs[i] = (i + 1) * 4'096;
+      values[i] = 42.0;
+    }
+    std::vector<uint8_t> encoded;
+    codec::EncodeEntries(starts.data(), ends.data(), ptrs.data(), values.data(), 64, encoded);
+    CHECK(encoded.size() <= 4 * 64 + 16);
+  };
+
+  auto fill = [](auto& tree, uint64_t first, uint64_t last) {
+    for (uint64_t i = first; i <= last; ++i) {
+      tree.Insert(i * 10, i * 10 + 5, i * 4'096, static_cast<double>(i % 7));
+    }
+  };
+  auto same = [](const auto& expected, const auto& actual, uint64_t start, uint64_t end) {
+    auto want = expected.Query(start, end);
+    auto got = actual.Query(start, end);
+    REQUIRE(want.has_value() == got.has_value());
+    if (want) {
+      REQUIRE(got->size() == want->size());
+      for (std::size_t i = 0; i < want->size(); ++i) {
+        CHECK(got->at(i).start == want->at(i).start);
+        CHECK(got->at(i).end == want->at(i).end);
+        CHECK(got->at(i).ptr == want->at(i).ptr);
+        CHECK(got->at(i).value == want->at(i).value);
+      }
+      CHECK(actual.AggregateQuery(start, end)->sum == expected.AggregateQuery(start, end)->sum);
+    }
+  };
+
+  TimeTree<16> plain;
+  TimeTree<16> compressed;
+  compressed.SetLeafCompression(true);
+  fill(plain, 1, 20'000);
+  fill(compressed, 1, 20'000);
+
+  SUBCASE("Sealed leafs are compressed") {
+    const auto& leafs = compressed.Data().front();
+    for (std::size_t i = 0; i < leafs.size(); ++i) {
+      CHECK(leafs[i]->IsCompressed() == (i + 1 != leafs.size()));
+    }
+    CHECK(compressed.GetAllocator().GetBytesHeld() * 2 < plain.GetAllocator().GetBytesHeld());
+    same(plain, compressed, 0, 1'000'000);
+    same(plain, compressed, 12'345, 23'456);
+    same(plain, compressed, 199'990, 200'000);
+  };
+
+  SUBCASE("Lazy ranges decode as they go") {
+    auto want = plain.Query(1'000, 30'000);
+    std::vector<TimeRange_t> got;
+    {
+      auto range = compressed.QueryRange(1'000, 30'000);
+      REQUIRE(range.has_value());
+      auto it = range->begin();
+      for (std::size_t i = 0; i < 17; ++i, ++it) {
+        got.push_back(*it);
+      }
+      // A copy keeps its own decoded leaf while the original moves on
+      auto copy = it;
+      for (; it != range->end(); ++it) {
+        got.push_back(*it);
+      }
+      CHECK((*copy).start == want->at(17).start);
+    }
+    REQUIRE(got.size() == want->size());
+    for (std::size_t i = 0; i < got.size(); ++i) {
+      CHECK(got[i].ptr == want->at(i).ptr);
+    }
+  };
+
+  SUBCASE("Late entries, aggregation and retention") {
+    plain.SetLateBufferLimit(4);
+    compressed.SetLateBufferLimit(4);
+    for (uint64_t i = 100; i < 4'000; i += 100) {
+      plain.Insert(i * 10 + 1, i * 10 + 2, i, 0.5);
+      compressed.Insert(i * 10 + 1, i * 10 + 2, i, 0.5);
+    }
+    same(plain, compressed, 0, 1'000'000);
+
+    std::vector<TimeRange_t> plainRemoved;
+    std::vector<TimeRange_t> compressedRemoved;
+    plain.Aggregate(10'000, plainRemoved);
+    compressed.Aggregate(10'000, compressedRemoved);
+    REQUIRE(compressedRemoved.size() == plainRemoved.size());
+    for (std::size_t i = 0; i < plainRemoved.size(); ++i) {
+      CHECK(compressedRemoved[i].ptr == plainRemoved[i].ptr);
+    }
+
+    std::size_t plainDropped = 0;
+    std::size_t compressedDropped = 0;
+    plain.DropBefore(20'000, [&plainDropped](const TimeRange_t&) { ++plainDropped; });
+    compressed.DropBefore(20'000, [&compressedDropped](const TimeRange_t&) { ++compressedDropped; });
+    CHECK(compressedDropped == plainDropped);
+    same(plain, compressed, 0, 1'000'000);
+
+    fill(plain, 20'001, 21'000);
+    fill(compressed, 20'001, 21'000);
+    same(plain, compressed, 0, 1'000'000);
+  };
+
+  SUBCASE("Checkpoints") {
+    const std::string path = (std::filesystem::temp_directory_path() / "timetree-compressed-test").string();
+    REQUIRE(compressed.Save(path).has_value());
+    auto loaded = TimeTree<16>::Load(path);
+    REQUIRE(loaded.has_value());
+    same(plain, *loaded, 0, 1'000'000);
+    loaded->SetLeafCompression(true);
+    CHECK(loaded->Data().front().front()->IsCompressed());
+    same(plain, *loaded, 0, 1'000'000);
+    std::filesystem::remove(path);
+  };
+
+  SUBCASE("Slab allocator") {
+    TimeTree<16, 16, SlabAllocator<16>> slab;
+    slab.SetLeafCompression(true);
+    fill(slab, 1, 5'000);
+    same(plain, slab, 0, 50'000);
+    std::size_t dropped = 0;
+    slab.DropBefore(1'000'000, [&dropped](const TimeRange_t&) { ++dropped; });
+    CHECK(dropped == 5'000);
+    CHECK(slab.GetAllocator().GetLiveNodes() == 1);
+  };
+}
+
+TEST_CASE("Sealed index") {
+  SUBCASE("Matches a binary search") {
+    for (std::size_t count = 0; count < 70; ++count) {
+      std::vector<uint64_t> keys;
+      std::vector<std::size_t> values;
+      for (std::size_t i = 0; i < count; ++i) {
+        // Runs of equal keys with gaps between them
+        keys.push_back((i / 3) * 10 + 5);
+        values.push_back(i);
+      }
+      const SealedIndex<std::size_t> index(keys, values);
+      CHECK(index.size() == count);
+      CHECK(index.GetLastKey() == (count == 0 ? 0 : keys.back()));
+      for (uint64_t key = 0; key < count * 4 + 20; ++key) {
+        const auto expected = std::lower_bound(keys.begin(), keys.end(), key);
+        const std::size_t* found = index.FindFirstGreaterEqual(key);
+        if (expected == keys.end()) {
+          CHECK(found == nullptr);
+        } else {
+          REQUIRE(found != nullptr);
+          CHECK(*found == static_cast<std::size_t>(std::distance(keys.begin(), expected)));
+        }
+      }
+    }
+  };
+
+  SUBCASE("Runs compute the rank") {
+    std::vector<uint64_t> keys;
+    std::vector<std::size_t> values;
+    // Two irregular keys, then 40 steps of 100 whose keys lie 30 before the end of their step
+    for (uint64_t key : {3, 50}) {
+      keys.push_back(key);
+      values.push_back(values.size());
+    }
+    for (uint64_t i = 0; i < 40; ++i) {
+      keys.push_back(1'000 + i * 100 + 70);
+      values.push_back(values.size());
+    }
+    using Run = SealedIndex<std::size_t>::Run_t;
+    // A run that doesn't match its keys only costs the fallback to the search
+    for (const Run& run : {Run{1'000, 100, 2, 40}, Run{1'000, 50, 2, 40}, Run{900, 100, 2, 40}}) {
+      const SealedIndex<std::size_t> index(keys, values, {run});
+      CHECK(index.GetRunCount() == 1);
+      for (uint64_t key = 0; key < 6'000; ++key) {
+        const auto expected = std::lower_bound(keys.begin(), keys.end(), key);
+        const std::size_t* found = index.FindFirstGreaterEqual(key);
+        if (expected == keys.end()) {
+          CHECK(found == nullptr);
+        } else {
+          REQUIRE(found != nullptr);
+          CHECK(*found == static_cast<std::size_t>(std::distance(keys.begin(), expected)));
+        }
+      }
+    }
+  };
+
+  auto fill = [](auto& tree, uint64_t first, uint64_t last) {
+    for (uint64_t i = first; i <= last; ++i) {
+      tree.Insert(i * 10, i * 10 + 5, i, static_cast<double>(i % 7));
+    }
+  };
+  auto same = [](const auto& expected, const auto& actual, uint64_t last) {
+    for (uint64_t start = 0; start <= last; start += 7) {
+      auto want = expected.Query(start, start + 30);
+      auto got = actual.Query(start, start + 30);
+      REQUIRE(want.has_value() == got.has_value());
+      if (want) {
+        REQUIRE(got->size() == want->size());
+        for (std::size_t i = 0; i < want->size(); ++i) {
+          CHECK(got->at(i).start == want->at(i).start);
+          CHECK(got->at(i).ptr == want->at(i).ptr);
+        }
+      }
+    }
+  };
+
+  TimeTree<8> plain;
+  TimeTree<8> sealed;
+  fill(plain, 1, 2'000);
+  fill(sealed, 1, 2'000);
+  sealed.Seal();
+
+  SUBCASE("Queries start from the index") {
+    CHECK(sealed.GetSealedCount() == sealed.GetNumberLeafs() - 1);
+    same(plain, sealed, 20'100);
+    auto range = sealed.QueryRange(5'006, 5'100);
+    REQUIRE(range.has_value());
+    CHECK((*range->begin()).start == 5'010);
+  };
+
+  SUBCASE("Inserts past the index") {
+    fill(plain, 2'001, 3'000);
+    fill(sealed, 2'001, 3'000);
+    CHECK(sealed.GetSealedCount() == 2'000 / 8 - 1);
+    same(plain, sealed, 30'100);
+  };
+
+  SUBCASE("Regularly spaced leafs") {
+    CHECK(sealed.GetRegularRunCount() == 1);
+    TimeTree<8> mixedPlain;
+    TimeTree<8> mixed;
+    auto insert = [&mixedPlain, &mixed](uint64_t start, uint64_t end) {
+      mixedPlain.Insert(start, end, start);
+      mixed.Insert(start, end, start);
+    };
+    // Every 10, a gap, every 15 with varying widths, then jittered
+    for (uint64_t i = 0; i < 800; ++i) {
+      insert(i * 10, i * 10 + 5);
+    }
+    for (uint64_t i = 0; i < 800; ++i) {
+      insert(20'000 + i * 15, 20'000 + i * 15 + i % 3);
+    }
+    for (uint64_t i = 0; i < 200; ++i) {
+      insert(40'000 + i * 10 + i % 4, 40'000 + i * 10 + 5);
+    }
+    mixed.Seal();
+    CHECK(mixed.GetRegularRunCount() == 2);
+    same(mixedPlain, mixed, 42'100);
+  };
+
+  SUBCASE("Changes to sealed nodes drop the index") {
+    plain.Insert(5'001, 5'002, 1);
+    sealed.Insert(5'001, 5'002, 1);
+    CHECK(sealed.GetSealedCount() != 0);
+    plain.FlushLateEntries();
+    sealed.FlushLateEntries();
+    CHECK(sealed.GetSealedCount() == 0);
+    same(plain, sealed, 20'100);
+
+    std::vector<TimeRange_t> removed;
+    for (int i = 0; i < 2; ++i) {
+      sealed.Seal();
+      plain.Aggregate(10'000, removed);
+      sealed.Aggregate(10'000, removed);
+    }
+    CHECK(sealed.GetSealedCount() == 0);
+    same(plain, sealed, 20'100);
+
+    // Collapsed nodes are indexed like leafs
+    sealed.Seal();
+    CHECK(sealed.GetSealedCount() > sealed.GetNumberLeafs() - 1);
+    same(plain, sealed, 20'100);
+
+    plain.DropBefore(15'000, [](const TimeRange_t&) {});
+    sealed.DropBefore(15'000, [](const TimeRange_t&) {});
+    CHECK(sealed.GetSealedCount() == 0);
+    same(plain, sealed, 20'100);
+
+    sealed.Seal();
+    sealed.SetLeafCompression(true);
+    CHECK(sealed.GetSealedCount() == 0);
+    sealed.Seal();
+    CHECK(sealed.GetSealedCount() != 0);
+    same(plain, sealed, 20'100);
+  };
+}
+
+TEST_CASE("Tail queries") {
+  // Every level is linked both ways in the order of the level list
+  auto linked = [](auto& tree) {
+    for (const auto& level : tree.Data()) {
+      for (std::size_t i = 0; i < level.size(); ++i) {
+        CHECK(level[i]->GetReverseLink() == (i == 0 ? nullptr : level[i - 1]));
+        CHECK(level[i]->GetLink() == (i + 1 == level.size() ? nullptr : level[i + 1]));
+      }
+    }
+  };
+  // Entries i * 10 to i * 10 + 5 for i in [first, last], queried from start to the newest one
+  auto tail = [](const auto& tree, uint64_t first, uint64_t last, uint64_t start) {
+    auto res = tree.Query(start, std::numeric_limits<uint64_t>::max());
+    REQUIRE(res.has_value());
+    const uint64_t oldest = std::max(first, start < 5 ? 0 : (start - 5 + 9) / 10);
+    REQUIRE(res->size() == last - oldest + 1);
+    for (std::size_t i = 0; i < res->size(); ++i) {
+      CHECK(res->at(i).start == (oldest + i) * 10);
+    }
+  };
+
+  TimeTree<8> tree;
+  for (uint64_t i = 1; i <= 5'000; ++i) {
+    tree.Insert(i * 10, i * 10 + 5, i);
+  }
+  linked(tree);
+
+  SUBCASE("Starts in the newest leafs") {
+    for (uint64_t start = 49'000; start <= 50'005; start += 3) {
+      tail(tree, 1, 5'000, start);
+    }
+    // Too far back for the walk, the descent takes over
+    tail(tree, 1, 5'000, 10'000);
+    CHECK(tree.Query(49'950, 49'990)->size() == 5);
+  };
+
+  SUBCASE("Links survive rewrites") {
+    tree.SetLateBufferLimit(2);
+    tree.Insert(49'001, 49'002, 1);
+    tree.Insert(49'101, 49'102, 1);
+    CHECK(tree.GetLateEntryCount() == 0);
+    linked(tree);
+    CHECK(tree.Query(49'000, 49'110)->size() == 14);
+
+    std::vector<TimeRange_t> removed;
+    tree.Aggregate(20'000, removed);
+    tree.Aggregate(20'000, removed);
+    linked(tree);
+    tree.DropBefore(10'000, [](const TimeRange_t&) {});
+    linked(tree);
+    tree.SetLeafCompression(true);
+    linked(tree);
+    for (uint64_t start = 49'500; start <= 50'005; start += 7) {
+      CHECK(tree.Query(start, std::numeric_limits<uint64_t>::max())->size() == tree.Query(start, 60'000)->size());
+    }
+  };
+
+  SUBCASE("Bulk loads and checkpoints") {
+    std::vector<TimeRange_t> ranges;
+    for (uint64_t i = 1; i <= 5'000; ++i) {
+      ranges.push_back({i * 10, i * 10 + 5, i});
+    }
+    auto loaded = TimeTree<8>::BulkLoad(ranges);
+    REQUIRE(loaded.has_value());
+    linked(*loaded);
+    tail(*loaded, 1, 5'000, 49'500);
+
+    const std::string path = (std::filesystem::temp_directory_path() / "timetree-tail-test").string();
+    REQUIRE(tree.Save(path).has_value());
+    auto restored = TimeTree<8>::Load(path);
+    REQUIRE(restored.has_value());
+    linked(*restored);
+    tail(*restored, 1, 5'000, 49'500);
+    std::filesystem::remove(path);
+  };
+}
+
+TEST_CASE("Newest first") {
+  // Stepping back from end() visits the nodes of the forward walk in reverse
+  auto reversed = [](auto& tree) {
+    std::vector<TimeTreeNode<8>*> forward;
+    for (auto& node : tree) {
+      forward.push_back(&node);
+    }
+    std::vector<TimeTreeNode<8>*> backward;
+    for (auto it = tree.end(); it != tree.begin();) {
+      --it;
+      backward.push_back(&*it);
+    }
+    std::reverse(backward.begin(), backward.end());
+    CHECK(forward == backward);
+  };
+  // QueryLatest() is the tail of Query(0, before) in reverse
+  auto latest = [](const auto& tree, std::size_t n, uint64_t before) {
+    auto all = tree.Query(0, before);
+    auto res = tree.QueryLatest(n, before);
+    if (!all) {
+      CHECK_FALSE(res.has_value());
+      return;
+    }
+    REQUIRE(res.has_value());
+    std::vector<TimeRange_t> expected(all->rbegin(), all->rend());
+    expected.resize(std::min(n, expected.size()));
+    REQUIRE(res->size() == expected.size());
+    for (std::size_t i = 0; i < expected.size(); ++i) {
+      CHECK(res->at(i).start == expected[i].start);
+      CHECK(res->at(i).end == expected[i].end);
+      CHECK(res->at(i).ptr == expected[i].ptr);
+    }
+  };
+  auto sweep = [&latest](const auto& tree) {
+    for (std::size_t n : {1, 7, 8, 100, 1'000, 100'000}) {
+      for (uint64_t before : {uint64_t{0}, uint64_t{9}, uint64_t{10}, uint64_t{12'345}, uint64_t{20'003},
+                              uint64_t{49'996}, uint64_t{50'000}, std::numeric_limits<uint64_t>::max()}) {
+        latest(tree, n, before);
+      }
+    }
+  };
+
+  TimeTree<8> tree;
+  for (uint64_t i = 1; i <= 5'000; ++i) {
+    tree.Insert(i * 10, i * 10 + 5, i);
+  }
+
+  SUBCASE("Walks back from the newest entry") {
+    reversed(tree);
+    sweep(tree);
+    auto res = tree.QueryLatest(3);
+    REQUIRE(res.has_value());
+    REQUIRE(res->size() == 3);
+    CHECK(res->at(0).start == 50'000);
+    CHECK(res->at(2).start == 49'980);
+    CHECK(tree.QueryLatest(0)->empty());
+    CHECK(tree.QueryLatest(1, 9).error() == Errors_e::RANGE_NOT_IN_DB);
+  };
+
+  SUBCASE("Late entries are interleaved") {
+    tree.SetLateBufferLimit(1'000);
+    tree.Insert(49'991, 49'992, 1);
+    tree.Insert(20'000, 20'001, 2);
+    tree.Insert(5, 6, 3);
+    REQUIRE(tree.GetLateEntryCount() == 3);
+    sweep(tree);
+    auto res = tree.QueryLatest(3, 49'995);
+    REQUIRE(res.has_value());
+    CHECK(res->at(0).start == 49'991);
+    CHECK(res->at(1).start == 49'990);
+    CHECK(tree.QueryLatest(1, 7)->at(0).start == 5);
+  };
+
+  SUBCASE("Collapsed nodes before the oldest leaf") {
+    std::vector<TimeRange_t> removed;
+    tree.Aggregate(20'000, removed, 1);
+    tree.Aggregate(10'000, removed);
+    tree.Aggregate(10'000, removed);
+    tree.Aggregate(5'000, removed);
+    reversed(tree);
+    sweep(tree);
+    tree.DropBefore(3'000, [](const TimeRange_t&) {});
+    reversed(tree);
+    sweep(tree);
+  };
+
+  SUBCASE("Inner nodes left with collapsed children only") {
+    std::vector<TimeRange_t> removed;
+    tree.Aggregate(30'000, removed);
+    tree.Aggregate(30'000, removed);
+    tree.Aggregate(15'000, removed);
+    reversed(tree);
+    sweep(tree);
+  };
+
+  SUBCASE("Compressed and sealed leafs") {
+    tree.SetLeafCompression(true);
+    tree.Seal();
+    reversed(tree);
+    sweep(tree);
+  };
+}
+
+TEST_CASE("As of lookups") {
+  // AsOf() is the first entry of QueryLatest(1, t)
+  auto asOf = [](const auto& tree, uint64_t last) {
+    for (uint64_t t = 0; t <= last; t += 3) {
+      auto found = tree.AsOf(t);
+      auto latest = tree.QueryLatest(1, t);
+      REQUIRE(found.has_value() == latest.has_value());
+      if (found) {
+        CHECK(found->start == latest->front().start);
+        CHECK(found->end == latest->front().end);
+        CHECK(found->ptr == latest->front().ptr);
+      }
+    }
+  };
+
+  TimeTree<8> tree;
+  CHECK_FALSE(tree.AsOf(10).has_value());
+  for (uint64_t i = 1; i <= 2'000; ++i) {
+    tree.Insert(i * 10, i * 10 + 5, i);
+  }
+
+  SUBCASE("Holding or before t") {
+    CHECK_FALSE(tree.AsOf(9).has_value());
+    CHECK(tree.AsOf(10)->ptr == 1);
+    CHECK(tree.AsOf(12'345)->ptr == 1'234);
+    CHECK(tree.AsOf(12'348)->ptr == 1'234);
+    CHECK(tree.AsOf(std::numeric_limits<uint64_t>::max())->ptr == 2'000);
+    asOf(tree, 20'010);
+  };
+
+  SUBCASE("Late entries, collapsed and compressed nodes") {
+    tree.SetLateBufferLimit(1'000);
+    tree.Insert(12'346, 12'347, 3'000);
+    tree.Insert(15'000, 15'001, 3'001);
+    CHECK(tree.AsOf(12'348)->ptr == 3'000);
+    CHECK(tree.AsOf(15'000)->ptr == 3'001);
+    asOf(tree, 20'010);
+    std::vector<TimeRange_t> removed;
+    tree.Aggregate(8'000, removed);
+    tree.Aggregate(4'000, removed);
+    tree.SetLeafCompression(true);
+    asOf(tree, 20'010);
+  };
+
+  SUBCASE("Equal starts across leafs") {
+    TimeTree<8> repeated;
+    for (uint64_t i = 0; i < 1'000; ++i) {
+      repeated.Insert(100 + i / 20 * 10, 100 + i / 20 * 10 + 5, i);
+    }
+    CHECK(repeated.AsOf(100)->ptr == 19);
+    asOf(repeated, 700);
+  };
+}
+
+TEST_CASE("Batched queries") {
+  // Every window holds what a query of its own returns, windows outside the tree are empty
+  auto many = [](const auto& tree, const std::vector<std::pair<uint64_t, uint64_t>>& windows) {
+    std::vector<TimeRange_t> out;
+    std::vector<std::size_t> offsets;
+    REQUIRE(tree.QueryMany(windows, out, offsets).has_value());
+    REQUIRE(offsets.size() == windows.size() + 1);
+    CHECK(offsets.back() == out.size());
+    for (std::size_t i = 0; i < windows.size(); ++i) {
+      auto single = tree.Query(windows[i].first, windows[i].second);
+      const std::size_t count = single ? single->size() : 0;
+      REQUIRE(offsets[i + 1] - offsets[i] == count);
+      for (std::size_t j = 0; j < count; ++j) {
+        CHECK(out[offsets[i] + j].start == single->at(j).start);
+        CHECK(out[offsets[i] + j].ptr == single->at(j).ptr);
+      }
+    }
+  };
+  // Each hour of a day, a few windows inside a single leaf, and windows sharing their starts
+  std::vector<std::pair<uint64_t, uint64_t>> windows;
+  for (uint64_t hour = 0; hour < 24; ++hour) {
+    windows.emplace_back(hour * 2'000, hour * 2'000 + 999);
+  }
+  windows.emplace_back(48'000, 48'001);
+  windows.emplace_back(48'003, 48'004);
+  windows.emplace_back(48'007, 48'100);
+  windows.emplace_back(48'007, 48'008);
+  windows.emplace_back(49'990, 60'000);
+  windows.emplace_back(70'000, 80'000);
+
+  TimeTree<8> tree;
+  for (uint64_t i = 1; i <= 5'000; ++i) {
+    tree.Insert(i * 10, i * 10 + 5, i);
+  }
+
+  SUBCASE("Matches single queries") {
+    many(tree, windows);
+    many(tree, {});
+    many(tree, {{0, std::numeric_limits<uint64_t>::max()}});
+    std::vector<TimeRange_t> out;
+    std::vector<std::size_t> offsets;
+    CHECK(tree.QueryMany(std::vector<std::pair<uint64_t, uint64_t>>{{20, 10}}, out, offsets).error()
+          == Errors_e::INVALID_TIME_RANGE);
+    CHECK(tree.QueryMany(std::vector<std::pair<uint64_t, uint64_t>>{{20, 30}, {10, 30}}, out, offsets).error()
+          == Errors_e::INVALID_TIME_RANGE);
+  };
+
+  SUBCASE("Late entries, collapsed and compressed nodes") {
+    tree.SetLateBufferLimit(1'000);
+    tree.Insert(2'001, 2'002, 6'000);
+    tree.Insert(48'002, 48'003, 6'001);
+    tree.Insert(75'000, 75'001, 6'002);
+    REQUIRE(tree.GetLateEntryCount() == 2);
+    many(tree, windows);
+    std::vector<TimeRange_t> removed;
+    tree.Aggregate(20'000, removed);
+    tree.Aggregate(10'000, removed);
+    tree.SetLeafCompression(true);
+    many(tree, windows);
+  };
+}
+
+TEST_CASE("Counting queries") {
+  // Count() matches the count of AggregateQuery(), Any() whether Query() finds anything
+  auto counts = [](const auto& tree) {
+    for (uint64_t start = 0; start <= 52'000; start += 997) {
+      for (uint64_t width : {0, 4, 5, 63, 1'000, 30'000}) {
+        const uint64_t end = start + width;
+        auto summary = tree.AggregateQuery(start, end);
+        auto query = tree.Query(start, end);
+        CHECK(*tree.Count(start, end) == (summary ? summary->count : 0));
+        CHECK(tree.Any(start, end) == (query.has_value() && !query->empty()));
+      }
+    }
+  };
+
+  TimeTree<8> tree;
+  CHECK(*tree.Count(0, 100) == 0);
+  CHECK_FALSE(tree.Any(0, 100));
+  for (uint64_t i = 1; i <= 5'000; ++i) {
+    tree.Insert(i * 10, i * 10 + 5, i);
+  }
+
+  SUBCASE("Without copying entries") {
+    CHECK(*tree.Count(0, std::numeric_limits<uint64_t>::max()) == 5'000);
+    CHECK(*tree.Count(10'000, 19'999) == 1'000);
+    CHECK(*tree.Count(10'006, 10'009) == 0);
+    CHECK(*tree.Count(10'005, 10'010) == 2);
+    CHECK(tree.Count(20, 10).error() == Errors_e::INVALID_TIME_RANGE);
+    CHECK(tree.Any(10'005, 10'005));
+    CHECK_FALSE(tree.Any(10'006, 10'009));
+    CHECK_FALSE(tree.Any(60'000, 70'000));
+    CHECK_FALSE(tree.Any(20, 10));
+    counts(tree);
+  };
+
+  SUBCASE("Late entries, collapsed and compressed nodes") {
+    tree.SetLateBufferLimit(1'000);
+    tree.Insert(10'007, 10'008, 6'000);
+    CHECK(*tree.Count(10'006, 10'009) == 1);
+    CHECK(tree.Any(10'006, 10'009));
+    counts(tree);
+    std::vector<TimeRange_t> removed;
+    tree.Aggregate(20'000, removed);
+    tree.Aggregate(10'000, removed);
+    // Collapsed nodes still count every entry they replaced
+    CHECK(*tree.Count(0, 19'999) == 2'000);
+    tree.SetLeafCompression(true);
+    counts(tree);
+  };
+}
+
+TEST_CASE("Parallel queries") {
+  // Same entries in the same order as a serial query
+  auto parallel = [](const auto& tree, ThreadPool& pool) {
+    for (uint64_t start = 0; start <= 52'000; start += 4'999) {
+      for (uint64_t width : {0, 5, 700, 20'000, 60'000}) {
+        auto serial = tree.Query(start, start + width);
+        auto split = tree.ParallelQuery(start, start + width, pool);
+        REQUIRE(serial.has_value() == split.has_value());
+        if (!serial) {
+          CHECK(serial.error() == split.error());
+          continue;
+        }
+        REQUIRE(serial->size() == split->size());
+        for (std::size_t i = 0; i < serial->size(); ++i) {
+          CHECK(serial->at(i).start == split->at(i).start);
+          CHECK(serial->at(i).ptr == split->at(i).ptr);
+        }
+      }
+    }
+  };
+
+  ThreadPool pool(4);
+  TimeTree<8> tree;
+  for (uint64_t i = 1; i <= 5'000; ++i) {
+    tree.Insert(i * 10, i * 10 + 5, i);
+  }
+
+  SUBCASE("Matches serial queries") {
+    parallel(tree, pool);
+    ThreadPool single(1);
+    parallel(tree, single);
+    CHECK(tree.ParallelQuery(20, 10, pool).error() == Errors_e::INVALID_TIME_RANGE);
+    CHECK(tree.ParallelQuery(60'000, 70'000, pool).error() == Errors_e::RANGE_NOT_IN_DB);
+    CHECK(tree.ParallelQuery(0, std::numeric_limits<uint64_t>::max(), pool)->size() == 5'000);
+  };
+
+  SUBCASE("Late entries, collapsed and compressed nodes") {
+    tree.SetLateBufferLimit(1'000);
+    // Late entries sharing their start with entries from the leafs, at the edges of leafs and of the tree
+    for (uint64_t start : {5, 80, 160, 10'240, 10'245, 25'600, 49'990}) {
+      tree.Insert(start, start + 1, 6'000 + start);
+    }
+    REQUIRE(tree.GetLateEntryCount() == 7);
+    parallel(tree, pool);
+    CHECK(tree.ParallelQuery(0, 9, pool)->size() == 1);
+    std::vector<TimeRange_t> removed;
+    tree.Aggregate(20'000, removed);
+    tree.Aggregate(10'000, removed);
+    tree.SetLeafCompression(true);
+    parallel(tree, pool);
+  };
+}
+
+TEST_CASE("Key search kernels") {
+  std::vector<uint64_t> keys;
+  for (uint64_t i = 0; i < 67; ++i) {
+    keys.push_back(i * 3 + 1);
+  }
+  // Values beyond the signed range must still compare as unsigned
+  keys.push_back(std::numeric_limits<uint64_t>::max() - 1);
+
+  const simd::Kernel_e best = simd::GetKernel();
+  for (simd::Kernel_e kernel : {simd::SCALAR, simd::SSE42, simd::AVX2}) {
+    simd::SetKernel(kernel);
+    for (std::size_t count = 0; count <= keys.size(); ++count) {
+      for (uint64_t value : {uint64_t{0}, uint64_t{1}, uint64_t{2}, uint64_t{30}, uint64_t{31}, uint64_t{200},
+                             std::numeric_limits<uint64_t>::max() - 1, std::numeric_limits<uint64_t>::max()}) {
+        CHECK(
+            simd::FirstGreaterEqual(keys.data(), count, value)
+            == simd::FirstGreaterEqualScalar(keys.data(), count, value));
+      }
+    }
+    CHECK(simd::FirstGreater(keys.data(), keys.size(), 31) == 11);
+    CHECK(simd::FirstGreater(keys.data(), keys.size(), std::numeric_limits<uint64_t>::max()) == keys.size());
+  }
+  simd::SetKernel(best);
+
+  SUBCASE("Queries match across kernels") {
+    TimeTree<128> tree;
+    for (int i = 1; i <= 100000; ++i) {
+      tree.Insert(i * 2, i * 2 + 1, i);
+    }
+    for (simd::Kernel_e kernel : {simd::SCALAR, simd::SSE42, simd::AVX2}) {
+      simd::SetKernel(kernel);
+      auto qRes = tree.Query(1001, 50000);
+      CHECK(qRes.has_value());
+      CHECK(qRes->size() == 24501);
+      CHECK(qRes->front().start == 1000);
+      CHECK(qRes->back().start == 50000);
+    }
+    simd::SetKernel(best);
+
+    // Starting before the oldest entry clamps to the first leaf
+    auto qRes = tree.Query(0, 9);
+    CHECK(qRes.has_value());
+    CHECK(qRes->size() == 4);
+  };
+}
+
+TEST_CASE("Batched insertion") {
+  std::vector<TimeRange_t> batch;
+  for (uint64_t i = 1; i <= 1000; ++i) {
+    batch.push_back({i * 10, i * 10 + 5, i});
+  }
+
+  TimeTree<8, 4> single;
+  for (const TimeRange_t& range : batch) {
+    CHECK(single.Insert(range.start, range.end, range.ptr).has_value());
+  }
+
+  TimeTree<8, 4> batched;
+  // Uneven slices so batches start and end in the middle of leafs
+  std::span<const TimeRange_t> rest(batch);
+  while (!rest.empty()) {
+    const std::size_t count = std::min<std::size_t>(rest.size(), 37);
+    auto res = batched.InsertBatch(rest.first(count));
+    CHECK(res.has_value());
+    CHECK(*res == count);
+    rest = rest.subspan(count);
+  }
+
+  CHECK(batched.GetHeight() == single.GetHeight());
+  CHECK(batched.GetNumberLeafs() == single.GetNumberLeafs());
+  CHECK(batched.GetRoot()->GetNodeStart() == 10);
+  CHECK(batched.GetRoot()->GetNodeEnd() == 10005);
+
+  for (auto [a, b] : std::vector<std::pair<uint64_t, uint64_t>>{{10, 10005}, {333, 4444}, {5000, 5001}, {0, 97}}) {
+    auto expected = single.Query(a, b);
+    auto actual = batched.Query(a, b);
+    CHECK(expected.has_value());
+    CHECK(actual.has_value());
+    CHECK(expected->size() == actual->size());
+    for (std::size_t i = 0; i < std::min(expected->size(), actual->size()); ++i) {
+      CHECK(expected->at(i).start == actual->at(i).start);
+      CHECK(expected->at(i).ptr == actual->at(i).ptr);
+    }
+  }
+
+  SUBCASE("Invalid entries reject the whole batch") {
+    const std::vector<TimeRange_t> bad{{20000, 20001, 0}, {20003, 20002, 0}};
+    CHECK(batched.InsertBatch(bad) == tl::unexpected(Errors_e::INVALID_TIME_RANGE));
+    CHECK(batched.Insert(20003, 20002, 0) == tl::unexpected(Errors_e::INVALID_TIME_RANGE));
+    CHECK(batched.GetRoot()->GetNodeEnd() == 10005);
+    CHECK(batched.InsertBatch({}).value() == 0);
+  };
+}
+
+TEST_CASE("Bulk loading") {
+  std::vector<TimeRange_t> ranges;
+  for (uint64_t i = 1; i <= 5000; ++i) {
+    ranges.push_back({i * 2, i * 2 + 1, i});
+  }
+
+  for (std::size_t threads : {1, 4}) {
+    TimeTree<8, 4> inserted;
+    for (const TimeRange_t& range : ranges) {
+      inserted.Insert(range.start, range.end, range.ptr);
+    }
+
+    auto loaded = TimeTree<8, 4>::BulkLoad(ranges, threads);
+    CHECK(loaded.has_value());
+    CHECK(loaded->GetHeight() == inserted.GetHeight());
+    CHECK(loaded->GetNumberLeafs() == inserted.GetNumberLeafs());
+    CHECK(loaded->GetRoot()->GetNodeStart() == 2);
+    CHECK(loaded->GetRoot()->GetNodeEnd() == 10001);
+
+    // Every level is linked left to right
+    for (const auto& level : loaded->Data()) {
+      for (std::size_t i = 0; i + 1 < level.size(); ++i) {
+        CHECK(level[i]->GetLink() == level[i + 1]);
+      }
+      CHECK(level.back()->GetLink() == nullptr);
+    }
+
+    auto qRes = loaded->Query(777, 8888);
+    auto expected = inserted.Query(777, 8888);
+    CHECK(qRes.has_value());
+    CHECK(qRes->size() == expected->size());
+    CHECK(qRes->front().ptr == expected->front().ptr);
+    CHECK(qRes->back().ptr == expected->back().ptr);
+
+    // Regular inserts carry on from the loaded tree
+    for (uint64_t i = 5001; i <= 6000; ++i) {
+      loaded->Insert(i * 2, i * 2 + 1, i);
+      inserted.Insert(i * 2, i * 2 + 1, i);
+    }
+    CHECK(loaded->GetHeight() == inserted.GetHeight());
+    CHECK(loaded->GetNumberLeafs() == inserted.GetNumberLeafs());
+    CHECK(loaded->Query(9000, 12001)->size() == 1501);
+  }
+
+  SUBCASE("Edge cases") {
+    auto empty = TimeTree<8>::BulkLoad({});
+    CHECK(empty.has_value());
+    CHECK(empty->GetHeight() == 1);
+
+    const std::vector<TimeRange_t> unsorted{{5, 6, 0}, {1, 2, 0}};
+    CHECK(TimeTree<8>::BulkLoad(unsorted) == tl::unexpected(Errors_e::INVALID_TIME_RANGE));
+    const std::vector<TimeRange_t> invalid{{5, 4, 0}};
+    CHECK(TimeTree<8>::BulkLoad(invalid) == tl::unexpected(Errors_e::INVALID_TIME_RANGE));
+
+    const std::vector<TimeRange_t> single{{5, 6, 7}};
+    auto tree = TimeTree<8>::BulkLoad(single);
+    CHECK(tree->GetHeight() == 1);
+    CHECK(tree->Query(5, 5)->front().ptr == 7);
+  };
+}
+
+TEST_CASE("Streaming queries") {
+  TimeTree<4> tree;
+  for (uint64_t i = 10; i <= 1000; i += 10) {
+    tree.Insert(i, i + 5, i / 10);
+  }
+
+  for (auto [a, b] : std::vector<std::pair<uint64_t, uint64_t>>{{10, 1005}, {45, 55}, {47, 48}, {0, 12}, {999, 1500}}) {
+    auto expected = tree.Query(a, b);
+
+    std::vector<TimeRange_t> visited;
+    auto res = tree.QueryVisit(a, b, [&visited](const TimeRange_t& range) { visited.push_back(range); });
+    CHECK(res.has_value());
+
+    auto range = tree.QueryRange(a, b);
+    CHECK(range.has_value());
+    std::vector<TimeRange_t> iterated;
+    for (const TimeRange_t entry : *range) {
+      iterated.push_back(entry);
+    }
+
+    CHECK(expected.has_value());
+    CHECK(visited.size() == expected->size());
+    CHECK(iterated.size() == expected->size());
+    for (std::size_t i = 0; i < std::min({expected->size(), visited.size(), iterated.size()}); ++i) {
+      CHECK(visited[i].ptr == expected->at(i).ptr);
+      CHECK(iterated[i].ptr == expected->at(i).ptr);
+    }
+  }
+
+  // The query end falls in the gap between two entries
+  CHECK(tree.Query(47, 48)->empty());
+  auto gap = tree.QueryRange(47, 48);
+  CHECK(gap->begin() == gap->end());
+
+  CHECK(tree.QueryVisit(2, 1, [](const TimeRange_t&) {}) == tl::unexpected(Errors_e::INVALID_TIME_RANGE));
+  CHECK(tree.QueryRange(2000, 2001) == tl::unexpected(Errors_e::RANGE_NOT_IN_DB));
+
+  SUBCASE("Collapsed nodes") {
+    std::vector<TimeRange_t> removed;
+    tree.Aggregate(200, removed);
+    std::size_t count = 0;
+    auto range = tree.QueryRange(10, 205);
+    CHECK(range.has_value());
+    for (const TimeRange_t entry : *range) {
+      CHECK(entry.start <= 205);
+      ++count;
+    }
+    CHECK(count == tree.Query(10, 205)->size());
+  };
+
+  SUBCASE("Long leaf chains") {
+    // Half a million leafs, walking them must not depend on stack depth
+    TimeTree<2> deep;
+    for (uint64_t i = 1; i <= 1'000'000; ++i) {
+      deep.Insert(i, i, i);
+    }
+    uint64_t sum = 0;
+    CHECK(deep.QueryVisit(1, 1'000'000, [&sum](const TimeRange_t& range) { sum += range.ptr; }).has_value());
+    CHECK(sum == 500'000'500'000);
+    CHECK(deep.Query(1, 1'000'000)->size() == 1'000'000);
+  };
+}
+
+TEST_CASE("Late insertion") {
+  TimeTree<4> tree;
+  tree.SetLateBufferLimit(8);
+  std::vector<uint64_t> starts;
+  // Every fifth entry arrives 37 units late
+  for (uint64_t i = 100; i <= 1000; i += 10) {
+    if (i % 50 == 0) {
+      continue;
+    }
+    tree.Insert(i, i + 5, i);
+    starts.push_back(i);
+    if (i % 50 == 30 && i > 130) {
+      CHECK(tree.Insert(i - 30, i - 25, i - 30).has_value());
+      starts.push_back(i - 30);
+    }
+  }
+  std::sort(starts.begin(), starts.end());
+
+  auto checkOrder = [&starts](const std::vector<TimeRange_t>& ranges) {
+    REQUIRE(ranges.size() == starts.size());
+    for (std::size_t i = 0; i < ranges.size(); ++i) {
+      CHECK(ranges[i].start == starts[i]);
+    }
+  };
+
+  SUBCASE("Buffered entries are visible to queries") {
+    CHECK(tree.GetLateEntryCount() != 0);
+    auto res = tree.Query(0, 2000);
+    CHECK(res.has_value());
+    checkOrder(*res);
+
+    // A window holding only a buffered entry
+    auto late = tree.Query(950, 952);
+    CHECK(late.has_value());
+    CHECK(late->size() == 1);
+  };
+
+  SUBCASE("Flushing merges into the leafs") {
+    tree.FlushLateEntries();
+    CHECK(tree.GetLateEntryCount() == 0);
+    std::vector<TimeRange_t> leafs;
+    for (auto* leaf : tree.Data().front()) {
+      for (const TimeRange_t range : leaf->GetData()) {
+        leafs.push_back(range);
+      }
+    }
+    checkOrder(leafs);
+
+    auto range = tree.QueryRange(0, 2000);
+    std::size_t count = 0;
+    for (const TimeRange_t entry : *range) {
+      CHECK(entry.start == starts[count]);
+      ++count;
+    }
+    CHECK(count == starts.size());
+  };
+
+  SUBCASE("Late entry before every leaf") {
+    CHECK(tree.Insert(1, 2, 1).has_value());
+    tree.FlushLateEntries();
+    CHECK(tree.GetRoot()->GetNodeStart() == 1);
+    CHECK(tree.Query(0, 2000)->size() == starts.size() + 1);
+    CHECK(tree.Insert(2000, 2001, 0).has_value());
+    CHECK(tree.Query(1990, 2010)->size() == 1);
+  };
+
+  SUBCASE("Batches with late entries") {
+    TimeTree<4> batched;
+    std::vector<TimeRange_t> batch;
+    for (uint64_t i = 100; i <= 1000; i += 10) {
+      batch.push_back({i, i + 5, i});
+      if (i % 70 == 0) {
+        batch.push_back({i - 65, i - 64, i - 65});
+      }
+    }
+    CHECK(*batched.InsertBatch(batch) == batch.size());
+    batched.FlushLateEntries();
+    std::vector<TimeRange_t> leafs;
+    for (auto* leaf : batched.Data().front()) {
+      for (const TimeRange_t range : leaf->GetData()) {
+        leafs.push_back(range);
+      }
+    }
+    CHECK(leafs.size() == batch.size());
+    CHECK(std::is_sorted(leafs.begin(), leafs.end(), [](const TimeRange_t& a, const TimeRange_t& b) {
+      return a.start < b.start;
+    }));
+  };
+
+  SUBCASE("Aggregated ranges are closed") {
+    std::vector<TimeRange_t> removed;
+    tree.Aggregate(300, removed);
+    CHECK(tree.Insert(150, 151, 0) == tl::unexpected(Errors_e::RANGE_AGGREGATED));
+  };
+
+  SUBCASE("Large buffers") {
+    // Enough late entries for readers to see them spread over many chunks
+    TimeTree<8> large;
+    large.SetLateBufferLimit(10'000);
+    std::vector<TimeRange_t> expected;
+    for (uint64_t i = 1; i <= 10'000; ++i) {
+      large.Insert(i * 10, i * 10 + 1, i);
+      expected.push_back({i * 10, i * 10 + 1, i});
+    }
+    auto lateInsert = [&large, &expected](uint64_t start) {
+      REQUIRE(large.Insert(start, start, start).has_value());
+      expected.push_back({start, start, start});
+    };
+    for (uint64_t i = 0; i < 3'000; ++i) {
+      lateInsert((i * 7'919) % 99'000 + 5);
+    }
+    large.DropBefore(1'000, [&expected](const TimeRange_t& range) {
+      std::erase_if(expected, [&range](const TimeRange_t& entry) {
+        return entry.start == range.start && entry.ptr == range.ptr;
+      });
+    });
+    for (uint64_t i = 0; i < 3'000; ++i) {
+      lateInsert((i * 104'729) % 98'000 + 1'003);
+    }
+    REQUIRE(large.GetLateEntryCount() > 5'000);
+    std::stable_sort(expected.begin(), expected.end(), [](const TimeRange_t& a, const TimeRange_t& b) {
+      return a.start < b.start;
+    });
+
+    auto res = large.Query(0, 200'000);
+    REQUIRE(res.has_value());
+    REQUIRE(res->size() == expected.size());
+    for (std::size_t i = 0; i < expected.size(); ++i) {
+      CHECK(res->at(i).start == expected[i].start);
+    }
+    {
+      auto range = large.QueryRange(25'000, 30'000);
+      REQUIRE(range.has_value());
+      CHECK(static_cast<uint64_t>(std::distance(range->begin(), range->end())) == *large.Count(25'000, 30'000));
+    }
+    auto latest = large.QueryLatest(5'000);
+    REQUIRE(latest.has_value());
+    REQUIRE(latest->size() == 5'000);
+    for (std::size_t i = 0; i < latest->size(); ++i) {
+      CHECK(latest->at(i).start == expected[expected.size() - 1 - i].start);
+    }
+    for (uint64_t t : {1'003, 1'004, 45'678, 99'999}) {
+      auto last = std::upper_bound(expected.begin(), expected.end(), t, [](uint64_t value, const TimeRange_t& entry) {
+        return value < entry.start;
+      });
+      CHECK(large.AsOf(t)->start == std::prev(last)->start);
+    }
+    CHECK(large.AggregateQuery(0, 200'000)->count == expected.size());
+
+    large.FlushLateEntries();
+    CHECK(large.Query(0, 200'000)->size() == expected.size());
+  };
+}
+
+TEST_CASE("Checkpoints") {
+  const std::string path = (std::filesystem::temp_directory_path() / "timetree-checkpoint-test").string();
+
+  auto collect = [](auto& tree) {
+    std::vector<TimeRange_t> entries;
+    CHECK(tree.QueryVisit(0, 100'000, [&entries](const TimeRange_t& range) { entries.push_back(range); }));
+    return entries;
+  };
+  auto checkSame = [&collect](auto& expected, auto& loaded) {
+    CHECK(loaded.GetHeight() == expected.GetHeight());
+    CHECK(loaded.GetNumberLeafs() == expected.GetNumberLeafs());
+    CHECK(loaded.GetRoot()->GetNodeStart() == expected.GetRoot()->GetNodeStart());
+    CHECK(loaded.GetRoot()->GetNodeEnd() == expected.GetRoot()->GetNodeEnd());
+    const auto want = collect(expected);
+    const auto got = collect(loaded);
+    REQUIRE(got.size() == want.size());
+    for (std::size_t i = 0; i < want.size(); ++i) {
+      CHECK(got[i].start == want[i].start);
+      CHECK(got[i].end == want[i].end);
+      CHECK(got[i].ptr == want[i].ptr);
+    }
+  };
+
+  TimeTree<4, 3> tree;
+  for (uint64_t i = 10; i <= 10'000; i += 10) {
+    tree.Insert(i, i + 5, i / 10);
+  }
+
+  SUBCASE("Round trip") {
+    for (std::size_t threads : {1, 3, 8}) {
+      CHECK(tree.Save(path).has_value());
+      CHECK(!std::filesystem::exists(path + ".tmp"));
+      auto loaded = TimeTree<4, 3>::Load(path, threads);
+      REQUIRE(loaded.has_value());
+      checkSame(tree, *loaded);
+
+      // The restored tree keeps taking inserts
+      CHECK(loaded->Insert(10'010, 10'011, 7).has_value());
+      CHECK(loaded->Query(10'009, 10'012)->size() == 1);
+      CHECK(loaded->Query(5'000, 6'000)->size() == tree.Query(5'000, 6'000)->size());
+    }
+  };
+
+  SUBCASE("Late entries and collapsed nodes") {
+    tree.Insert(9'995, 9'996, 42);
+    std::vector<TimeRange_t> removed;
+    tree.Aggregate(2'000, removed);
+    CHECK(tree.Save(path).has_value());
+    auto loaded = TimeTree<4, 3>::Load(path, 2);
+    REQUIRE(loaded.has_value());
+    CHECK(loaded->GetLateEntryCount() == tree.GetLateEntryCount());
+    checkSame(tree, *loaded);
+    CHECK(loaded->Insert(100, 101, 0) == tl::unexpected(Errors_e::RANGE_AGGREGATED));
+  };
+
+  SUBCASE("Empty tree") {
+    TimeTree<4, 3> empty;
+    CHECK(empty.Save(path).has_value());
+    auto loaded = TimeTree<4, 3>::Load(path);
+    REQUIRE(loaded.has_value());
+    CHECK(loaded->GetHeight() == 1);
+    CHECK(loaded->Insert(1, 2, 3).has_value());
+    CHECK(loaded->Query(0, 5)->size() == 1);
+  };
+
+  SUBCASE("Rejected checkpoints") {
+    CHECK(tree.Save(path).has_value());
+    CHECK(TimeTree<4>::Load(path) == tl::unexpected(Errors_e::INVALID_CHECKPOINT));
+    CHECK(TimeTree<8, 3>::Load(path) == tl::unexpected(Errors_e::INVALID_CHECKPOINT));
+
+    // Overwrites a field of the saved checkpoint in place
+    auto corrupt = [&path](std::size_t offset, auto value) {
+      std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+      file.seekp(static_cast<std::streamoff>(offset));
+      file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    };
+    const std::size_t countOffset = sizeof(checkpoint::Header_t) + offsetof(checkpoint::NodeRecord_t, count);
+    const std::size_t innerOffset =
+        sizeof(checkpoint::Header_t) + tree.GetNumberLeafs() * sizeof(checkpoint::LeafRecord_t<4>);
+    corrupt(countOffset, uint32_t{5});
+    CHECK(TimeTree<4, 3>::Load(path) == tl::unexpected(Errors_e::INVALID_CHECKPOINT));
+    CHECK(tree.Save(path).has_value());
+    corrupt(innerOffset + offsetof(checkpoint::InnerRecord_t<3>, firstChild), uint64_t{tree.GetNumberLeafs()});
+    CHECK(TimeTree<4, 3>::Load(path) == tl::unexpected(Errors_e::INVALID_CHECKPOINT));
+    CHECK(tree.Save(path).has_value());
+    corrupt(innerOffset + offsetof(checkpoint::InnerRecord_t<3>, node.count), uint32_t{4});
+    CHECK(TimeTree<4, 3>::Load(path) == tl::unexpected(Errors_e::INVALID_CHECKPOINT));
+    CHECK(tree.Save(path).has_value());
+    CHECK(TimeTree<4, 3>::Load(path).has_value());
+
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) - 8);
+    CHECK(TimeTree<4, 3>::Load(path) == tl::unexpected(Errors_e::INVALID_CHECKPOINT));
+    std::filesystem::remove(path);
+    CHECK(TimeTree<4, 3>::Load(path) == tl::unexpected(Errors_e::IO_ERROR));
+  };
+
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("Memory mapped trees") {
+  const std::string path = (std::filesystem::temp_directory_path() / "timetree-mapped-test").string();
+
+  TimeTree<4, 3> tree;
+  for (uint64_t i = 10; i <= 10'000; i += 10) {
+    tree.Insert(i, i + 5, i / 10);
+  }
+
+  auto checkSame = [&tree, &path] {
+    REQUIRE(tree.Save(path).has_value());
+    auto mapped = MappedTimeTree<4, 3>::Open(path);
+    REQUIRE(mapped.has_value());
+    CHECK(mapped->GetHeight() == tree.GetHeight());
+    CHECK(mapped->GetNumberLeafs() == tree.GetNumberLeafs());
+    CHECK(mapped->GetLateEntryCount() == tree.GetLateEntryCount());
+
+    for (auto [a, b] : std::vector<std::pair<uint64_t, uint64_t>>{
+             {0, 100'000}, {45, 55}, {47, 48}, {0, 12}, {9'990, 20'000}, {1'234, 5'678}, {20'000, 30'000}}) {
+      auto expected = tree.Query(a, b);
+      auto got = mapped->Query(a, b);
+      REQUIRE(got.has_value() == expected.has_value());
+      if (!expected) {
+        CHECK(got.error() == expected.error());
+        continue;
+      }
+
+      std::vector<TimeRange_t> iterated;
+      auto range = mapped->QueryRange(a, b);
+      REQUIRE(range.has_value());
+      for (const TimeRange_t entry : *range) {
+        iterated.push_back(entry);
+      }
+
+      REQUIRE(got->size() == expected->size());
+      REQUIRE(iterated.size() == expected->size());
+      for (std::size_t i = 0; i < expected->size(); ++i) {
+        CHECK(got->at(i).start == expected->at(i).start);
+        CHECK(got->at(i).ptr == expected->at(i).ptr);
+        CHECK(iterated[i].start == expected->at(i).start);
+        CHECK(iterated[i].ptr == expected->at(i).ptr);
+      }
+    }
+    CHECK(mapped->Query(2, 1) == tl::unexpected(Errors_e::INVALID_TIME_RANGE));
+
+    auto sameEntries = [](const auto& expected, const auto& got) {
+      REQUIRE(got.has_value() == expected.has_value());
+      if (!expected) {
+        CHECK(got.error() == expected.error());
+        return;
+      }
+      REQUIRE(got->size() == expected->size());
+      for (std::size_t i = 0; i < expected->size(); ++i) {
+        CHECK(got->at(i).start == expected->at(i).start);
+        CHECK(got->at(i).ptr == expected->at(i).ptr);
+      }
+    };
+    ThreadPool pool(2);
+    for (auto [a, b] : std::vector<std::pair<uint64_t, uint64_t>>{
+             {0, 100'000}, {45, 55}, {47, 48}, {0, 12}, {9'990, 20'000}, {1'234, 5'678}, {20'000, 30'000}, {2, 1}}) {
+      sameEntries(tree.Query(a, b), mapped->ParallelQuery(a, b, pool));
+    }
+    for (auto [n, before] : std::vector<std::pair<std::size_t, uint64_t>>{
+             {1, std::numeric_limits<uint64_t>::max()}, {7, 5'000}, {100, 9'999}, {3, 12}, {2'000, 100'000}, {5, 3}}) {
+      sameEntries(tree.QueryLatest(n, before), mapped->QueryLatest(n, before));
+    }
+    const std::vector<std::pair<uint64_t, uint64_t>> windows{
+        {0, 12}, {10, 10}, {15, 15}, {45, 55}, {47, 48}, {1'234, 5'678}, {1'240, 1'250}, {9'990, 20'000},
+        {20'000, 30'000}};
+    std::vector<TimeRange_t> expectedOut;
+    std::vector<std::size_t> expectedOffsets;
+    std::vector<TimeRange_t> out;
+    std::vector<std::size_t> offsets;
+    REQUIRE(tree.QueryMany(windows, expectedOut, expectedOffsets).has_value());
+    REQUIRE(mapped->QueryMany(windows, out, offsets).has_value());
+    CHECK(offsets == expectedOffsets);
+    REQUIRE(out.size() == expectedOut.size());
+    for (std::size_t i = 0; i < out.size(); ++i) {
+      CHECK(out[i].start == expectedOut[i].start);
+      CHECK(out[i].ptr == expectedOut[i].ptr);
+    }
+
+    for (auto [a, b] : std::vector<std::pair<uint64_t, uint64_t>>{
+             {0, 100'000}, {45, 55}, {47, 48}, {0, 9}, {15, 15}, {1'234, 5'678}, {9'990, 20'000}, {20'000, 30'000}}) {
+      CHECK(mapped->Count(a, b) == tree.Count(a, b));
+      CHECK(mapped->Any(a, b) == tree.Any(a, b));
+    }
+    CHECK(mapped->Count(2, 1) == tl::unexpected(Errors_e::INVALID_TIME_RANGE));
+
+    for (uint64_t t : {uint64_t{0}, uint64_t{9}, uint64_t{10}, uint64_t{13}, uint64_t{16}, uint64_t{2'345},
+                       uint64_t{9'995}, uint64_t{10'003}, std::numeric_limits<uint64_t>::max()}) {
+      const std::optional<TimeRange_t> expected = tree.AsOf(t);
+      const std::optional<TimeRange_t> got = mapped->AsOf(t);
+      REQUIRE(got.has_value() == expected.has_value());
+      if (expected) {
+        CHECK(got->start == expected->start);
+        CHECK(got->ptr == expected->ptr);
+      }
+    }
+  };
+
+  SUBCASE("Plain tree") {
+    checkSame();
+  };
+
+  SUBCASE("Late entries") {
+    tree.Insert(9'995, 9'996, 42);
+    tree.Insert(15, 16, 43);
+    checkSame();
+  };
+
+  SUBCASE("Collapsed nodes") {
+    std::vector<TimeRange_t> removed;
+    tree.Aggregate(2'000, removed);
+    checkSame();
+  };
+
+  SUBCASE("Collapsed nodes on several levels") {
+    std::vector<TimeRange_t> removed;
+    tree.Aggregate(6'000, removed);
+    tree.Aggregate(6'000, removed);
+    tree.Aggregate(3'000, removed);
+    checkSame();
+  };
+
+  SUBCASE("Start lookup") {
+    REQUIRE(tree.Save(path).has_value());
+    auto mapped = MappedTimeTree<4, 3>::Open(path);
+    REQUIRE(mapped.has_value());
+    CHECK(mapped->FindStartOfRange(0).level == 0);
+    CHECK(mapped->FindStartOfRange(0).index == 0);
+    CHECK(mapped->FindStartOfRange(55).index == 1);
+    CHECK(!mapped->FindStartOfRange(20'000).Valid());
+  };
+
+  SUBCASE("Rejected checkpoints") {
+    REQUIRE(tree.Save(path).has_value());
+    CHECK(MappedTimeTree<4>::Open(path) == tl::unexpected(Errors_e::INVALID_CHECKPOINT));
+
+    auto corrupt = [&path](std::size_t offset, auto value) {
+      std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+      file.seekp(static_cast<std::streamoff>(offset));
+      file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    };
+    const std::size_t innerOffset =
+        sizeof(checkpoint::Header_t) + tree.GetNumberLeafs() * sizeof(checkpoint::LeafRecord_t<4>);
+    corrupt(sizeof(checkpoint::Header_t) + offsetof(checkpoint::NodeRecord_t, count), uint32_t{5});
+    CHECK(MappedTimeTree<4, 3>::Open(path) == tl::unexpected(Errors_e::INVALID_CHECKPOINT));
+    REQUIRE(tree.Save(path).has_value());
+    corrupt(innerOffset + offsetof(checkpoint::InnerRecord_t<3>, firstChild), uint64_t{1});
+    CHECK(MappedTimeTree<4, 3>::Open(path) == tl::unexpected(Errors_e::INVALID_CHECKPOINT));
+    REQUIRE(tree.Save(path).has_value());
+    CHECK(MappedTimeTree<4, 3>::Open(path).has_value());
+
+    std::filesystem::remove(path);
+    CHECK(MappedTimeTree<4, 3>::Open(path) == tl::unexpected(Errors_e::IO_ERROR));
+  };
+
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("Write-ahead log") {
+  const auto dir = std::filesystem::temp_directory_path();
+  const std::string logPath = (dir / "timetree-wal-test").string();
+  const std::string checkpointPath = (dir / "timetree-wal-checkpoint-test").string();
+  std::filesystem::remove(logPath);
+
+  auto sameEntries = [](auto& expected, auto& recovered) {
+    auto want = expected.Query(0, 1'000'000);
+    auto got = recovered.Query(0, 1'000'000);
+    REQUIRE(want.has_value() == got.has_value());
+    if (want) {
+      REQUIRE(got->size() == want->size());
+      for (std::size_t i = 0; i < want->size(); ++i) {
+        CHECK(got->at(i).start == want->at(i).start);
+        CHECK(got->at(i).ptr == want->at(i).ptr);
+        CHECK(got->at(i).value == want->at(i).value);
+      }
+    }
+  };
+
+  TimeTree<4> tree;
+  {
+    auto log = WriteAheadLog::Open(logPath, {.records = 16});
+    REQUIRE(log.has_value());
+    for (uint64_t i = 1; i <= 100; ++i) {
+      CHECK(*log->LogInsert(i * 10, i * 10 + 5, i, static_cast<double>(i) / 2) == i);
+      tree.Insert(i * 10, i * 10 + 5, i, static_cast<double>(i) / 2);
+    }
+    // 96 records went out in groups of 16, the rest waits for the next commit
+    CHECK(log->GetDurableSequence() == 96);
+    CHECK(log->Sync().has_value());
+    CHECK(log->GetDurableSequence() == 100);
+  }
+
+  SUBCASE("Replay into an empty tree") {
+    TimeTree<4> recovered;
+    CHECK(*WriteAheadLog::Replay(logPath, recovered) == 100);
+    CHECK(recovered.GetLogSequence() == 100);
+    sameEntries(tree, recovered);
+    // Replaying again applies nothing
+    CHECK(*WriteAheadLog::Replay(logPath, recovered) == 0);
+  };
+
+  SUBCASE("Replay on top of a checkpoint") {
+    TimeTree<4> checkpointed;
+    CHECK(*WriteAheadLog::Replay(logPath, checkpointed) == 100);
+    REQUIRE(checkpointed.Save(checkpointPath).has_value());
+
+    {
+      auto log = WriteAheadLog::Open(logPath, {}, checkpointed.GetLogSequence());
+      REQUIRE(log.has_value());
+      CHECK(log->GetSequence() == 100);
+      for (uint64_t i = 101; i <= 150; ++i) {
+        log->LogInsert(i * 10, i * 10 + 5, i);
+        tree.Insert(i * 10, i * 10 + 5, i);
+      }
+      log->LogAggregate(300);
+      std::vector<TimeRange_t> removed;
+      tree.Aggregate(300, removed);
+    }
+
+    auto recovered = TimeTree<4>::Load(checkpointPath);
+    REQUIRE(recovered.has_value());
+    CHECK(recovered->GetLogSequence() == 100);
+    CHECK(*WriteAheadLog::Replay(logPath, *recovered) == 51);
+    CHECK(recovered->GetLogSequence() == 151);
+    sameEntries(tree, *recovered);
+  };
+
+  SUBCASE("Dropped history") {
+    {
+      auto log = WriteAheadLog::Open(logPath, {});
+      REQUIRE(log.has_value());
+      CHECK(*log->LogDropBefore(300) == 101);
+      tree.DropBefore(300, [](const TimeRange_t&) {});
+    }
+    TimeTree<4> recovered;
+    CHECK(*WriteAheadLog::Replay(logPath, recovered) == 101);
+    CHECK(recovered.Query(0, 1'000'000)->front().start == tree.Query(0, 1'000'000)->front().start);
+    sameEntries(tree, recovered);
+  };
+
+  SUBCASE("Truncated log keeps counting") {
+    {
+      auto log = WriteAheadLog::Open(logPath, {});
+      REQUIRE(log.has_value());
+      CHECK(log->Truncate().has_value());
+      CHECK(std::filesystem::file_size(logPath) == 0);
+      CHECK(*log->LogInsert(2'000, 2'001, 0) == 101);
+    }
+    auto log = WriteAheadLog::Open(logPath, {});
+    CHECK(log->GetSequence() == 101);
+  };
+
+  SUBCASE("Torn tail") {
+    std::filesystem::resize_file(logPath, std::filesystem::file_size(logPath) - 7);
+    TimeTree<4> recovered;
+    CHECK(*WriteAheadLog::Replay(logPath, recovered) == 99);
+    {
+      // Opening cuts the torn record off and continues after the last intact one
+      auto log = WriteAheadLog::Open(logPath, {.records = 1});
+      CHECK(log->GetSequence() == 99);
+      CHECK(std::filesystem::file_size(logPath) == 99 * sizeof(WriteAheadLog::Record_t));
+      log->LogInsert(1'000, 1'005, 100, 50);
+    }
+    CHECK(*WriteAheadLog::Replay(logPath, recovered) == 1);
+    sameEntries(tree, recovered);
+  };
+
+  SUBCASE("Corrupted record") {
+    std::fstream file(logPath, std::ios::binary | std::ios::in | std::ios::out);
+    file.seekp(static_cast<std::streamoff>(50 * sizeof(WriteAheadLog::Record_t) + 20));
+    file.put('x');
+    file.close();
+    TimeTree<4> recovered;
+    CHECK(*WriteAheadLog::Replay(logPath, recovered) == 50);
+  };
+
+  CHECK(WriteAheadLog::Replay((dir / "timetree-missing-wal").string(), tree) == tl::unexpected(Errors_e::IO_ERROR));
+  std::filesystem::remove(logPath);
+  std::filesystem::remove(checkpointPath);
+}
+
+TEST_CASE("Concurrent readers") {
+  using Tree = TimeTree<8, 8, SlabAllocator<8>>;
+  constexpr uint64_t entries = 20'000;
+  constexpr std::size_t readers = 4;
+  Tree tree;
+  std::atomic<bool> done{false};
+  std::atomic<std::size_t> failures{0};
+  std::atomic<std::size_t> queries{0};
+
+  // Runs check on queries from several threads while write fills the tree
+  auto run = [&](auto&& write, auto&& check) {
+    std::vector<std::thread> threads;
+    for (std::size_t r = 0; r < readers; ++r) {
+      threads.emplace_back([&, r]() {
+        while (!done.load()) {
+          if (!check(r)) {
+            ++failures;
+          }
+          ++queries;
+        }
+      });
+    }
+    write();
+    done = true;
+    for (std::thread& thread : threads) {
+      thread.join();
+    }
+  };
+
+  SUBCASE("In order inserts are seen as a growing prefix") {
+    std::array<std::size_t, readers> seen{};
+    run(
+        [&tree]() {
+          for (uint64_t i = 1; i <= entries; ++i) {
+            tree.Insert(i, i, i);
+          }
+        },
+        [&tree, &seen](std::size_t reader) {
+          std::size_t count = 0;
+          bool contiguous = true;
+          auto visited = tree.QueryVisit(0, entries, [&count, &contiguous](const TimeRange_t& range) {
+            ++count;
+            contiguous = contiguous && range.start == count && range.ptr == count;
+          });
+          const bool grew = count >= seen[reader];
+          seen[reader] = count;
+          return (visited.has_value() || count == 0) && contiguous && grew;
+        });
+    CHECK(tree.Query(0, entries)->size() == entries);
+  };
+
+  SUBCASE("Leafs are compressed under readers") {
+    tree.SetLeafCompression(true);
+    run(
+        [&tree]() {
+          for (uint64_t i = 1; i <= entries; ++i) {
+            tree.Insert(i, i, i, static_cast<double>(i));
+          }
+        },
+        [&tree](std::size_t /*reader*/) {
+          std::size_t count = 0;
+          bool contiguous = true;
+          auto visited = tree.QueryVisit(0, entries, [&count, &contiguous](const TimeRange_t& range) {
+            ++count;
+            contiguous = contiguous && range.start == count && range.value == static_cast<double>(count);
+          });
+          // Well behind the newest entry every node is complete, the summary has to be exact
+          const bool summarized = count < 1'000 || tree.AggregateQuery(count / 2, count / 2 + 99)->count == 100;
+          return (visited.has_value() || count == 0) && contiguous && summarized;
+        });
+    CHECK(tree.Query(0, entries)->size() == entries);
+  };
+
+  SUBCASE("Parallel scans under readers") {
+    ThreadPool pool(2);
+    run(
+        [&tree]() {
+          for (uint64_t i = 1; i <= entries; ++i) {
+            tree.Insert(i, i, i);
+          }
+        },
+        [&tree, &pool](std::size_t /*reader*/) {
+          auto res = tree.ParallelQuery(0, entries, pool);
+          if (!res) {
+            return true;
+          }
+          // A prefix of the inserts without gaps, however the range was split
+          for (std::size_t i = 0; i < res->size(); ++i) {
+            if (res->at(i).start != i + 1) {
+              return false;
+            }
+          }
+          return true;
+        });
+    CHECK(tree.ParallelQuery(0, entries, pool)->size() == entries);
+  };
+
+  SUBCASE("Node iteration under readers") {
+    tree.SetLeafCompression(true);
+    run(
+        [&tree]() {
+          std::vector<TimeRange_t> removed;
+          for (uint64_t i = 1; i <= entries; ++i) {
+            tree.Insert(i, i, i);
+            if (i % 4'096 == 0) {
+              tree.Aggregate(i - 2'048, removed);
+            }
+          }
+        },
+        [&tree](std::size_t reader) {
+          // Leafs replaced by their compressed copy or collapsed away stay readable until the iterator is gone
+          uint64_t previous = 0;
+          bool ordered = true;
+          if (reader % 2 == 0) {
+            for (const auto& node : tree) {
+              ordered = ordered && node.GetNodeStart() >= previous;
+              previous = node.GetNodeStart();
+            }
+          } else {
+            // The oldest node steps back to the end
+            const auto last = tree.end();
+            previous = std::numeric_limits<uint64_t>::max();
+            for (auto it = std::prev(last); it != last; --it) {
+              ordered = ordered && it->GetNodeStart() <= previous;
+              previous = it->GetNodeStart();
+            }
+          }
+          return ordered;
+        });
+    CHECK(std::distance(tree.begin(), tree.end()) > 0);
+  };
+
+  SUBCASE("Sealing under readers") {
+    run(
+        [&tree]() {
+          std::vector<TimeRange_t> removed;
+          for (uint64_t i = 1; i <= entries; ++i) {
+            tree.Insert(i, i, i);
+            if (i % 1'000 == 0) {
+              tree.Seal();
+            }
+            if (i % 4'096 == 0) {
+              tree.Aggregate(i - 2'048, removed);
+            }
+          }
+        },
+        [&tree, &queries](std::size_t /*reader*/) {
+          const uint64_t start = (queries.load() * 7'919) % entries + 1;
+          uint64_t expected = start;
+          bool contiguous = true;
+          std::ignore = tree.QueryVisit(start, start + 9, [&expected, &contiguous](const TimeRange_t& range) {
+            // Collapsed nodes carry ptr 0 and cover every entry up to their end
+            if (range.ptr == 0) {
+              contiguous = contiguous && range.start <= expected && range.end >= expected;
+              expected = range.end + 1;
+            } else {
+              contiguous = contiguous && range.start == expected;
+              ++expected;
+            }
+          });
+          return contiguous;
+        });
+    CHECK(tree.Query(entries - 100, entries - 1)->size() == 100);
+  };
+
+  SUBCASE("Late entries and aggregation") {
+    run(
+        [&tree]() {
+          std::vector<TimeRange_t> removed;
+          for (uint64_t i = 1; i <= entries; ++i) {
+            // Every 16th entry shows up a few entries late
+            if (i % 16 == 0) {
+              continue;
+            }
+            tree.Insert(i, i, i);
+            if (i % 16 == 5 && i > 16) {
+              tree.Insert(i - 5, i - 5, i - 5);
+            }
+            if (i % 4096 == 0) {
+              tree.Aggregate(i - 2048, removed);
+            }
+          }
+        },
+        [&tree](std::size_t reader) {
+          uint64_t previous = 0;
+          bool ordered = true;
+          auto check = [&previous, &ordered](const TimeRange_t& range) {
+            // Entries collapsed into an aggregate carry its ptr instead of their start, none is assigned here
+            ordered = ordered && range.start >= previous && (range.ptr == range.start || range.ptr == 0);
+            previous = range.start;
+          };
+          if (reader % 2 == 0) {
+            std::ignore = tree.QueryVisit(0, entries, check);
+          } else if (auto range = tree.QueryRange(0, entries)) {
+            for (const TimeRange_t entry : *range) {
+              check(entry);
+            }
+          }
+          return ordered;
+        });
+    CHECK(tree.Query(entries - 100, entries - 1)->size() == 100);
+  };
+
+  CHECK(failures == 0);
+  CHECK(queries != 0);
+}
+
+TEST_CASE("Thread pool") {
+  ThreadPool pool(4);
+  CHECK(pool.GetThreadCount() == 4);
+  std::vector<std::atomic<int>> hits(10'000);
+  pool.ParallelFor(hits.size(), [&hits](std::size_t i) { ++hits[i]; });
+  CHECK(std::all_of(hits.begin(), hits.end(), [](const std::atomic<int>& hit) { return hit == 1; }));
+
+  // Nested calls are worked off by the calling threads
+  std::atomic<std::size_t> inner{0};
+  pool.ParallelFor(8, [&pool, &inner](std::size_t) { pool.ParallelFor(100, [&inner](std::size_t) { ++inner; }); });
+  CHECK(inner == 800);
+  pool.ParallelFor(0, [](std::size_t) { CHECK(false); });
+}
+
+TEST_CASE("Tree sets") {
+  TimeTreeSet<4> set(4, 2);
+  // Series s holds the ranges [i, i + s] for every i in 1..s * 3
+  for (uint64_t series = 1; series <= 10; ++series) {
+    for (uint64_t i = 1; i <= series * 3; ++i) {
+      CHECK(set.Insert(series, i, i + series, series).has_value());
+    }
+  }
+  CHECK(set.GetSeriesCount() == 10);
+
+  SUBCASE("Small series stay inline") {
+    // Series 1 fits a single leaf, the others were moved into trees
+    CHECK(set.GetTreeCount() == 9);
+    TimeTreeSet<4> small(1, 1);
+    CHECK(small.Insert(7, 10, 12, 1).has_value());
+    CHECK(small.Insert(7, 5, 6, 2).has_value());
+    CHECK(small.GetTreeCount() == 0);
+    CHECK(small.GetBytesHeld() == 2 * sizeof(TimeRange_t));
+    auto res = small.Query(7, 0, 100);
+    REQUIRE(res.has_value());
+    REQUIRE(res->size() == 2);
+    CHECK(res->front().ptr == 2);
+    CHECK(small.Query(7, 13, 20) == tl::unexpected(Errors_e::RANGE_NOT_IN_DB));
+    CHECK(small.Query(8, 0, 100) == tl::unexpected(Errors_e::RANGE_NOT_IN_DB));
+    CHECK(small.Insert(7, 2, 1, 0) == tl::unexpected(Errors_e::INVALID_TIME_RANGE));
+  };
+
+  SUBCASE("Series match standalone trees") {
+    for (uint64_t series = 1; series <= 10; ++series) {
+      TimeTree<4> tree;
+      for (uint64_t i = 1; i <= series * 3; ++i) {
+        tree.Insert(i, i + series, series);
+      }
+      auto expected = tree.Query(5, 9);
+      auto res = set.Query(series, 5, 9);
+      REQUIRE(res.has_value() == expected.has_value());
+      if (!res) {
+        continue;
+      }
+      REQUIRE(res->size() == expected->size());
+      for (std::size_t i = 0; i < res->size(); ++i) {
+        CHECK((*res)[i].start == (*expected)[i].start);
+        CHECK((*res)[i].end == (*expected)[i].end);
+      }
+    }
+  };
+
+  SUBCASE("Fan-out queries") {
+    const std::vector<uint64_t> ids{3, 1, 10, 42};
+    auto res = set.QueryMany(ids, 4, 6);
+    REQUIRE(res.has_value());
+    std::size_t expected = 0;
+    for (uint64_t series : {1, 3, 10}) {
+      expected += set.Query(series, 4, 6)->size();
+    }
+    CHECK(res->size() == expected);
+    CHECK(std::is_sorted(res->begin(), res->end(), [](const TimeRange_t& a, const TimeRange_t& b) {
+      return a.start < b.start;
+    }));
+    CHECK(set.QueryMany(ids, 6, 4) == tl::unexpected(Errors_e::INVALID_TIME_RANGE));
+    CHECK(set.QueryMany({}, 4, 6)->empty());
+  };
+
+  SUBCASE("Concurrent writers") {
+    std::vector<std::thread> writers;
+    for (uint64_t w = 0; w < 4; ++w) {
+      writers.emplace_back([&set, w]() {
+        for (uint64_t i = 1; i <= 1'000; ++i) {
+          std::ignore = set.Insert(100 + (i % 50) * 4 + w, i, i, i);
+        }
+      });
+    }
+    for (std::thread& writer : writers) {
+      writer.join();
+    }
+    CHECK(set.GetSeriesCount() == 210);
+    std::vector<uint64_t> ids;
+    for (uint64_t series = 100; series < 300; ++series) {
+      ids.push_back(series);
+    }
+    CHECK(set.QueryMany(ids, 0, 2'000)->size() == 4'000);
+  };
+
+  SUBCASE("Readers alongside writers") {
+    std::atomic<bool> done{false};
+    std::vector<std::thread> readers;
+    for (std::size_t r = 0; r < 2; ++r) {
+      readers.emplace_back([&set, &done]() {
+        while (!done) {
+          // Series 500 + w holds the ranges [i, i] for i in 1..n, so every result is a prefix of that
+          for (uint64_t series = 500; series < 502; ++series) {
+            auto res = set.Query(series, 0, 10'000);
+            if (!res) {
+              continue;
+            }
+            for (std::size_t i = 0; i < res->size(); ++i) {
+              CHECK((*res)[i].start == i + 1);
+            }
+          }
+        }
+      });
+    }
+    std::vector<std::thread> writers;
+    for (uint64_t w = 0; w < 2; ++w) {
+      writers.emplace_back([&set, w]() {
+        for (uint64_t i = 1; i <= 5'000; ++i) {
+          CHECK(set.Insert(500 + w, i, i, i).has_value());
+        }
+      });
+    }
+    for (std::thread& writer : writers) {
+      writer.join();
+    }
+    done = true;
+    for (std::thread& reader : readers) {
+      reader.join();
+    }
+    CHECK(set.Query(500, 0, 10'000)->size() == 5'000);
+    CHECK(set.Query(501, 0, 10'000)->size() == 5'000);
+  };
+}
+
+TEST_CASE("Range aggregates") {
+  const std::string path = (std::filesystem::temp_directory_path() / "timetree-aggregate-test").string();
+
+  // Summary of the entries a regular query returns, collapsed nodes count once with their mean
+  auto scan = [](const auto& tree, uint64_t start, uint64_t end) {
+    Summary_t summary;
+    CHECK(tree.QueryVisit(start, end, [&summary](const TimeRange_t& range) { summary.Add(range.value); }));
+    return summary;
+  };
+  auto checkSame = [](const Summary_t& got, const Summary_t& want) {
+    CHECK(got.count == want.count);
+    CHECK(got.sum == want.sum);
+    CHECK(got.min == want.min);
+    CHECK(got.max == want.max);
+  };
+  const std::vector<std::pair<uint64_t, uint64_t>> ranges{
+      {0, 100'000}, {15, 15}, {17, 19}, {23, 4'567}, {1'000, 2'000}, {9'995, 10'005}, {4'444, 4'444}};
+
+  TimeTree<4, 3> tree;
+  for (uint64_t i = 1; i <= 1'000; ++i) {
+    tree.Insert(i * 10, i * 10 + 5, i, static_cast<double>(i));
+  }
+
+  SUBCASE("Matches a scan over the query") {
+    for (const auto& [start, end] : ranges) {
+      auto res = tree.AggregateQuery(start, end);
+      REQUIRE(res.has_value());
+      checkSame(*res, scan(tree, start, end));
+    }
+    const Summary_t root = tree.GetRoot()->GetSummary();
+    CHECK(root.count == 1'000);
+    CHECK(root.sum == 500'500);
+    CHECK(root.min == 1);
+    CHECK(root.max == 1'000);
+    CHECK(tree.AggregateQuery(17, 19)->count == 0);
+    CHECK(tree.AggregateQuery(1'000, 2'000)->Mean() == 150);
+    CHECK(tree.AggregateQuery(5, 4) == tl::unexpected(Errors_e::INVALID_TIME_RANGE));
+    CHECK(tree.AggregateQuery(20'000, 30'000) == tl::unexpected(Errors_e::RANGE_NOT_IN_DB));
+  };
+
+  SUBCASE("Batches, late entries and truncation") {
+    std::vector<TimeRange_t> batch;
+    for (uint64_t i = 1'001; i <= 1'100; ++i) {
+      batch.push_back({i * 10, i * 10 + 5, i, static_cast<double>(i)});
+    }
+    CHECK(tree.InsertBatch(batch).has_value());
+    CHECK(tree.Insert(505, 506, 0, -1).has_value());
+    CHECK(tree.GetLateEntryCount() == 1);
+    for (const auto& [start, end] : ranges) {
+      checkSame(*tree.AggregateQuery(start, end), scan(tree, start, end));
+    }
+    CHECK(tree.AggregateQuery(505, 506)->min == -1);
+
+    // Merging the late entry rewrites the right edge of the tree, the summaries are rebuilt along with it
+    tree.FlushLateEntries();
+    const Summary_t root = tree.GetRoot()->GetSummary();
+    CHECK(root.count == 1'101);
+    CHECK(root.sum == 1100 * 1101 / 2 - 1);
+    for (const auto& [start, end] : ranges) {
+      checkSame(*tree.AggregateQuery(start, end), scan(tree, start, end));
+    }
+  };
+
+  SUBCASE("Collapsed nodes keep their summary") {
+    std::vector<TimeRange_t> removed;
+    tree.Aggregate(2'000, removed);
+    CHECK(tree.GetRoot()->GetSummary().count == 1'000);
+    CHECK(tree.AggregateQuery(0, 100'000)->sum == 500'500);
+    // The collapsed leaf holding [1'950, 1'955] counts with all four of its entries
+    CHECK(tree.AggregateQuery(1'950, 1'951)->count == 4);
+    CHECK(tree.AggregateQuery(1'950, 1'951)->sum == 193 + 194 + 195 + 196);
+    checkSame(*tree.AggregateQuery(2'100, 3'000), scan(tree, 2'100, 3'000));
+  };
+
+  SUBCASE("Checkpoints carry values and summaries") {
+    CHECK(tree.Insert(505, 506, 0, -1).has_value());
+    CHECK(tree.Save(path).has_value());
+    auto loaded = TimeTree<4, 3>::Load(path, 2);
+    REQUIRE(loaded.has_value());
+    auto mapped = MappedTimeTree<4, 3>::Open(path);
+    REQUIRE(mapped.has_value());
+    for (const auto& [start, end] : ranges) {
+      const Summary_t want = *tree.AggregateQuery(start, end);
+      checkSame(*loaded->AggregateQuery(start, end), want);
+      checkSame(*mapped->AggregateQuery(start, end), want);
+      checkSame(scan(*mapped, start, end), want);
+    }
+    CHECK(mapped->AggregateQuery(5, 4) == tl::unexpected(Errors_e::INVALID_TIME_RANGE));
+    CHECK(mapped->AggregateQuery(20'000, 30'000) == tl::unexpected(Errors_e::RANGE_NOT_IN_DB));
+  };
+
+  std::filesystem::remove(path);
+}